@@ -0,0 +1,104 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * bench_decode.c: Microbenchmark of the MP4 table decoders.
+ *
+ * Compares the original byte loop (read_xx() per entry) with the plain C
+ * and the vector versions of decode_table() on synthetic stsz, stts, stsc
+ * and co64 columns. Build and run with "make bench".
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/decode.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#define ENTRIES     (1 << 22)                   // entries per table
+#define ROUNDS      20                          // decodes per measurement
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Original reader (as used for every table entry before decode_table()).
+ */
+static uint64_t read_xx(const uint8_t* buffer, uint8_t bits) {
+    uint64_t result = 0;
+    uint8_t i;
+    uint8_t bytes = bits >> 3;
+    for (i = 0, bits -= 8; i < bytes; i++, bits -= 8) {
+        result |= (uint64_t)buffer[i] << bits;
+    }
+    return result;
+}
+
+static void decode_loop(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride, uint8_t bits) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        values[i] = read_xx(buffer + i * stride, bits);
+    }
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+typedef void (*decoder_t)(uint64_t*, const uint8_t*, size_t, size_t, uint8_t);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double measure(decoder_t decoder, uint64_t* values, const uint8_t* buffer, size_t stride, uint8_t bits) {
+    int    i;
+    double start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        decoder(values, buffer, ENTRIES, stride, bits);
+    }
+    return (now() - start) / ROUNDS;
+}
+
+static void bench(const char* name, size_t offset, size_t stride, uint8_t bits) {
+    size_t    i;
+    uint8_t*  buffer = malloc(ENTRIES * stride);
+    uint64_t* a = malloc(ENTRIES * sizeof(uint64_t));
+    uint64_t* b = malloc(ENTRIES * sizeof(uint64_t));
+    uint64_t* c = malloc(ENTRIES * sizeof(uint64_t));
+
+    // synthetic table
+    for (i = 0; i < ENTRIES * stride; i++) {
+        buffer[i] = rand();
+    }
+
+    // measure
+    double loop = measure(decode_loop, a, buffer + offset, stride, bits);
+    double scalar = measure(decode_table_c, b, buffer + offset, stride, bits);
+    double vector = measure(decode_table, c, buffer + offset, stride, bits);
+
+    // verify and report
+    int same = !memcmp(a, b, ENTRIES * sizeof(uint64_t)) && !memcmp(a, c, ENTRIES * sizeof(uint64_t));
+    printf("%-6s loop %7.2f ms, plain %7.2f ms (x%5.2f), vector %7.2f ms (x%5.2f)%s\n", name,
+           loop * 1e3, scalar * 1e3, loop / scalar, vector * 1e3, loop / vector, same ? "" : " MISMATCH!");
+
+    free(buffer);
+    free(a);
+    free(b);
+    free(c);
+}
+
+int main() {
+    printf("%d entries, average of %d rounds\n", ENTRIES, ROUNDS);
+    bench("stsz", 0, 4, 32);
+    bench("stco", 0, 4, 32);
+    bench("stts", 4, 8, 32);
+    bench("stsc", 4, 12, 32);
+    bench("co64", 0, 8, 64);
+    return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * bench_offsets.c: Benchmark of the MP4 period offsets generation.
+ *
+ * Builds the sample tables of a synthetic 10 hour video track (variable
+ * frame durations, chunk sizes and sample sizes, 64bit chunk offsets) and
+ * compares the original table walk with compile_offsets() for several
+ * periods. Build and run with "make bench".
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "../src/stream_mp4.c"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#define HOURS       10                          // track length
+#define SCALE       90000                       // media time-scale
+#define FPS         25                          // nominal frame rate
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Minimal replacements for the server routines used by the parser.
+ */
+void* ALLOC(size_t size) { return malloc(size); }
+void* ZALLOC(size_t size) { return calloc(1, size); }
+void* REALLOC(void* pointer, size_t size) { return realloc(pointer, size); }
+void  ZERO(void* pointer, size_t size) { memset(pointer, 0, size); }
+
+char* FORMAT(const char* format, ...) {
+    char*   result = NULL;
+    va_list args;
+    va_start(args, format);
+    if (vasprintf(&result, format, args) < 0) result = NULL;
+    va_end(args);
+    return result;
+}
+
+uint64_t read_xx(const uint8_t* buffer, uint8_t bits) {
+    uint64_t result = 0;
+    uint8_t i;
+    uint8_t bytes = bits >> 3;
+    for (i = 0, bits -= 8; i < bytes; i++, bits -= 8) {
+        result |= (uint64_t)buffer[i] << bits;
+    }
+    return result;
+}
+
+void write_xx(uint8_t* buffer, uint64_t value, uint8_t bits) {
+    uint8_t i;
+    uint8_t bytes = bits >> 3;
+    for (i = 0, bits -= 8; i < bytes; i++, bits -= 8) {
+        buffer[i] = value >> bits;
+    }
+}
+
+void* stream_cache_get(stream_t* self, const char* name, int* size) { return NULL; }
+void  stream_cache_put(stream_t* self, const char* name, const void* data, int size) { }
+void  stream_cache_putv(stream_t* self, const char* name, const struct iovec* data, int count) { }
+void  stream_head_add(stream_t* self, const void* base, size_t size) { }
+void  stream_head_keep(stream_t* self, void* block) { }
+int   stream_lazy(stream_t* self) { return 0; }
+void  stream_complete(stream_t* self) { }
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Original generator (walks the big-endian tables for every period).
+ */
+static void walk_offsets(stbl_t* stbl, uint64_t period, off_t* offsets, size_t periods) {
+    uint32_t i;
+    uint8_t* p;
+    uint64_t u = 0, d = 0, c = 0;
+    uint64_t t = 0, n = 0, k = 0;
+
+    uint64_t time = 0;
+    tbli_t   sample = {0, 0};
+    uint64_t sample_id = 0;
+    tbli_t   chunk = {0, 0};
+    uint64_t chunk_last = 0;
+    uint64_t chunk_id = 0;
+    uint64_t chunk_sample = 0;
+
+    uint64_t offset;
+
+    for (i = 0; i < periods; i++, time += period) {
+        p = stbl->stts.data + 8 * sample.index;
+        u = d = c = 0;
+        for (; sample.index < stbl->stts.count; sample.index++, p += 8) {
+            c  = read_32(&p[0]);
+            d  = read_32(&p[4]);
+            u  = c * d;
+            if ((t + u) > time) break;
+            n += c;
+            t += u;
+            d  = 1;
+        }
+        if (!d) {
+            sample_id     = stbl->max_samples;
+        } else {
+            sample.offset = (time - t) / d;
+            sample_id     = MIN(n + sample.offset, stbl->max_samples);
+        }
+
+        p = stbl->stsc.data + 12 * chunk.index;
+        u = d = c = 0;
+        for (; chunk.index < stbl->stsc.count; chunk.index++, p += 12) {
+            c = read_32(&p[4]);
+            d = (chunk.index == (stbl->stsc.count - 1)) ?
+                 stbl->max_chunks : (read_32(&p[12]) - 1);
+            u = d - chunk_last;
+            d = u * c;
+            if ((k + d) > sample_id) break;
+            k += d;
+            chunk_last += u;
+            c = 1;
+        }
+        if (!c) {
+            chunk_id = stbl->max_chunks;
+            chunk_sample = 0;
+        } else {
+            d = sample_id - k;
+            chunk.offset = d / c;
+            chunk_id = chunk_last + chunk.offset;
+            chunk_sample = d % c;
+        }
+
+        if (chunk_id < stbl->max_chunks) {
+            offset = read_xx(&stbl->coxx.data[chunk_id * stbl->coxx.bytes], stbl->coxx.bytes << 3);
+        } else {
+            offset = stbl->max_offset;
+        }
+
+        if (stbl->stsz.size) {
+            offset += chunk_sample * stbl->stsz.size;
+        } else if (chunk_sample) {
+            u = chunk_sample;
+            while (u) {
+                offset += read_32(&stbl->stsz.data[(sample_id - u) << 2]);
+                u--;
+            }
+        }
+
+        offsets[i] = offset;
+    }
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void table(stxx_t* stxx, uint8_t* data, uint32_t count, uint8_t bytes) {
+    stxx->atom.size = 1;
+    stxx->data = data;
+    stxx->count = count;
+    stxx->bytes = bytes;
+}
+
+int main() {
+    uint32_t samples = HOURS * 3600 * FPS;
+    uint32_t i, j, n;
+    stbl_t   stbl;
+    ZERO(&stbl, sizeof(stbl_t));
+    srand(1);
+
+    // stts: runs of frames with varying durations
+    uint8_t* stts = ALLOC((size_t)samples * 8);
+    for (i = 0, n = 0; n < samples; i++) {
+        uint32_t c = MIN(1 + rand() % 500, samples - n);
+        write_32(&stts[i * 8], c);
+        write_32(&stts[i * 8 + 4], SCALE / FPS + (rand() % 3) * 150 - 150);
+        n += c;
+    }
+    table(&stbl.stts, stts, i, 8);
+
+    // stss: a keyframe about every two seconds
+    uint8_t* stss = ALLOC((size_t)samples * 4);
+    for (i = 0, n = 1; n <= samples; i++, n += 40 + rand() % 20) {
+        write_32(&stss[i * 4], n);
+    }
+    table(&stbl.stss, stss, i, 4);
+
+    // stsz: variable sample sizes (keyframes not distinguished)
+    uint8_t* stsz = ALLOC((size_t)samples * 4);
+    for (i = 0; i < samples; i++) {
+        write_32(&stsz[i * 4], 2000 + rand() % 60000);
+    }
+    table(&stbl.stsz, stsz, samples, 4);
+
+    // stsc: chunks of 5 to 30 samples (in runs), one co64 offset per chunk
+    uint8_t*  stsc = ALLOC((size_t)samples * 12);
+    uint8_t*  co64 = ALLOC((size_t)samples * 8);
+    uint64_t  offset = 4096;
+    uint32_t  chunks = 0, entries = 0, s = 0;
+    while (s < samples) {
+        uint32_t c = 5 + rand() % 26;
+        uint32_t r = 1 + rand() % 20;
+        for (j = 0; j < r && s < samples; j++) {
+            if ((samples - s) < c) break;
+            write_64(&co64[chunks * 8], offset);
+            for (n = 0; n < c; n++, s++) {
+                offset += read_32(&stsz[s * 4]);
+            }
+            offset += 1000 + rand() % 20000;                                    // interleaved audio
+            if (j == 0) {
+                write_32(&stsc[entries * 12], chunks + 1);
+                write_32(&stsc[entries * 12 + 4], c);
+                write_32(&stsc[entries * 12 + 8], 1);
+                entries++;
+            }
+            chunks++;
+        }
+        if (s < samples && (samples - s) < 5) {                                 // tail chunk
+            c = samples - s;
+            write_64(&co64[chunks * 8], offset);
+            for (; s < samples; s++) {
+                offset += read_32(&stsz[s * 4]);
+            }
+            write_32(&stsc[entries * 12], chunks + 1);
+            write_32(&stsc[entries * 12 + 4], c);
+            write_32(&stsc[entries * 12 + 8], 1);
+            entries++;
+            chunks++;
+        }
+    }
+    table(&stbl.stsc, stsc, entries, 12);
+    table(&stbl.coxx, co64, chunks, 8);
+
+    // prefix tables (built once per file and cached)
+    double  start = now();
+    size_t  size = 0;
+    void*   index = compile_index(&stbl, &size);
+    double  build = now() - start;
+    printf("%u samples, %u stts, %u stsc, %u chunks, %.1f GB, index %.1f MB built in %.2f ms\n",
+           samples, stbl.stts.count, stbl.stsc.count, chunks, offset / 1e9, size / 1e6, build * 1e3);
+
+    // compare
+    double periods[] = { 0.5, 1, 2, 5, 10 };
+    for (i = 0; i < sizeof(periods) / sizeof(double); i++) {
+        size_t   count = ceil((double)HOURS * 3600 / periods[i]);
+        uint64_t period = periods[i] * SCALE;
+        off_t*   a = ALLOC(sizeof(off_t) * count);
+        off_t*   b = ALLOC(sizeof(off_t) * count);
+
+        start = now();
+        walk_offsets(&stbl, period, a, count);
+        double walk = now() - start;
+
+        start = now();
+        compile_offsets(&stbl, period, b, count);
+        double merge = now() - start;
+
+        printf("period %5.1fs (%6zu offsets): walk %8.3f ms, merge %8.3f ms (x%6.2f)%s\n",
+               periods[i], count, walk * 1e3, merge * 1e3, walk / merge,
+               memcmp(a, b, sizeof(off_t) * count) ? " MISMATCH!" : "");
+        free(a);
+        free(b);
+    }
+
+    // done
+    free(index);
+    free(stts);
+    free(stss);
+    free(stsz);
+    free(stsc);
+    free(co64);
+    return 0;
+}
@@ -26,6 +26,12 @@ options.root = 81
 -- you could increase (or multiply) this number to increase performance.
 options.workers = 2
 
+-- Number of metadata parser threads. New streams are parsed by these
+-- threads and only then handed to their workers, so that parsing a large
+-- file that is not cached yet never stalls the streams being served by a
+-- worker. Set it to 0 to have the workers parse metadata themselves.
+options.parsers = 2
+
 -- The maximum number of clients that may be served simultaneously; any
 -- excess clients are dropped (i.e. clear-cut anti-dos mechanism). You
 -- can set this to 0 or negative to disable the restriction altogether.
@@ -39,15 +45,76 @@ options.clients = 10000
 -- in the player. This feature is fully aware of variable bit-rates and
 -- it drastically reduces the costs of bandwidth utilization. Setting
 -- this to 0 disables throttling (unrecommended). Default is 20 seconds.
+-- Throttled streams whose send queue stops draining (the viewer is likely
+-- gone, but the connection lingers) are no longer topped up; they wait for
+-- the queue to drain or time out. Data sent past the play-head of streams
+-- that never finished is reported on the monitor page as 'data:wasted',
+-- in total and for each host.
 options.throttle = 20
 
+-- Bounds (in seconds) within which each stream adapts its own pre-buffering
+-- to the measured state of its connection (congestion window, round-trip
+-- time and data still in flight, see TCP_INFO), starting from the value of
+-- 'options.throttle': clients on fast links get less data ahead of their
+-- play-head, congested clients get more to ride out their stalls. The net
+-- amount of data this saved on abandoned streams is reported on the monitor
+-- page as 'data:saved'. Both bounds are nil by default (a fixed run-ahead);
+-- set them, for instance to 5 and 60, to adapt it.
+options.throttle_min = nil
+options.throttle_max = nil
+
+-- Kernel-side pacing of throttled streams. Instead of leaving the socket in
+-- a burst at line rate once per period, each period's data is spread evenly
+-- by the kernel (SO_MAX_PACING_RATE; TCP internal pacing on Linux 4.13 and
+-- newer, the 'fq' queueing discipline on older kernels) at the rate the
+-- stream needs over the next few periods, as given by its offsets, plus a
+-- little headroom. The initial run-ahead still goes out at full speed. The
+-- share of data retransmitted is reported on the monitor page as
+-- 'data:resent', to compare both modes. Default is false.
+options.pacing = false
+
 -- There are many types of data that are expensive to produce, therefore
 -- they are cached straight in memory (RAM) for fast reuse. This is the
 -- maximum amount of memory (in MegaBytes) the server is allowed to use
 -- for caching purposes. By default this is set to 64 MegaBytes (which is
 -- very low). Set it to 0 to disable caching entirely (not recommended).
+-- Cached entries are bound to the identity of each file (device, inode,
+-- size and modification time) and the hosts' folders are watched so that
+-- entries of changed files are dropped at once; therefore large caches
+-- are safe to use even when files are replaced in place.
 options.cache = 64
 
+-- Name of a shared-memory segment holding the cache (e.g. 'loomiere'), so
+-- that several Loomiere instances running on the same machine share one
+-- cache instead of each keeping its own copy. The segment is created (with
+-- the size given by 'options.cache') by the first instance and is kept
+-- when instances stop, so restarted instances start with a warm cache; to
+-- resize or reset it, stop all instances and delete /dev/shm/<name>. Set
+-- it to nil to keep a private cache in each instance.
+options.shared = nil
+
+-- Folder holding the persistent metadata index (one sidecar file for each
+-- served media file, named after the file's device and inode). Sidecars
+-- are written in the background whenever a file's metadata is parsed and
+-- are used instead of parsing after restarts, so the cache starts warm.
+-- Run 'loomiere --index' to (re)build all sidecars at once and exit. The
+-- folder must be writable. Set it to nil to disable the index entirely.
+options.index = nil
+
+-- Right after start-up the cache is empty, so the first requests of every
+-- file pay the full parsing price. The warmer threads parse metadata into
+-- the cache in the background: first the files listed in the hot list
+-- (the most requested files, saved at the previous shutdown), then every
+-- media file found in the hosts' folders, and later every new file as it
+-- is dropped in those folders. To avoid competing with live streaming the
+-- warmers parse at most 'options.warming' files per second (all threads
+-- combined). Set 'options.warmers' to 0 to disable warming altogether, and
+-- 'options.hotlist' to a file path (in a writable location, for instance
+-- '/var/cache/loomiere/hotlist') to keep a hot list; nil keeps none.
+options.warmers = 1
+options.warming = 10
+options.hotlist = nil
+
 -- Virtual hosts table, where each can be served from a distinct path,
 -- each having an URL routing table. Hosts are in fact Lua regexps (read
 -- http://www.lua.org/manual/5.1/manual.html#5.4.1) and they are matched
@@ -0,0 +1,534 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * cache.c: Metadata cache (private or shared between processes).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Segment layout helpers.
+ */
+#define _ALIGN(x, a)    (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+#define _LOG_FIRST      8                       // first log position (0 marks deleted slots)
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Key hash (FNV-1a, never 0).
+ */
+static uint64_t _cache_hash(const void* key, int ksize) {
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t hash = 14695981039346656037ULL;
+    while (ksize-- > 0) {
+        hash ^= *p++;
+        hash *= 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/*
+ * Writers lock (recovers from writers that died while holding it).
+ */
+static int _cache_lock(cache_t* self) {
+    int status = pthread_mutex_lock(&self->shm->lock);
+    if (status == EOWNERDEAD) {
+        pthread_mutex_consistent(&self->shm->lock);
+        status = 0;
+    }
+    return status;
+}
+
+static void _cache_unlock(cache_t* self) {
+    pthread_mutex_unlock(&self->shm->lock);
+}
+
+/*
+ * Check if a log position has not yet been overwritten.
+ */
+static int _cache_live(cache_t* self, uint64_t position) {
+    return position && self->shm->head <= position + self->shm->log_size;
+}
+
+/*
+ * Read a slot consistently (without locking). Returns 0 on success and
+ * 1 if the slot kept changing.
+ */
+static int _slot_read(cache_t* self, uint64_t index, cache_slot_t* copy) {
+    cache_slot_t* slot = &self->slots[index];
+    int i;
+    for (i = 0; i < CACHE_RETRIES; i++) {
+        uint32_t seq = slot->seq;
+        __sync_synchronize();
+        if (seq & 1) continue;
+        copy->size = slot->size;
+        copy->hash = slot->hash;
+        copy->position = slot->position;
+        __sync_synchronize();
+        if (slot->seq == seq) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Update a slot (writers lock must be held).
+ */
+static void _slot_write(cache_slot_t* slot, uint64_t hash, uint64_t position, uint32_t size) {
+    slot->seq |= 1;
+    __sync_synchronize();
+    slot->hash = hash;
+    slot->position = position;
+    slot->size = size;
+    __sync_synchronize();
+    slot->seq++;
+}
+
+/*
+ * Copy the record a slot refers to, validating it after the copy. The
+ * result must be released using FREE(); NULL is returned if stale.
+ */
+static uint8_t* _record_copy(cache_t* self, cache_slot_t* slot) {
+
+    // check
+    if (!slot->position || slot->size < sizeof(cache_record_t) || slot->size > self->shm->log_size) {
+        return NULL;
+    }
+
+    // copy
+    uint8_t* copy = (uint8_t*)ALLOC(slot->size + 1);
+    memcpy(copy, self->log + slot->position % self->shm->log_size, slot->size);
+    __sync_synchronize();
+
+    // validate
+    cache_record_t* record = (cache_record_t*)copy;
+    if (!_cache_live(self, slot->position) ||
+        record->position != slot->position ||
+        record->hash != slot->hash ||
+        sizeof(cache_record_t) + (uint64_t)record->key_size + record->value_size > slot->size) {
+        FREE(copy);
+        return NULL;
+    }
+
+    // ready
+    return copy;
+}
+
+/*
+ * Check if the record at the given position holds the given key (writers
+ * lock must be held, so the record can be read in place).
+ */
+static int _record_match(cache_t* self, uint64_t position, const void* key, int ksize) {
+    cache_record_t* record = (cache_record_t*)(self->log + position % self->shm->log_size);
+    return record->position == position &&
+           record->key_size == ksize &&
+           !memcmp((uint8_t*)record + sizeof(cache_record_t), key, ksize);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Create (or attach to) the named shared segment.
+ */
+static int _cache_attach(cache_t* self) {
+
+    // open (the first engine creates it)
+    int    created = 1;
+    int    file = shm_open(self->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    size_t size = 0;
+    if (file < 0 && errno == EEXIST) {
+        created = 0;
+        file = shm_open(self->name, O_RDWR, 0600);
+    }
+    if (file < 0) {
+        ERROR("Could not open shared cache \"%s\" (%s)!", self->name, strerror(errno));
+        return 1;
+    }
+
+    // size
+    uint64_t slots = 1024;
+    if (created) {
+        while (slots * CACHE_SLOT_BYTES < self->size) {
+            slots <<= 1;
+        }
+        size = _ALIGN(sizeof(cache_shm_t), CACHE_LINE_SIZE) +
+               _ALIGN(slots * sizeof(cache_slot_t), CACHE_LINE_SIZE) +
+               self->size;
+        if (ftruncate(file, size)) {
+            ERROR("Could not size shared cache \"%s\" (%s)!", self->name, strerror(errno));
+            close(file);
+            shm_unlink(self->name);
+            return 1;
+        }
+    } else {
+        int i;
+        struct stat info;
+        for (i = 0; i < 100; i++) {
+            if (fstat(file, &info)) {
+                ERROR("Could not stat shared cache \"%s\" (%s)!", self->name, strerror(errno));
+                close(file);
+                return 1;
+            }
+            if (info.st_size) {
+                break;
+            }
+            usleep(10000);
+        }
+        size = info.st_size;
+    }
+
+    // map
+    self->shm = (cache_shm_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    close(file);
+    if (self->shm == MAP_FAILED) {
+        ERROR("Could not map shared cache \"%s\" (%s)!", self->name, strerror(errno));
+        self->shm = NULL;
+        return 1;
+    }
+
+    // initialize (or wait for the creator to)
+    if (created) {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&self->shm->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        self->shm->version = CACHE_VERSION;
+        self->shm->size = size;
+        self->shm->slots = slots;
+        self->shm->log_start = size - self->size;
+        self->shm->log_size = self->size;
+        self->shm->head = _LOG_FIRST;
+        __sync_synchronize();
+        self->shm->magic = CACHE_MAGIC;
+    } else {
+        int i;
+        for (i = 0; i < 100 && self->shm->magic != CACHE_MAGIC; i++) {
+            usleep(10000);
+        }
+        if (self->shm->magic != CACHE_MAGIC ||
+            self->shm->version != CACHE_VERSION ||
+            self->shm->size != size) {
+            ERROR("Shared cache \"%s\" is invalid (remove it from /dev/shm)!", self->name);
+            munmap(self->shm, size);
+            self->shm = NULL;
+            return 1;
+        }
+        if (self->shm->log_size != self->size) {
+            INFO("Shared cache \"%s\" keeps its original size (%lu MB).",
+                 self->name, (unsigned long)(self->shm->log_size / 1048576));
+        }
+    }
+
+    // locate areas
+    self->slots = (cache_slot_t*)((uint8_t*)self->shm + _ALIGN(sizeof(cache_shm_t), CACHE_LINE_SIZE));
+    self->log = (uint8_t*)self->shm + self->shm->log_start;
+
+    // success
+    INFO("%s shared cache \"%s\".", created ? "Created" : "Attached to", self->name);
+    return 0;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int cache_new(cache_t* self) {
+
+    // shared
+    if (self->name) {
+        if (!self->size) {
+            ERROR("Shared cache \"%s\" needs a size!", self->name);
+            return 1;
+        }
+        return _cache_attach(self);
+    }
+
+    // private
+    char* options = self->size ? FORMAT("*#capsiz=%lu", self->size) : STRDUP("*");
+    self->db = tcadbnew();
+    if (!tcadbopen(self->db, options)) {
+        tcadbdel(self->db);
+        self->db = NULL;
+    }
+    FREE(options);
+
+    // ready
+    return self->db ? 0 : 1;
+}
+
+/*
+ * Destructor (a shared segment is only unmapped, never removed).
+ */
+int cache_destroy(cache_t* self) {
+
+    // backends
+    if (self->db) {
+        tcadbclose(self->db);
+        tcadbdel(self->db);
+    }
+    if (self->shm) {
+        munmap(self->shm, self->shm->size);
+    }
+
+    // done
+    FREE(self->name);
+    ZERO(self, sizeof(cache_t));
+    return 0;
+}
+
+/*
+ * Fetch an entry. The returned buffer (NUL terminated for convenience)
+ * must be released using FREE(); NULL is returned if missing.
+ */
+void* cache_get(cache_t* self, const void* key, int ksize, int* size) {
+
+    // private
+    *size = 0;
+    if (self->db) {
+        return tcadbget(self->db, key, ksize, size);
+    }
+
+    // probe
+    uint64_t i, hash = _cache_hash(key, ksize), mask = self->shm->slots - 1;
+    for (i = 0; i < CACHE_PROBES; i++) {
+        cache_slot_t slot;
+        if (_slot_read(self, (hash + i) & mask, &slot)) continue;
+        if (!slot.hash) break;
+        if (slot.hash != hash) continue;
+
+        // copy
+        uint8_t* copy = _record_copy(self, &slot);
+        if (!copy) continue;
+
+        // match
+        cache_record_t* record = (cache_record_t*)copy;
+        if (record->key_size == ksize && !memcmp(copy + sizeof(cache_record_t), key, ksize)) {
+            *size = record->value_size;
+            memmove(copy, copy + sizeof(cache_record_t) + ksize, *size);
+            copy[*size] = 0;
+            return copy;
+        }
+        FREE(copy);
+    }
+
+    // missing
+    return NULL;
+}
+
+/*
+ * Store an entry (replacing any previous value).
+ * Returns 0 on success and 1 on error.
+ */
+int cache_put(cache_t* self, const void* key, int ksize, const void* value, int size) {
+    struct iovec vector = { (void*)value, size };
+    return cache_putv(self, key, ksize, &vector, 1);
+}
+
+/*
+ * Store an entry made of the concatenation of the given buffers.
+ * Returns 0 on success and 1 on error.
+ */
+int cache_putv(cache_t* self, const void* key, int ksize, const struct iovec* value, int count) {
+    int v, size = 0;
+    for (v = 0; v < count; v++) {
+        size += value[v].iov_len;
+    }
+
+    // private (gathered, unless single)
+    if (self->db) {
+        if (count == 1) {
+            return !tcadbput(self->db, key, ksize, value[0].iov_base, size);
+        }
+        uint8_t* buffer = (uint8_t*)ALLOC(size ? size : 1);
+        uint8_t* p = buffer;
+        for (v = 0; v < count; p += value[v].iov_len, v++) {
+            memcpy(p, value[v].iov_base, value[v].iov_len);
+        }
+        int status = !tcadbput(self->db, key, ksize, buffer, size);
+        FREE(buffer);
+        return status;
+    }
+
+    // fit
+    cache_shm_t* shm = self->shm;
+    uint64_t length = _ALIGN(sizeof(cache_record_t) + ksize + size, 8);
+    if (length > shm->log_size / 4) return 1;
+
+    // lock
+    if (_cache_lock(self)) return 1;
+
+    // reserve (records never wrap around the end of the log)
+    uint64_t position = shm->head;
+    uint64_t offset = position % shm->log_size;
+    if (offset + length > shm->log_size) {
+        position += shm->log_size - offset;
+    }
+    shm->head = position + length;
+    __sync_synchronize();
+
+    // write
+    cache_record_t* record = (cache_record_t*)(self->log + position % shm->log_size);
+    record->position = position;
+    record->hash = _cache_hash(key, ksize);
+    record->key_size = ksize;
+    record->value_size = size;
+    memcpy((uint8_t*)record + sizeof(cache_record_t), key, ksize);
+    uint8_t* p = (uint8_t*)record + sizeof(cache_record_t) + ksize;
+    for (v = 0; v < count; p += value[v].iov_len, v++) {
+        memcpy(p, value[v].iov_base, value[v].iov_len);
+    }
+    __sync_synchronize();
+
+    // choose slot: same key, else first free (or stale), else oldest
+    int64_t  found = -1, spare = -1, oldest = -1;
+    uint64_t i, index, mask = shm->slots - 1, oldest_position = ~0ULL;
+    for (i = 0; i < CACHE_PROBES; i++) {
+        index = (record->hash + i) & mask;
+        cache_slot_t* slot = &self->slots[index];
+        if (!slot->hash) {
+            if (spare < 0) spare = index;
+            break;
+        }
+        if (!_cache_live(self, slot->position)) {
+            if (spare < 0) spare = index;
+            continue;
+        }
+        if (slot->hash == record->hash && _record_match(self, slot->position, key, ksize)) {
+            found = index;
+            break;
+        }
+        if (slot->position < oldest_position) {
+            oldest_position = slot->position;
+            oldest = index;
+        }
+    }
+    index = found >= 0 ? found : (spare >= 0 ? spare : oldest);
+
+    // publish
+    _slot_write(&self->slots[index], record->hash, position, length);
+
+    // done
+    _cache_unlock(self);
+    return 0;
+}
+
+/*
+ * Remove an entry (if present).
+ */
+void cache_out(cache_t* self, const void* key, int ksize) {
+
+    // private
+    if (self->db) {
+        tcadbout(self->db, key, ksize);
+        return;
+    }
+
+    // lock
+    if (_cache_lock(self)) return;
+
+    // probe (deleted slots keep their hash so probing goes on past them)
+    uint64_t i, hash = _cache_hash(key, ksize), mask = self->shm->slots - 1;
+    for (i = 0; i < CACHE_PROBES; i++) {
+        cache_slot_t* slot = &self->slots[(hash + i) & mask];
+        if (!slot->hash) break;
+        if (slot->hash == hash && _cache_live(self, slot->position) &&
+            _record_match(self, slot->position, key, ksize)) {
+            _slot_write(slot, hash, 0, 0);
+            break;
+        }
+    }
+
+    // done
+    _cache_unlock(self);
+}
+
+/*
+ * List all keys starting with the given prefix. The list must be released
+ * using tclistdel().
+ */
+TCLIST* cache_keys(cache_t* self, const void* prefix, int psize) {
+
+    // private
+    if (self->db) {
+        return tcadbfwmkeys(self->db, prefix, psize, -1);
+    }
+
+    // lock
+    TCLIST* keys = tclistnew();
+    if (_cache_lock(self)) return keys;
+
+    // scan
+    uint64_t i;
+    for (i = 0; i < self->shm->slots; i++) {
+        cache_slot_t* slot = &self->slots[i];
+        if (!slot->hash || !_cache_live(self, slot->position)) continue;
+        cache_record_t* record = (cache_record_t*)(self->log + slot->position % self->shm->log_size);
+        uint8_t* key = (uint8_t*)record + sizeof(cache_record_t);
+        if (record->key_size >= psize && !memcmp(key, prefix, psize)) {
+            tclistpush(keys, key, record->key_size);
+        }
+    }
+
+    // done
+    _cache_unlock(self);
+    return keys;
+}
+
+/*
+ * Remove all entries.
+ */
+void cache_clear(cache_t* self) {
+
+    // private
+    if (self->db) {
+        tcadbvanish(self->db);
+        return;
+    }
+
+    // forget all slots
+    uint64_t i;
+    if (_cache_lock(self)) return;
+    for (i = 0; i < self->shm->slots; i++) {
+        _slot_write(&self->slots[i], 0, 0, 0);
+    }
+    _cache_unlock(self);
+}
+
+/*
+ * Get the memory used (in bytes) and the number of live entries.
+ */
+double cache_used(cache_t* self) {
+    if (self->db) {
+        return tcadbsize(self->db);
+    }
+    return MIN(self->shm->head - _LOG_FIRST, self->shm->log_size);
+}
+
+double cache_items(cache_t* self) {
+    if (self->db) {
+        return tcadbrnum(self->db);
+    }
+    uint64_t i;
+    double   result = 0;
+    for (i = 0; i < self->shm->slots; i++) {
+        cache_slot_t slot;
+        if (!_slot_read(self, i, &slot) && slot.hash && _cache_live(self, slot.position)) {
+            result++;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,153 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * cache.h: Metadata cache (private or shared between processes).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __cache_h__
+#define __cache_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <tcadb.h>
+
+#include "core.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Shared segment constants.
+ */
+#define CACHE_MAGIC             0x4C4D5843      // "LMXC"
+#define CACHE_VERSION           1               // bumped on every layout change
+#define CACHE_PROBES            32              // maximum slots probed per key
+#define CACHE_SLOT_BYTES        256             // log bytes per hash slot (half the average entry size)
+#define CACHE_RETRIES           64              // maximum attempts to read a slot being updated
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Shared segment layout: header, hash slots, then the log. Records are
+ * appended to the log (a ring) at ever increasing absolute positions and
+ * slots refer to records by position only, so the segment can be mapped
+ * at any address by any number of processes. A record is valid as long
+ * as the log head has not advanced a whole ring past it; readers never
+ * lock, they copy the record and then check that it was not overwritten
+ * meanwhile. Writers are serialized by a process-shared (robust) mutex.
+ */
+typedef struct {
+    volatile uint32_t   seq;            // odd while the slot is being updated
+    uint32_t            size;           // record size in bytes
+    uint64_t            hash;           // key hash (0 = never used)
+    uint64_t            position;       // record position in log (0 = deleted)
+} cache_slot_t;
+
+typedef struct {
+    uint64_t            position;       // absolute position (validation)
+    uint64_t            hash;           // key hash
+    uint32_t            key_size;       // key bytes (following the record)
+    uint32_t            value_size;     // value bytes (following the key)
+} cache_record_t;
+
+typedef struct {
+    volatile uint32_t   magic;          // CACHE_MAGIC (set last, when ready)
+    uint32_t            version;        // CACHE_VERSION
+    uint64_t            size;           // segment size in bytes
+    uint64_t            slots;          // number of hash slots (power of 2)
+    uint64_t            log_start;      // log offset in segment
+    uint64_t            log_size;       // log size in bytes
+    volatile uint64_t   head;           // next log position (published before writing)
+    pthread_mutex_t     lock;           // writers lock (process-shared)
+} cache_shm_t;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Cache object. Without a name, entries live in a private on-memory TCADB;
+ * with a name, they live in the named shared-memory segment, which every
+ * engine using the same name shares (and which outlives the processes).
+ */
+typedef struct cache_t {
+
+    // arguments
+    unsigned long       size;           // capacity in bytes (0 = unlimited, private only)
+    char*               name;           // shared segment name (may be NULL)
+
+    // internals
+    TCADB*              db;             // private backend
+    cache_shm_t*        shm;            // shared backend (mapped segment)
+    cache_slot_t*       slots;          // hash slots (in segment)
+    uint8_t*            log;            // log area (in segment)
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(unsigned long) +
+                        sizeof(char*) +
+                        sizeof(TCADB*) +
+                        sizeof(cache_shm_t*) +
+                        sizeof(cache_slot_t*) +
+                        sizeof(uint8_t*));
+
+} cache_t CACHE_ALIGNED;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor (arguments are prepared in self).
+ */
+int cache_new(cache_t* self);
+
+/*
+ * Destructor (a shared segment is only unmapped, never removed).
+ */
+int cache_destroy(cache_t* self);
+
+/*
+ * Fetch an entry. The returned buffer (NUL terminated for convenience)
+ * must be released using FREE(); NULL is returned if missing.
+ */
+void* cache_get(cache_t* self, const void* key, int ksize, int* size);
+
+/*
+ * Store an entry (replacing any previous value).
+ * Returns 0 on success and 1 on error.
+ */
+int cache_put(cache_t* self, const void* key, int ksize, const void* value, int size);
+
+/*
+ * Store an entry made of the concatenation of the given buffers (copied
+ * straight into a shared segment, gathered first for a private cache).
+ * Returns 0 on success and 1 on error.
+ */
+int cache_putv(cache_t* self, const void* key, int ksize, const struct iovec* value, int count);
+
+/*
+ * Remove an entry (if present).
+ */
+void cache_out(cache_t* self, const void* key, int ksize);
+
+/*
+ * List all keys starting with the given prefix. The list must be released
+ * using tclistdel().
+ */
+TCLIST* cache_keys(cache_t* self, const void* prefix, int psize);
+
+/*
+ * Remove all entries.
+ */
+void cache_clear(cache_t* self);
+
+/*
+ * Get the memory used (in bytes) and the number of live entries.
+ */
+double cache_used(cache_t* self);
+double cache_items(cache_t* self);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
@@ -10,6 +10,7 @@
 #define _GNU_SOURCE
 #define _XOPEN_SOURCE 600
 
+#include <dirent.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -165,6 +166,10 @@ char* STRNDUP(const char* original, size_t length) {
  * Read variable bitsize, big-endian value from buffer.
  */
 uint64_t read_xx(const uint8_t* buffer, uint8_t bits) {
+    switch (bits) {
+    case 32: return read_32(buffer);
+    case 64: return read_64(buffer);
+    }
     uint64_t result = 0;
     uint8_t i;
     uint8_t bytes = bits >> 3;
@@ -178,6 +183,10 @@ uint64_t read_xx(const uint8_t* buffer, uint8_t bits) {
  * Write variable bitsize, big-endian value into buffer.
  */
 void write_xx(uint8_t* buffer, uint64_t value, uint8_t bits) {
+    switch (bits) {
+    case 32: write_32(buffer, value); return;
+    case 64: write_64(buffer, value); return;
+    }
     uint8_t i;
     uint8_t bytes = bits >> 3;
     for (i = 0, bits -= 8; i < bytes; i++, bits -= 8) {
@@ -225,6 +234,57 @@ static int luaF_core_realpath(lua_State* L) {
     return 1;
 }
 
+// Recursively append all regular files under a folder to the table on top.
+static void luaU_core_files(lua_State* L, const char* folder, int* count) {
+
+    // open
+    DIR* dir = opendir(folder);
+    if (!dir) return;
+
+    // walk
+    struct dirent* entry;
+    struct stat info;
+    while ((entry = readdir(dir))) {
+
+        // skip hidden entries (and '.', '..')
+        if (entry->d_name[0] == '.') continue;
+
+        // qualify
+        char* path = FORMAT("%s/%s", folder, entry->d_name);
+        if (!lstat(path, &info)) {
+            if (S_ISDIR(info.st_mode)) {
+                luaU_core_files(L, path, count);
+            } else if (S_ISREG(info.st_mode)) {
+                lua_pushstring(L, path);
+                lua_rawseti(L, -2, ++(*count));
+            }
+        }
+        FREE(path);
+    }
+
+    // done
+    closedir(dir);
+}
+
+// [0, +1, -]
+// (folder) => { 'path', ... }
+static int luaF_core_files(lua_State* L) {
+
+    // acquire
+    const char* folder = luaL_checkstring(L, 1);
+    size_t length = strlen(folder);
+    char* base = STRNDUP(folder, length && folder[length - 1] == '/' ? length - 1 : length);
+
+    // resolve
+    int count = 0;
+    lua_newtable(L);
+    luaU_core_files(L, base, &count);
+    FREE(base);
+
+    // ready
+    return 1;
+}
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
@@ -350,6 +410,7 @@ int load_core_c(lua_State* L) {
         // system
         { "readable", luaF_core_readable },
         { "realpath", luaF_core_realpath },
+        { "files", luaF_core_files },
 
         // binary
         { "bin2integer32", luaF_core_bin2integer32 },
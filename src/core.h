@@ -87,16 +87,35 @@ char*   STRNDUP(const char* original, size_t length);
 #define ROUND(a)        ((uint64_t)((a) + 0.5))
 
 /*
- * Big-endian I/O macros.
+ * Big-endian I/O routines specialized by size (the compiler turns the byte
+ * shifts into single byte-swapping loads and stores).
  */
-#define read_24(b)      read_xx(b, 24)
-#define read_32(b)      read_xx(b, 32)
-#define read_64(b)      read_xx(b, 64)
-#define write_32(b, v)  write_xx(b, v, 32)
-#define write_64(b, v)  write_xx(b, v, 64)
+static inline uint16_t read_16(const uint8_t* b) {
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+static inline uint32_t read_24(const uint8_t* b) {
+    return ((uint32_t)b[0] << 16) | ((uint32_t)b[1] << 8) | b[2];
+}
+
+static inline uint32_t read_32(const uint8_t* b) {
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static inline uint64_t read_64(const uint8_t* b) {
+    return ((uint64_t)read_32(b) << 32) | read_32(b + 4);
+}
+
+static inline void write_32(uint8_t* b, uint32_t v) {
+    b[0] = v >> 24; b[1] = v >> 16; b[2] = v >> 8; b[3] = v;
+}
+
+static inline void write_64(uint8_t* b, uint64_t v) {
+    write_32(b, v >> 32); write_32(b + 4, v);
+}
 
 /*
- * Binary access routines.
+ * Binary access routines (variable bitsize).
  */
 uint64_t read_xx(const uint8_t*, uint8_t);
 void write_xx(uint8_t*, uint64_t, uint8_t);
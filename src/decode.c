@@ -0,0 +1,205 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * decode.c: Bulk big-endian table decoding.
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include "decode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define DECODE_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define DECODE_NEON
+#endif
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Vector loops never load past the last value, so each one stops where a
+ * whole load would cross the end of the table and returns the number of
+ * values decoded; the rest is always finished by the plain C loops.
+ */
+#define FITS(i, n, count, stride, width, load) \
+    ((i) + (n) <= (count) && (size_t)(i) * (stride) + (load) <= ((count) - 1) * (stride) + (width))
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Plain C routines (the byte shifts are fused into bswap loads by the compiler).
+ */
+static void decode_32_c(uint64_t* values, const uint8_t* buffer, size_t i, size_t count, size_t stride) {
+    const uint8_t* b = buffer + i * stride;
+    for (; i < count; i++, b += stride) {
+        values[i] = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    }
+}
+
+static void decode_64_c(uint64_t* values, const uint8_t* buffer, size_t i, size_t count, size_t stride) {
+    const uint8_t* b = buffer + i * stride;
+    for (; i < count; i++, b += stride) {
+        values[i] = ((uint64_t)b[0] << 56) | ((uint64_t)b[1] << 48) | ((uint64_t)b[2] << 40) |
+                    ((uint64_t)b[3] << 32) | ((uint64_t)b[4] << 24) | ((uint64_t)b[5] << 16) |
+                    ((uint64_t)b[6] << 8) | b[7];
+    }
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#ifdef DECODE_X86
+
+/*
+ * SSSE3 routines: one shuffle both swaps and widens two values per load.
+ */
+__attribute__((target("ssse3")))
+static size_t decode_32_ssse3(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride) {
+    size_t i = 0;
+
+    // packed (4 values per load)
+    if (stride == 4) {
+        const __m128i lo = _mm_setr_epi8(3, 2, 1, 0, -1, -1, -1, -1, 7, 6, 5, 4, -1, -1, -1, -1);
+        const __m128i hi = _mm_setr_epi8(11, 10, 9, 8, -1, -1, -1, -1, 15, 14, 13, 12, -1, -1, -1, -1);
+        for (; FITS(i, 4, count, 4, 4, 16); i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(buffer + i * 4));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_shuffle_epi8(x, lo));
+            _mm_storeu_si128((__m128i*)(values + i + 2), _mm_shuffle_epi8(x, hi));
+        }
+        return i;
+    }
+
+    // strided (2 values per load)
+    if (stride == 8 || stride == 12) {
+        const __m128i m = (stride == 8) ?
+            _mm_setr_epi8(3, 2, 1, 0, -1, -1, -1, -1, 11, 10, 9, 8, -1, -1, -1, -1) :
+            _mm_setr_epi8(3, 2, 1, 0, -1, -1, -1, -1, 15, 14, 13, 12, -1, -1, -1, -1);
+        for (; FITS(i, 2, count, stride, 4, 16); i += 2) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(buffer + i * stride));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_shuffle_epi8(x, m));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_64_ssse3(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride) {
+    size_t i = 0;
+    if (stride == 8) {
+        const __m128i m = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        for (; FITS(i, 2, count, 8, 8, 16); i += 2) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(buffer + i * 8));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_shuffle_epi8(x, m));
+        }
+    }
+    return i;
+}
+
+/*
+ * AVX2 routines (packed tables only, e.g. stsz, stco and co64).
+ */
+__attribute__((target("avx2")))
+static size_t decode_32_avx2(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride) {
+    size_t i = 0;
+    if (stride == 4) {
+        const __m128i m = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        for (; FITS(i, 8, count, 4, 4, 32); i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(buffer + i * 4));
+            __m128i b = _mm_loadu_si128((const __m128i*)(buffer + i * 4 + 16));
+            _mm256_storeu_si256((__m256i*)(values + i), _mm256_cvtepu32_epi64(_mm_shuffle_epi8(a, m)));
+            _mm256_storeu_si256((__m256i*)(values + i + 4), _mm256_cvtepu32_epi64(_mm_shuffle_epi8(b, m)));
+        }
+        return i;
+    }
+    return decode_32_ssse3(values, buffer, count, stride);
+}
+
+__attribute__((target("avx2")))
+static size_t decode_64_avx2(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride) {
+    size_t i = 0;
+    if (stride == 8) {
+        const __m256i m = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        for (; FITS(i, 4, count, 8, 8, 32); i += 4) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(buffer + i * 8));
+            _mm256_storeu_si256((__m256i*)(values + i), _mm256_shuffle_epi8(x, m));
+        }
+    }
+    return i;
+}
+
+#endif
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#ifdef DECODE_NEON
+
+/*
+ * NEON routines (packed tables only, NEON is always present when enabled).
+ */
+static size_t decode_32_neon(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride) {
+    size_t i = 0;
+    if (stride == 4) {
+        for (; FITS(i, 4, count, 4, 4, 16); i += 4) {
+            uint32x4_t x = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer + i * 4)));
+            vst1q_u64(values + i, vmovl_u32(vget_low_u32(x)));
+            vst1q_u64(values + i + 2, vmovl_u32(vget_high_u32(x)));
+        }
+    }
+    return i;
+}
+
+static size_t decode_64_neon(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride) {
+    size_t i = 0;
+    if (stride == 8) {
+        for (; FITS(i, 2, count, 8, 8, 16); i += 2) {
+            vst1q_u64(values + i, vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(buffer + i * 8))));
+        }
+    }
+    return i;
+}
+
+#endif
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Decode a big-endian table column into native 64bit values.
+ */
+void decode_table(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride, uint8_t bits) {
+    size_t i = 0;
+
+    // nothing to do
+    if (!count) return;
+
+    // vector prefix
+    #if defined(DECODE_X86)
+        if (__builtin_cpu_supports("avx2")) {
+            i = (bits == 64) ? decode_64_avx2(values, buffer, count, stride) :
+                               decode_32_avx2(values, buffer, count, stride);
+        } else if (__builtin_cpu_supports("ssse3")) {
+            i = (bits == 64) ? decode_64_ssse3(values, buffer, count, stride) :
+                               decode_32_ssse3(values, buffer, count, stride);
+        }
+    #elif defined(DECODE_NEON)
+        i = (bits == 64) ? decode_64_neon(values, buffer, count, stride) :
+                           decode_32_neon(values, buffer, count, stride);
+    #endif
+
+    // scalar remainder
+    if (bits == 64) {
+        decode_64_c(values, buffer, i, count, stride);
+    } else {
+        decode_32_c(values, buffer, i, count, stride);
+    }
+}
+
+void decode_table_c(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride, uint8_t bits) {
+    if (bits == 64) {
+        decode_64_c(values, buffer, 0, count, stride);
+    } else {
+        decode_32_c(values, buffer, 0, count, stride);
+    }
+}
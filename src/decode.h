@@ -0,0 +1,35 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * decode.h: Bulk big-endian table decoding.
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __decode_h__
+#define __decode_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Decode count big-endian values of the given bit size (32 or 64) laid out
+ * stride bytes apart (e.g. a single column of an MP4 table) into native
+ * 64bit values. The vector routine best suited for the running processor
+ * (AVX2/SSSE3 or NEON) is chosen on every call, falling back to plain C.
+ */
+void decode_table(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride, uint8_t bits);
+
+/*
+ * Plain C version of decode_table() (reference and fallback).
+ */
+void decode_table_c(uint64_t* values, const uint8_t* buffer, size_t count, size_t stride, uint8_t bits);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
@@ -10,6 +10,7 @@
 #include <ev.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -28,15 +29,100 @@ int engine_new(engine_t* self) {
 
     // cache
     if (self->cache) {
-        char* options = FORMAT("*#capsiz=%lu", self->cache);
-        self->db = tcadbnew();
-        if (!tcadbopen(self->db, options)) {
-            tcadbdel(self->db);
-            self->db = NULL;
+        self->db = (cache_t*)ZALLOC(sizeof(cache_t));
+        self->db->size = self->cache;
+        self->db->name = self->shared;
+        self->shared = NULL;
+        if (cache_new(self->db) && self->db->name) {
+            WARNING("Failed to attach shared cache, using a private one!");
+            cache_destroy(self->db);
+            self->db->size = self->cache;
+            cache_new(self->db);
+        }
+        if (!self->db->db && !self->db->shm) {
+            WARNING("Failed to create cache, metadata will always be parsed!");
+            cache_destroy(self->db);
+            FREE(self->db);
+        }
+    }
+
+    // single-flight parsing (pointless without a cache)
+    if (self->db) {
+        self->flight = (flight_t*)ZALLOC(sizeof(flight_t));
+        if (flight_new(self->flight)) {
+            WARNING("Failed to create in-flight table, bursts will be parsed repeatedly!");
+            FREE(self->flight);
+        }
+    }
+
+    // parser pool
+    if (self->parsers) {
+        self->parser = (parser_t*)ZALLOC(sizeof(parser_t));
+        self->parser->threads = self->parsers;
+        if (parser_new(self->parser)) {
+            WARNING("Failed to create parser pool, metadata will be parsed by the workers!");
+            parser_destroy(self->parser);
+            FREE(self->parser);
+        }
+    }
+
+    // indexer
+    if (self->index) {
+        self->indexer = (indexer_t*)ZALLOC(sizeof(indexer_t));
+        self->indexer->folder = self->index;
+        self->indexer->period = 1.0;
+        if (indexer_new(self->indexer)) {
+            FATAL("Failed to create indexer!");
+        }
+    }
+
+    // dispatch counts (hot list)
+    if (self->hotlist) {
+        self->hot = tcadbnew();
+        if (!tcadbopen(self->hot, "*")) {
+            tcadbdel(self->hot);
+            self->hot = NULL;
+        }
+    }
+
+    // wasted data by host (viewers gone)
+    self->wasted = tcadbnew();
+    if (!tcadbopen(self->wasted, "*")) {
+        tcadbdel(self->wasted);
+        self->wasted = NULL;
+    }
+
+    // warmer (pointless without a cache)
+    if (self->db && self->warmers && self->warming > 0 && (self->folders || self->hotlist)) {
+        self->warmer = (warmer_t*)ZALLOC(sizeof(warmer_t));
+        self->warmer->threads = self->warmers;
+        self->warmer->rate = self->warming;
+        self->warmer->period = 1.0;
+        self->warmer->hotlist = self->hotlist;
+        self->warmer->folders = self->folders;
+        self->warmer->types = self->types;
+        self->warmer->db = self->db;
+        self->warmer->index = self->index;
+        self->warmer->indexer = self->indexer;
+        if (warmer_new(self->warmer)) {
+            WARNING("Failed to create warmer, the cache will start cold!");
+            warmer_destroy(self->warmer);
+            FREE(self->warmer);
+        }
+    }
+
+    // notifier
+    if (self->folders && (self->db || self->index)) {
+        self->notify = (notify_t*)ZALLOC(sizeof(notify_t));
+        self->notify->folders = self->folders;
+        self->notify->db = self->db;
+        self->notify->index = self->index;
+        self->notify->warmer = self->warmer;
+        if (notify_new(self->notify)) {
+            WARNING("Failed to watch folders, cached metadata will only expire!");
+            notify_destroy(self->notify);
+            FREE(self->notify);
         }
-        FREE(options);
-    } else {
-        self->db = NULL;
     }
 
     // workers
@@ -44,6 +130,11 @@ int engine_new(engine_t* self) {
     for (i = 0; i < self->workers; i++) {
         self->pool[i].id = i + 1;
         self->pool[i].db = self->db;
+        self->pool[i].index = self->index;
+        self->pool[i].indexer = self->indexer;
+        self->pool[i].flight = self->flight;
+        self->pool[i].parser = self->parser;
+        self->pool[i].wasted = self->wasted;
         if (worker_new(&self->pool[i])) {
             FATAL("Failed to create worker %u!", i + 1);
         }
@@ -61,21 +152,84 @@ int engine_new(engine_t* self) {
  */
 int engine_destroy(engine_t* self) {
 
+    // no more wake-ups (loops go away one by one)
+    if (self->flight) {
+        flight_close(self->flight);
+    }
+
+    // parser pool (hands back the streams being parsed)
+    if (self->parser) {
+        parser_destroy(self->parser);
+        FREE(self->parser);
+    }
+
     // workers
     int i = self->workers - 1;
     for (; i >= 0 ; i--) {
         worker_destroy(&self->pool[i]);
     }
 
+    // in-flight table
+    if (self->flight) {
+        flight_destroy(self->flight);
+        FREE(self->flight);
+    }
+
+    // notifier
+    if (self->notify) {
+        notify_destroy(self->notify);
+        FREE(self->notify);
+    }
+
+    // warmer
+    if (self->warmer) {
+        warmer_destroy(self->warmer);
+        FREE(self->warmer);
+    }
+
+    // indexer (completes pending jobs)
+    if (self->indexer) {
+        indexer_destroy(self->indexer);
+        FREE(self->indexer);
+    }
+
+    // hot list
+    if (self->hot) {
+        warmer_save(self->hotlist, self->hot);
+        tcadbclose(self->hot);
+        tcadbdel(self->hot);
+    }
+
+    // wasted data by host
+    if (self->wasted) {
+        tcadbclose(self->wasted);
+        tcadbdel(self->wasted);
+    }
+
     // cache
     if (self->db) {
-        tcadbclose(self->db);
-        tcadbdel(self->db);
+        cache_destroy(self->db);
+        FREE(self->db);
     }
 
     // deinitialize
     pthread_spin_destroy(&self->lock);
     FREE(self->pool);
+    FREE(self->index);
+    FREE(self->shared);
+    FREE(self->hotlist);
+    if (self->folders) {
+        for (i = 0; self->folders[i]; i++) {
+            FREE(self->folders[i]);
+        }
+        FREE(self->folders);
+    }
+    if (self->types) {
+        for (i = 0; self->types[i]; i++) {
+            FREE(self->types[i]);
+        }
+        FREE(self->types);
+    }
 
     // done
     ZERO(self, sizeof(engine_t));
@@ -104,23 +258,59 @@ int engine_destroy(engine_t* self) {
     // cache indicators
     case ENGINE_CACHE_USED:
         if (self->db) {
-            result = tcadbsize(self->db);
+            result = cache_used(self->db);
         }
         break;
     case ENGINE_CACHE_ITEMS:
         if (self->db) {
-            result = tcadbrnum(self->db);
+            result = cache_items(self->db);
         }
         break;
     case ENGINE_CACHE_HITS:
         for (i = 0; i < self->workers; i++) {
             result += (double)self->pool[i].cache_hits;
         }
+        for (i = 0; self->parser && i < self->parser->threads; i++) {
+            result += (double)self->parser->pool[i].cache_hits;
+        }
         break;
     case ENGINE_CACHE_MISSES:
         for (i = 0; i < self->workers; i++) {
             result += (double)self->pool[i].cache_misses;
         }
+        for (i = 0; self->parser && i < self->parser->threads; i++) {
+            result += (double)self->parser->pool[i].cache_misses;
+        }
+        break;
+    case ENGINE_CACHE_DROPS:
+        if (self->notify) {
+            result = self->notify->drops;
+        }
+        break;
+
+    // parsing indicators
+    case ENGINE_PARSE_FAULTS:
+        for (i = 0; i < self->workers; i++) {
+            result += (double)self->pool[i].parse_faults;
+        }
+        for (i = 0; self->parser && i < self->parser->threads; i++) {
+            result += (double)self->parser->pool[i].parse_faults;
+        }
+        break;
+    case ENGINE_PARSE_PARKED:
+        if (self->flight) {
+            result = self->flight->parked;
+        }
+        break;
+    case ENGINE_PARSE_WAIT:
+        if (self->parser) {
+            result = parser_wait(self->parser);
+        }
+        break;
+    case ENGINE_PARSE_TIME:
+        if (self->parser) {
+            result = parser_time(self->parser);
+        }
         break;
 
     // transfer indicators
@@ -144,6 +334,49 @@ int engine_destroy(engine_t* self) {
         }
         result = result / (double)self->workers;
         break;
+    case ENGINE_DATA_SAVED:
+        for (i = 0; i < self->workers; i++) {
+            result += self->pool[i].data_saved;
+        }
+        break;
+    case ENGINE_DATA_WASTED:
+        for (i = 0; i < self->workers; i++) {
+            result += self->pool[i].data_wasted;
+        }
+        break;
+    case ENGINE_DATA_RESENT: {
+            double sent = 0;
+            for (i = 0; i < self->workers; i++) {
+                result += self->pool[i].resent_sum;
+                sent += self->pool[i].resent_count;
+            }
+            result = sent ? result / sent : 0;
+        }
+        break;
+
+    // index indicators
+    case ENGINE_INDEX_BUILT:
+        if (self->indexer) {
+            result = self->indexer->built;
+        }
+        break;
+    case ENGINE_INDEX_FAILED:
+        if (self->indexer) {
+            result = self->indexer->failed;
+        }
+        break;
+
+    // warmer indicators
+    case ENGINE_WARM_DONE:
+        if (self->warmer) {
+            result = warmer_warmed(self->warmer);
+        }
+        break;
+    case ENGINE_WARM_FAILED:
+        if (self->warmer) {
+            result = warmer_failed(self->warmer);
+        }
+        break;
 
     // unknown
     default:
@@ -171,13 +404,33 @@ int engine_dispatch(engine_t* self, stream_t* stream) {
         }
     }
 
-    // configure
+    // configure (adaptive run-ahead within bounds around the configured one)
     stream->throttle = self->throttle;
+    if (self->throttle_max > self->throttle_min && self->throttle_min > 0) {
+        stream->throttle_min = MIN(self->throttle_min, self->throttle);
+        stream->throttle_max = MAX(self->throttle_max, self->throttle);
+    }
+    stream->pacing = self->pacing;
+
+    // count (hot list, temporal seek points included)
+    if (self->hot) {
+        char* key = FORMAT("%s\t%s\t%g", stream->mime, stream->path, stream->spatial ? 0 : stream->start);
+        tcadbaddint(self->hot, key, strlen(key), 1);
+        FREE(key);
+    }
 
     // ready
     return worker_enqueue(worker, stream);
 }
 
+/*
+ * Schedule a file for background indexing (assumes self is valid).
+ * Returns 0 on success, 1 on error (or if indexing is disabled).
+ */
+int engine_index(engine_t* self, const char* path, const char* mime) {
+    return self->indexer ? indexer_enqueue(self->indexer, path, mime) : 1;
+}
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
@@ -256,11 +509,73 @@ static int luaF_engine_new(lua_State* L) {
     lua_getfield(L, 2, "clients");
     lua_getfield(L, 2, "throttle");
     lua_getfield(L, 2, "cache");
-    engine->workers = (unsigned int)luaL_checkinteger(L, -4);
-    engine->clients = (unsigned int)luaL_checkinteger(L, -3);
-    engine->throttle = (double)luaL_checknumber(L, -2);
-    engine->cache = (double)luaL_checknumber(L, -1);
-    lua_pop(L, 4);
+    lua_getfield(L, 2, "index");
+    lua_getfield(L, 2, "shared");
+    engine->workers = (unsigned int)luaL_checkinteger(L, -6);
+    engine->clients = (unsigned int)luaL_checkinteger(L, -5);
+    engine->throttle = (double)luaL_checknumber(L, -4);
+    engine->cache = (double)luaL_checknumber(L, -3);
+    engine->index = STRDUP(lua_tostring(L, -2));
+    engine->shared = STRDUP(lua_tostring(L, -1));
+    lua_pop(L, 6);
+
+    // adaptive run-ahead bounds (optional)
+    lua_getfield(L, 2, "throttle_min");
+    lua_getfield(L, 2, "throttle_max");
+    engine->throttle_min = (double)lua_tonumber(L, -2);
+    engine->throttle_max = (double)lua_tonumber(L, -1);
+    lua_pop(L, 2);
+
+    // kernel-side pacing (optional)
+    lua_getfield(L, 2, "pacing");
+    engine->pacing = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    // watched folders
+    lua_getfield(L, 2, "watch");
+    if (lua_istable(L, -1)) {
+        int i, count = lua_objlen(L, -1);
+        engine->folders = (char**)ZALLOC(sizeof(char*) * (count + 1));
+        for (i = 0; i < count; i++) {
+            lua_rawgeti(L, -1, i + 1);
+            engine->folders[i] = STRDUP(luaL_checkstring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    // served file types (extension => mime)
+    lua_getfield(L, 2, "types");
+    if (lua_istable(L, -1)) {
+        int i = 0, count = 0;
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            lua_pop(L, 1);
+            count++;
+        }
+        engine->types = (char**)ZALLOC(sizeof(char*) * (count * 2 + 1));
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            engine->types[i++] = STRDUP(luaL_checkstring(L, -2));
+            engine->types[i++] = STRDUP(luaL_checkstring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    // warmer
+    lua_getfield(L, 2, "warmers");
+    lua_getfield(L, 2, "warming");
+    lua_getfield(L, 2, "hotlist");
+    engine->warmers = (unsigned int)lua_tointeger(L, -3);
+    engine->warming = (double)lua_tonumber(L, -2);
+    engine->hotlist = STRDUP(lua_tostring(L, -1));
+    lua_pop(L, 3);
+
+    // parser pool
+    lua_getfield(L, 2, "parsers");
+    engine->parsers = (unsigned int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
 
     // attempt ignition
     if (engine_new(engine)) {
@@ -341,6 +656,50 @@ static int luaF_engine_dispatch(lua_State* L) {
     stream->stop = luaL_checknumber(L, -1);
     lua_pop(L, 5);
 
+    // get output format, segment, tracks and trick-play (optional)
+    lua_getfield(L, 2, "format");
+    lua_getfield(L, 2, "segment");
+    lua_getfield(L, 2, "tracks");
+    lua_getfield(L, 2, "trick");
+    const char* format = lua_tostring(L, -4);
+    const char* segment = lua_tostring(L, -3);
+    const char* tracks = lua_tostring(L, -2);
+    const char* trick = lua_tostring(L, -1);
+    if (format && !strcmp(format, "fmp4")) {
+        stream->format = STREAM_FORMAT_FMP4;
+    } else if (format && !strcmp(format, "hls")) {
+        stream->format = STREAM_FORMAT_HLS;
+    } else if (format && !strcmp(format, "dash")) {
+        stream->format = STREAM_FORMAT_DASH;
+    }
+    if (segment) {
+        stream->format = STREAM_FORMAT_SEGMENT;
+        stream->segment = strcmp(segment, "init") ? MAX(atoi(segment), 0) : -1;
+    }
+    if (tracks && !strcmp(tracks, "video")) {
+        stream->tracks = STREAM_TRACKS_VIDEO;
+    } else if (tracks && !strcmp(tracks, "audio")) {
+        stream->tracks = STREAM_TRACKS_AUDIO;
+    }
+    if (trick) {
+        stream->trick = MAX(atoi(trick), 0);
+    }
+    lua_pop(L, 4);
+
+    // get virtual host (optional, for accounting)
+    lua_getfield(L, 2, "host");
+    if (lua_isstring(L, -1)) {
+        stream->host = STRDUP(lua_tostring(L, -1));
+    }
+    lua_pop(L, 1);
+
+    // get query arguments carried over to segment URLs (optional)
+    lua_getfield(L, 2, "query");
+    if (lua_isstring(L, -1) && lua_objlen(L, -1)) {
+        stream->query = STRDUP(lua_tostring(L, -1));
+    }
+    lua_pop(L, 1);
+
     // dispatch
     if (engine_dispatch(self, stream)) goto error_overload;
 
@@ -364,6 +723,22 @@ static int luaF_engine_dispatch(lua_State* L) {
 }
 
 
+// [0, +1, -]
+// (self, path, mime) => boolean
+static int luaF_engine_index(lua_State* L) {
+
+    // get engine
+    engine_t* self = extract_engine(L, 1);
+
+    // get arguments
+    const char* path = luaL_checkstring(L, 2);
+    const char* mime = luaL_checkstring(L, 3);
+
+    // schedule
+    lua_pushboolean(L, !engine_index(self, path, mime));
+    return 1;
+}
+
 // [0, +1, -]
 // (self, indicator) => number
 static int luaF_engine_monitor(lua_State* L) {
@@ -378,8 +753,20 @@ static int luaF_engine_monitor(lua_State* L) {
         "cache:items",
         "cache:hits",
         "cache:misses",
+        "cache:drops",
+        "parse:faults",
+        "parse:parked",
+        "parse:wait",
+        "parse:time",
         "data:total",
         "data:delay",
+        "data:saved",
+        "data:wasted",
+        "data:resent",
+        "index:built",
+        "index:failed",
+        "warm:done",
+        "warm:failed",
         NULL
     };
 
@@ -390,8 +777,20 @@ static int luaF_engine_monitor(lua_State* L) {
         ENGINE_CACHE_ITEMS,
         ENGINE_CACHE_HITS,
         ENGINE_CACHE_MISSES,
+        ENGINE_CACHE_DROPS,
+        ENGINE_PARSE_FAULTS,
+        ENGINE_PARSE_PARKED,
+        ENGINE_PARSE_WAIT,
+        ENGINE_PARSE_TIME,
         ENGINE_DATA_TOTAL,
         ENGINE_DATA_DELAY,
+        ENGINE_DATA_SAVED,
+        ENGINE_DATA_WASTED,
+        ENGINE_DATA_RESENT,
+        ENGINE_INDEX_BUILT,
+        ENGINE_INDEX_FAILED,
+        ENGINE_WARM_DONE,
+        ENGINE_WARM_FAILED,
         0
     };
 
@@ -406,6 +805,36 @@ static int luaF_engine_monitor(lua_State* L) {
     return 1;
 }
 
+// [0, +1, -]
+// (self) => { host = bytes, ... }
+static int luaF_engine_wasted(lua_State* L) {
+
+    // get engine
+    engine_t* self = extract_engine(L, 1);
+
+    // assemble
+    lua_newtable(L);
+    if (self->wasted) {
+        int   ksize = 0;
+        char* key;
+        tcadbiterinit(self->wasted);
+        while ((key = tcadbiternext(self->wasted, &ksize))) {
+            int     vsize = 0;
+            double* value = (double*)tcadbget(self->wasted, key, ksize, &vsize);
+            if (value && vsize == sizeof(double)) {
+                lua_pushlstring(L, key, ksize);
+                lua_pushnumber(L, *value);
+                lua_settable(L, -3);
+            }
+            FREE(value);
+            FREE(key);
+        }
+    }
+
+    // done
+    return 1;
+}
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
@@ -425,7 +854,9 @@ int load_engine_c(lua_State* L) {
         { "new", luaF_engine_new },
         { "destroy", luaF_engine_destroy },
         { "dispatch", luaF_engine_dispatch },
+        { "index", luaF_engine_index },
         { "monitor", luaF_engine_monitor },
+        { "wasted", luaF_engine_wasted },
         { NULL, NULL }
     };
 
@@ -441,6 +872,12 @@ int load_engine_c(lua_State* L) {
     lua_setfield(L, -2, "throttle");
     lua_pushinteger(L, 256 * 1048576);
     lua_setfield(L, -2, "cache");
+    lua_pushinteger(L, 1);
+    lua_setfield(L, -2, "warmers");
+    lua_pushnumber(L, 10.0);
+    lua_setfield(L, -2, "warming");
+    lua_pushinteger(L, 2);
+    lua_setfield(L, -2, "parsers");
 
     // finish
     return 1;
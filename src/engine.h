@@ -17,8 +17,14 @@
 #include <pthread.h>
 #include <tcadb.h>
 
+#include "cache.h"
 #include "core.h"
+#include "flight.h"
+#include "index.h"
+#include "notify.h"
+#include "parser.h"
 #include "stream.h"
+#include "warmer.h"
 #include "worker.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -32,8 +38,20 @@ enum {
     ENGINE_CACHE_ITEMS,
     ENGINE_CACHE_HITS,
     ENGINE_CACHE_MISSES,
+    ENGINE_CACHE_DROPS,
+    ENGINE_PARSE_FAULTS,
+    ENGINE_PARSE_PARKED,
+    ENGINE_PARSE_WAIT,
+    ENGINE_PARSE_TIME,
     ENGINE_DATA_TOTAL,
-    ENGINE_DATA_DELAY
+    ENGINE_DATA_DELAY,
+    ENGINE_DATA_SAVED,
+    ENGINE_DATA_WASTED,
+    ENGINE_DATA_RESENT,
+    ENGINE_INDEX_BUILT,
+    ENGINE_INDEX_FAILED,
+    ENGINE_WARM_DONE,
+    ENGINE_WARM_FAILED
 };
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -45,22 +63,49 @@ typedef struct engine_t {
 
     // arguments
     unsigned int        workers;
+    unsigned int        parsers;
     unsigned int        clients;
     double              throttle;
+    double              throttle_min;
+    double              throttle_max;
+    int                 pacing;
     unsigned long       cache;
+    char*               shared;
+    char*               index;
+    char**              folders;
+    char**              types;
+    unsigned int        warmers;
+    double              warming;
+    char*               hotlist;
 
     // internals
     worker_t*           pool;
     pthread_spinlock_t  lock;
-    TCADB*              db;
+    cache_t*            db;
+    flight_t*           flight;
+    parser_t*           parser;
+    indexer_t*          indexer;
+    notify_t*           notify;
+    warmer_t*           warmer;
+    TCADB*              hot;
+    TCADB*              wasted;
 
     // alignment
-    CACHE_ALIGNMENT(    sizeof(unsigned int) * 2 +
+    CACHE_ALIGNMENT(    sizeof(unsigned int) * 4 +
+                        sizeof(int) +
                         sizeof(unsigned long) +
-                        sizeof(double) +
+                        sizeof(double) * 4 +
+                        sizeof(char*) * 3 +
+                        sizeof(char**) * 2 +
                         sizeof(worker_t*) +
                         sizeof(pthread_spinlock_t) +
-                        sizeof(TCADB*));
+                        sizeof(cache_t*) +
+                        sizeof(flight_t*) +
+                        sizeof(parser_t*) +
+                        sizeof(TCADB*) * 2 +
+                        sizeof(indexer_t*) +
+                        sizeof(notify_t*) +
+                        sizeof(warmer_t*));
 
 } engine_t CACHE_ALIGNED;
 
@@ -88,6 +133,12 @@ double engine_monitor(engine_t* self, int indicator);
  */
 int engine_dispatch(engine_t* self, stream_t* stream);
 
+/*
+ * Schedule a file for background indexing (assumes self is valid).
+ * Returns 0 on success, 1 on error (or if indexing is disabled).
+ */
+int engine_index(engine_t* self, const char* path, const char* mime);
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
@@ -0,0 +1,153 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * flight.c: Single-flight metadata parsing (shared between workers).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "flight.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Find the link to the parse in flight of the given file identity (the
+ * table must be locked). Returns the link to NULL if there is none.
+ */
+static flight_node_t** _flight_find(flight_t* self, const char* key) {
+    flight_node_t** link = &self->nodes;
+    while (*link && strcmp((*link)->key, key)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int flight_new(flight_t* self) {
+    return pthread_mutex_init(&self->lock, NULL);
+}
+
+/*
+ * Destructor.
+ */
+int flight_destroy(flight_t* self) {
+
+    // purge nodes (parked streams belong to their workers)
+    while (self->nodes) {
+        flight_node_t* node = self->nodes;
+        self->nodes = node->next;
+        FREE(node);
+    }
+
+    // deinitialize
+    pthread_mutex_destroy(&self->lock);
+
+    // done
+    ZERO(self, sizeof(flight_t));
+    return 0;
+}
+
+/*
+ * Join the parse of the (opened) stream's file.
+ */
+int flight_join(flight_t* self, stream_t* stream) {
+
+    // identity
+    char* key = stream_cache_key(stream, "");
+    int parked = 0;
+
+    // acquire lock
+    pthread_mutex_lock(&self->lock);
+
+    // park behind the leader, or lead
+    if (!self->closed) {
+        flight_node_t* node = *_flight_find(self, key);
+        if (node) {
+            stream->flight_next = node->parked;
+            node->parked = stream;
+            self->parked++;
+            parked = 1;
+        } else {
+            node = (flight_node_t*)ZALLOC(sizeof(flight_node_t));
+            node->key = key;
+            node->leader = stream;
+            node->next = self->nodes;
+            self->nodes = node;
+        }
+        stream->flight_key = key;
+        key = NULL;
+    }
+
+    // release lock
+    pthread_mutex_unlock(&self->lock);
+
+    // done
+    FREE(key);
+    return parked;
+}
+
+/*
+ * Leave the flight (publish or withdraw).
+ */
+void flight_leave(flight_t* self, stream_t* stream) {
+
+    // check
+    if (!stream->flight_key) return;
+
+    // acquire lock
+    pthread_mutex_lock(&self->lock);
+
+    // locate
+    flight_node_t** link = _flight_find(self, stream->flight_key);
+    flight_node_t*  node = *link;
+    if (node && node->leader == stream) {
+
+        // publish (the parked streams resume on their own loops)
+        *link = node->next;
+        stream_t* parked = node->parked;
+        while (parked) {
+            stream_t* next = parked->flight_next;
+            parked->flight_next = NULL;
+            if (!self->closed) {
+                ev_async_send(parked->loop, &parked->wake_w);
+            }
+            parked = next;
+        }
+        FREE(node);
+
+    } else if (node) {
+
+        // withdraw
+        stream_t** parked = &node->parked;
+        while (*parked && *parked != stream) {
+            parked = &(*parked)->flight_next;
+        }
+        if (*parked) {
+            *parked = stream->flight_next;
+            stream->flight_next = NULL;
+        }
+    }
+
+    // release lock
+    pthread_mutex_unlock(&self->lock);
+
+    // done (the key was shared with the node while leading)
+    FREE(stream->flight_key);
+}
+
+/*
+ * Stop waking parked streams.
+ */
+void flight_close(flight_t* self) {
+    pthread_mutex_lock(&self->lock);
+    self->closed = 1;
+    pthread_mutex_unlock(&self->lock);
+}
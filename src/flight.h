@@ -0,0 +1,100 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * flight.h: Single-flight metadata parsing (shared between workers).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __flight_h__
+#define __flight_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <ev.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "stream.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * A parse in flight: the file identity being parsed (see stream_cache_key()),
+ * the stream parsing it and the streams waiting for its result.
+ */
+typedef struct flight_node_t {
+
+    // internals
+    char*               key;            // file identity
+    stream_t*           leader;         // stream parsing the file
+    stream_t*           parked;         // streams waiting (linked through flight_next)
+    struct flight_node_t* next;
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(char*) +
+                        sizeof(stream_t*) * 2 +
+                        sizeof(struct flight_node_t*));
+
+} flight_node_t CACHE_ALIGNED;
+
+/*
+ * In-flight table. When a burst of requests hits a file whose metadata is
+ * not cached yet, only the first stream parses it; the streams arriving on
+ * other workers (or parser threads) meanwhile are parked (no i/o, no
+ * parsing) and woken through their own loops once the leader has published
+ * the result in the cache, from which they then parse at the cost of a hit.
+ */
+typedef struct flight_t {
+
+    // internals
+    size_t              parked;         // number of streams parked so far
+    int                 closed;         // no more wake-ups (shutting down)
+    flight_node_t*      nodes;          // parses in flight
+    pthread_mutex_t     lock;           // table lock
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(size_t) +
+                        sizeof(int) +
+                        sizeof(flight_node_t*) +
+                        sizeof(pthread_mutex_t));
+
+} flight_t CACHE_ALIGNED;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int flight_new(flight_t* self);
+
+/*
+ * Destructor.
+ */
+int flight_destroy(flight_t* self);
+
+/*
+ * Join the parse of the (opened) stream's file. Returns 0 if the stream must
+ * parse the file itself (it then leads the flight until flight_leave()) and
+ * 1 if it was parked behind another stream parsing the same file, in which
+ * case its wake_w watcher (already started by the caller) is signalled once
+ * the result is published.
+ */
+int flight_join(flight_t* self, stream_t* stream);
+
+/*
+ * Leave the flight: a leader publishes its result (waking all the streams
+ * parked behind it), a parked stream simply withdraws (being destroyed).
+ */
+void flight_leave(flight_t* self, stream_t* stream);
+
+/*
+ * Stop waking parked streams (called before the workers are stopped, since
+ * their loops may be gone before the last leaders finish).
+ */
+void flight_close(flight_t* self);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
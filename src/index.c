@@ -0,0 +1,519 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * index.c: Persistent on-disk metadata index (sidecar files).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "stream_flv.h"
+#include "stream_mp4.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Sidecar location (sidecars are named after the file identity so that
+ * renamed files keep their sidecar and replaced files never match one).
+ */
+static char* _index_path(const char* folder, stream_t* stream) {
+    return FORMAT("%s/%llx-%llx.idx", folder,
+                  (unsigned long long)stream->file_device,
+                  (unsigned long long)stream->file_inode);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Map the sidecar of an opened stream (file identity must be known).
+ * Returns 0 on success and 1 if the sidecar is missing or outdated.
+ */
+int index_open(stream_t* stream) {
+
+    // open
+    char* path = _index_path(stream->index, stream);
+    int   file = open(path, O_RDONLY);
+    FREE(path);
+    if (file < 0) {
+        return 1;
+    }
+
+    // map
+    struct stat info;
+    void* map = MAP_FAILED;
+    if (!fstat(file, &info) && info.st_size >= sizeof(index_head_t)) {
+        map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    }
+    close(file);
+    if (map == MAP_FAILED) {
+        return 1;
+    }
+
+    // validate
+    index_head_t* head = (index_head_t*)map;
+    if (head->magic != INDEX_MAGIC ||
+        head->version != INDEX_VERSION ||
+        head->device != stream->file_device ||
+        head->inode != stream->file_inode ||
+        head->size != stream->file_length ||
+        head->mtime != stream->file_mtime ||
+        head->period != stream->period ||
+        sizeof(index_head_t) + head->count * sizeof(index_entry_t) > info.st_size) {
+        munmap(map, info.st_size);
+        return 1;
+    }
+
+    // success
+    stream->index_map = map;
+    stream->index_size = info.st_size;
+    return 0;
+}
+
+/*
+ * Unmap the sidecar of a stream (if mapped).
+ */
+void index_close(stream_t* stream) {
+    if (stream->index_map) {
+        munmap(stream->index_map, stream->index_size);
+        stream->index_map = NULL;
+        stream->index_size = 0;
+    }
+}
+
+/*
+ * Find a named blob in the mapped sidecar of a stream. The returned
+ * pointer is read-only and only valid until index_close() is called.
+ */
+const void* index_find(stream_t* stream, const char* name, int* size) {
+
+    // check
+    if (!stream->index_map) {
+        return NULL;
+    }
+
+    // locate
+    index_head_t*  head    = (index_head_t*)stream->index_map;
+    index_entry_t* entries = (index_entry_t*)(head + 1);
+    uint32_t i;
+    for (i = 0; i < head->count; i++) {
+        if (!strncmp(entries[i].name, name, INDEX_NAME_SIZE)) {
+            if (entries[i].offset + entries[i].size > stream->index_size) {
+                break;
+            }
+            *size = entries[i].size;
+            return (char*)stream->index_map + entries[i].offset;
+        }
+    }
+
+    // missing
+    return NULL;
+}
+
+/*
+ * Write the sidecar for the given stream using every record from the
+ * given database whose key starts with the given prefix (stripped off).
+ * Returns 0 on success and 1 on error.
+ */
+int index_save(const char* folder, stream_t* stream, cache_t* db, const char* prefix) {
+
+    // exit code
+    int status = 1;
+
+    // prepare
+    size_t         psize   = strlen(prefix);
+    TCLIST*        keys    = cache_keys(db, prefix, psize);
+    uint64_t       limit   = tclistnum(keys);
+    index_entry_t* entries = (index_entry_t*)ZALLOC(sizeof(index_entry_t) * (limit + 1));
+    void**         blobs   = (void**)ZALLOC(sizeof(void*) * (limit + 1));
+    char*          path    = _index_path(folder, stream);
+    char*          temp    = FORMAT("%s.%d", path, (int)getpid());
+    int            file    = -1;
+    uint32_t       i;
+
+    // header
+    index_head_t head;
+    ZERO(&head, sizeof(index_head_t));
+    head.magic   = INDEX_MAGIC;
+    head.version = INDEX_VERSION;
+    head.device  = stream->file_device;
+    head.inode   = stream->file_inode;
+    head.size    = stream->file_length;
+    head.mtime   = stream->file_mtime;
+    head.period  = stream->period;
+
+    // gather records
+    int         ksize = 0;
+    int         vsize = 0;
+    const char* key   = NULL;
+    for (i = 0; i < limit; i++) {
+        key = tclistval(keys, i, &ksize);
+        if (ksize > psize && ksize - psize < INDEX_NAME_SIZE) {
+            blobs[head.count] = cache_get(db, key, ksize, &vsize);
+            if (blobs[head.count]) {
+                memcpy(entries[head.count].name, key + psize, ksize - psize);
+                entries[head.count].size = vsize;
+                head.count++;
+            }
+        }
+    }
+    tclistdel(keys);
+
+    // layout (8-byte aligned blobs)
+    uint64_t offset = sizeof(index_head_t) + head.count * sizeof(index_entry_t);
+    for (i = 0; i < head.count; i++) {
+        offset = (offset + 7) & ~7ULL;
+        entries[i].offset = offset;
+        offset += entries[i].size;
+    }
+
+    // write (atomically replacing any previous sidecar)
+    file = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) goto error;
+    if (pwrite(file, &head, sizeof(index_head_t), 0) != sizeof(index_head_t)) goto error;
+    if (pwrite(file, entries, head.count * sizeof(index_entry_t), sizeof(index_head_t)) !=
+        head.count * sizeof(index_entry_t)) goto error;
+    for (i = 0; i < head.count; i++) {
+        if (pwrite(file, blobs[i], entries[i].size, entries[i].offset) != entries[i].size) goto error;
+    }
+    if (close(file)) {
+        file = -1;
+        goto error;
+    }
+    file = -1;
+    if (rename(temp, path)) goto error;
+
+    // success
+    status = 0;
+    goto done;
+
+    // error
+    error:
+    WARNING("Could not write sidecar \"%s\" (%s)!", path, strerror(errno));
+    if (file >= 0) {
+        close(file);
+    }
+    unlink(temp);
+
+    // done
+    done:
+    for (i = 0; i < head.count; i++) {
+        FREE(blobs[i]);
+    }
+    FREE(blobs);
+    FREE(entries);
+    FREE(path);
+    FREE(temp);
+    return status;
+}
+
+/*
+ * Remove the sidecar of the given file identity (if any).
+ */
+void index_drop(const char* folder, uint64_t device, uint64_t inode) {
+    char* path = FORMAT("%s/%llx-%llx.idx", folder,
+                        (unsigned long long)device,
+                        (unsigned long long)inode);
+    unlink(path);
+    FREE(path);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Send an asynchronous command to the indexer.
+ * Returns 0 on success and 1 on error.
+ */
+static int _queue_push(indexer_t* self, int command, const char* path, const char* mime) {
+
+    // prepare node
+    index_node_t* node = (index_node_t*)ZALLOC(sizeof(index_node_t));
+    node->command = command;
+    node->path = STRDUP(path);
+    node->mime = STRDUP(mime);
+
+    // acquire lock
+    pthread_spin_lock(&self->lock);
+
+    // coalesce builds of a file already pending or being built (single-flight)
+    if (command == INDEX_BUILD) {
+        index_node_t* pending = self->head->next;
+        while (pending != self->tail &&
+               (pending->command != INDEX_BUILD || strcmp(pending->path, path))) {
+            pending = pending->next;
+        }
+        if (pending != self->tail || (self->building && !strcmp(self->building, path))) {
+            pthread_spin_unlock(&self->lock);
+            FREE(node->path);
+            FREE(node->mime);
+            FREE(node);
+            return 0;
+        }
+    }
+
+    // append
+    node->prev = self->tail->prev;
+    node->next = self->tail;
+    self->tail->prev->next = node;
+    self->tail->prev = node;
+
+    // release lock
+    pthread_spin_unlock(&self->lock);
+
+    // wake-up thread
+    ev_async_send(self->loop, &self->async_w);
+
+    // done
+    return 0;
+}
+
+/*
+ * Retrieves a pending command from the incoming queue. The path and
+ * mime (if available) are taken over by the caller and must be freed.
+ * The function will return 0 on success and 1 if queue was empty.
+ */
+static int _queue_pop(indexer_t* self, int* command, char** path, char** mime) {
+
+    // prepare
+    index_node_t* node = NULL;
+    *command = INDEX_NONE;
+    *path = NULL;
+    *mime = NULL;
+
+    // acquire lock
+    pthread_spin_lock(&self->lock);
+
+    // pop
+    int empty = 1;
+    if (self->head->next != self->tail) {
+
+        // extract
+        node = self->head->next;
+        self->head->next = node->next;
+        node->next->prev = self->head;
+
+        // assign
+        *command = node->command;
+        *path = node->path;
+        *mime = node->mime;
+
+        // ready
+        FREE(node);
+        empty = 0;
+    }
+
+    // release lock
+    pthread_spin_unlock(&self->lock);
+
+    // done
+    return empty;
+}
+
+/*
+ * Build the sidecar of a single file (unless it is already up to date).
+ */
+static void _indexer_build(indexer_t* self, const char* path, const char* mime) {
+
+    // scratch stream
+    size_t    counter = 0;
+    char*     prefix = NULL;
+    stream_t* stream = stream_detached(path, mime, self->period, &counter);
+    stream->db = self->db;
+    stream->index = self->folder;
+
+    // identify
+    if (stream_open(stream)) goto error;
+
+    // skip fresh sidecars
+    if (!index_open(stream)) goto done;
+
+    // parse from the media file itself
+    stream->index = NULL;
+    cache_clear(self->db);
+    if (stream_parse(stream)) goto error;
+
+    // write sidecar
+    prefix = stream_cache_key(stream, "");
+    if (index_save(self->folder, stream, self->db, prefix)) goto error;
+
+    // success
+    TRACE("Indexed \"%s\".", stream->path);
+    self->built++;
+    goto done;
+
+    // error
+    error:
+    WARNING("File \"%s\" could not be indexed!", stream->path);
+    self->failed++;
+
+    // done
+    done:
+    cache_clear(self->db);
+    stream_destroy(stream);
+    FREE(stream);
+    FREE(prefix);
+}
+
+/*
+ * Asynchronous command processor.
+ */
+static void _indexer_async_cb(EV_P_ ev_async* watcher, int events) {
+
+    // get self
+    indexer_t* self    = (indexer_t*)((char*)watcher - offsetof(indexer_t, async_w));
+    int        command = INDEX_NONE;
+    char*      path    = NULL;
+    char*      mime    = NULL;
+
+    // consume
+    while (!_queue_pop(self, &command, &path, &mime)) {
+
+        // handle
+        switch (command) {
+
+        // shutdown
+        case INDEX_STOP:
+            ev_unloop(self->loop, EVUNLOOP_ALL);
+            FREE(path);
+            FREE(mime);
+            return;
+
+        // build (requests for the same file are coalesced meanwhile)
+        case INDEX_BUILD:
+            pthread_spin_lock(&self->lock);
+            self->building = path;
+            pthread_spin_unlock(&self->lock);
+            _indexer_build(self, path, mime);
+            pthread_spin_lock(&self->lock);
+            self->building = NULL;
+            pthread_spin_unlock(&self->lock);
+            FREE(path);
+            FREE(mime);
+            break;
+
+        // ignore
+        default:
+            FREE(path);
+            FREE(mime);
+            break;
+        }
+    }
+}
+
+/*
+ * Indexer main work loop.
+ */
+static void* _indexer_run(void* data) {
+
+    // get self
+    indexer_t* self = (indexer_t*)data;
+
+    // configure
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    // capture commands
+    ev_async_init(&self->async_w, _indexer_async_cb);
+    ev_async_start(self->loop, &self->async_w);
+
+    // enter loop
+    TRACE("Indexer is up.");
+    ev_loop(self->loop, 0);
+
+    // end gracefully
+    TRACE("Indexer is down!");
+    pthread_exit(NULL);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int indexer_new(indexer_t* self) {
+
+    // initialise
+    pthread_spin_init(&self->lock, 0);
+    self->head = (index_node_t*)ZALLOC(sizeof(index_node_t));
+    self->tail = (index_node_t*)ZALLOC(sizeof(index_node_t));
+    self->head->next = self->tail;
+    self->tail->prev = self->head;
+
+    // check folder
+    if (access(self->folder, W_OK)) {
+        ERROR("Index folder \"%s\" is not writable!", self->folder);
+        return 1;
+    }
+
+    // scratch database
+    self->db = (cache_t*)ZALLOC(sizeof(cache_t));
+    if (cache_new(self->db)) {
+        ERROR("Could not create scratch database for indexer!");
+        return 1;
+    }
+
+    // event loop
+    self->loop = ev_loop_new(0);
+    if (!self->loop) {
+        ERROR("Could not create new event loop for indexer!");
+        return 1;
+    }
+
+    // spawn
+    return pthread_create(&self->thread, NULL, _indexer_run, self);
+}
+
+/*
+ * Destructor (pending jobs are completed first).
+ */
+int indexer_destroy(indexer_t* self) {
+
+    // send stop command (queued after all pending jobs)
+    if (self->thread) {
+        _queue_push(self, INDEX_STOP, NULL, NULL);
+        if (pthread_join(self->thread, NULL)) {
+            pthread_cancel(self->thread);
+            WARNING("Indexer stalled, and was cancelled!");
+        }
+    }
+
+    // purge internals
+    if (self->loop) {
+        ev_loop_destroy(self->loop);
+    }
+    if (self->db) {
+        cache_destroy(self->db);
+        FREE(self->db);
+    }
+    pthread_spin_destroy(&self->lock);
+    FREE(self->head);
+    FREE(self->tail);
+
+    // done
+    ZERO(self, sizeof(indexer_t));
+    return 0;
+}
+
+/*
+ * Schedule a file for (re)indexing in the background (files already
+ * waiting in the queue are not enlisted twice).
+ * Returns 0 on success and 1 otherwise.
+ */
+int indexer_enqueue(indexer_t* self, const char* path, const char* mime) {
+
+    // only parsed formats have metadata
+    if (strcmp(mime, STREAM_MP4_MIME) && strcmp(mime, STREAM_FLV_MIME)) {
+        return 1;
+    }
+
+    // enlist file
+    return _queue_push(self, INDEX_BUILD, path, mime);
+}
@@ -0,0 +1,177 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * index.h: Persistent on-disk metadata index (sidecar files).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __index_h__
+#define __index_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <ev.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "cache.h"
+#include "core.h"
+#include "stream.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Sidecar format constants.
+ */
+#define INDEX_MAGIC             0x4C4D5849      // "LMXI"
+#define INDEX_VERSION           1               // bumped on every layout change
+#define INDEX_NAME_SIZE         32              // maximum entry name length (with NUL)
+
+/*
+ * Sidecar file header (all fields in native byte order, since sidecars
+ * are never shared between machines). Entries follow the header and
+ * the entry data follows the entries, each blob being 8-byte aligned.
+ */
+typedef struct {
+    uint32_t            magic;          // INDEX_MAGIC
+    uint32_t            version;        // INDEX_VERSION
+    uint64_t            device;         // media file device
+    uint64_t            inode;          // media file inode
+    uint64_t            size;           // media file size in bytes
+    uint64_t            mtime;          // media file modification time
+    double              period;         // throttling period of the offsets table
+    uint32_t            count;          // number of entries
+    uint32_t            reserved;       // (padding)
+} index_head_t;
+
+typedef struct {
+    char                name[INDEX_NAME_SIZE];
+    uint64_t            offset;         // blob offset from start of file
+    uint64_t            size;           // blob size in bytes
+} index_entry_t;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Commands types coming through the indexer queue.
+ */
+enum {
+    INDEX_NONE,
+    INDEX_STOP,
+    INDEX_BUILD
+};
+
+/*
+ * Job node for the indexer queue.
+ */
+typedef struct index_node_t {
+
+    // internals
+    int                 command;
+    char*               path;
+    char*               mime;
+    struct index_node_t* next;
+    struct index_node_t* prev;
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(int) +
+                        sizeof(char*) * 2 +
+                        sizeof(struct index_node_t*) * 2);
+} index_node_t CACHE_ALIGNED;
+
+/*
+ * Background indexer object.
+ */
+typedef struct indexer_t {
+
+    // arguments
+    char*               folder;         // sidecar files folder
+    double              period;         // throttling period (in seconds)
+
+    // internals
+    size_t              built;          // sidecars written
+    size_t              failed;         // files that could not be indexed
+
+    pthread_t           thread;         // thread handle
+    pthread_spinlock_t  lock;           // spinlock
+    index_node_t*       head;           // incoming queue head
+    index_node_t*       tail;           // incoming queue tail
+    char*               building;       // path of the file being built (if any)
+
+    cache_t*            db;             // scratch database (one file at a time)
+    struct ev_loop*     loop;           // event loop
+
+    ev_async            async_w;        // asynchronous command handler
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(char*) +
+                        sizeof(double) +
+                        sizeof(size_t) * 2 +
+                        sizeof(pthread_t) +
+                        sizeof(pthread_spinlock_t) +
+                        sizeof(index_node_t*) * 2 +
+                        sizeof(char*) +
+                        sizeof(cache_t*) +
+                        sizeof(struct ev_loop*) +
+                        sizeof(ev_async));
+
+} indexer_t CACHE_ALIGNED;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Map the sidecar of an opened stream (file identity must be known).
+ * Returns 0 on success and 1 if the sidecar is missing or outdated.
+ */
+int index_open(stream_t* stream);
+
+/*
+ * Unmap the sidecar of a stream (if mapped).
+ */
+void index_close(stream_t* stream);
+
+/*
+ * Find a named blob in the mapped sidecar of a stream. The returned
+ * pointer is read-only and only valid until index_close() is called.
+ */
+const void* index_find(stream_t* stream, const char* name, int* size);
+
+/*
+ * Write the sidecar for the given stream using every record from the
+ * given database whose key starts with the given prefix (stripped off).
+ * Returns 0 on success and 1 on error.
+ */
+int index_save(const char* folder, stream_t* stream, cache_t* db, const char* prefix);
+
+/*
+ * Remove the sidecar of the given file identity (if any).
+ */
+void index_drop(const char* folder, uint64_t device, uint64_t inode);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor (arguments are prepared in self).
+ */
+int indexer_new(indexer_t* self);
+
+/*
+ * Destructor (pending jobs are completed first).
+ */
+int indexer_destroy(indexer_t* self);
+
+/*
+ * Schedule a file for (re)indexing in the background (files already
+ * waiting in the queue are not enlisted twice).
+ * Returns 0 on success and 1 otherwise.
+ */
+int indexer_enqueue(indexer_t* self, const char* path, const char* mime);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * notify.c: File-system change watcher (cache invalidation).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "notify.h"
+#include "stream.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Watched events.
+ */
+#define NOTIFY_DIRS     (IN_CREATE | IN_MOVED_TO)
+#define NOTIFY_FILES    (IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE)
+#define NOTIFY_EVENTS   (NOTIFY_DIRS | NOTIFY_FILES | IN_DELETE_SELF)
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Recursively watch a folder and all its sub-folders.
+ */
+static void _notify_watch(notify_t* self, const char* folder) {
+
+    // watch
+    int wd = inotify_add_watch(self->inotify, folder, NOTIFY_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        WARNING("Could not watch folder \"%s\" for changes!", folder);
+        return;
+    }
+
+    // remember path
+    if (wd >= self->paths_size) {
+        int size = MAX(wd + 1, self->paths_size * 2);
+        self->paths = (char**)REALLOC(self->paths, sizeof(char*) * size);
+        ZERO(self->paths + self->paths_size, sizeof(char*) * (size - self->paths_size));
+        self->paths_size = size;
+    }
+    FREE(self->paths[wd]);
+    self->paths[wd] = STRDUP(folder);
+
+    // descend
+    DIR* dir = opendir(folder);
+    if (!dir) return;
+    struct dirent* entry;
+    struct stat info;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
+        char* path = FORMAT("%s/%s", folder, entry->d_name);
+        if (!lstat(path, &info) && S_ISDIR(info.st_mode)) {
+            _notify_watch(self, path);
+        }
+        FREE(path);
+    }
+    closedir(dir);
+}
+
+/*
+ * Drop all cache entries (and the sidecar) of the given file path, unless
+ * the file still has the identity under which they were stored.
+ */
+void notify_drop(notify_t* self, const char* path, int moved) {
+
+    // previous identity
+    int   size = 0;
+    char* link = FORMAT("path:%s", path);
+    char* root = self->db ? cache_get(self->db, link, strlen(link), &size) : NULL;
+    if (!root) {
+        FREE(link);
+        return;
+    }
+
+    // current identity (a moved-away file keeps its entries)
+    stream_t probe;
+    struct stat info;
+    char* current = NULL;
+    ZERO(&probe, sizeof(stream_t));
+    if (!moved && !stat(path, &info)) {
+        probe.file_device = info.st_dev;
+        probe.file_inode = info.st_ino;
+        probe.file_length = info.st_size;
+        probe.file_mtime = info.st_mtime;
+        current = stream_cache_key(&probe, "");
+    }
+
+    // forget path
+    cache_out(self->db, link, strlen(link));
+
+    // drop stale entries
+    if (!moved && (!current || strcmp(current, root))) {
+        int i;
+        TCLIST* keys = cache_keys(self->db, root, size);
+        for (i = 0; i < tclistnum(keys); i++) {
+            int ksize = 0;
+            const void* key = tclistval(keys, i, &ksize);
+            cache_out(self->db, key, ksize);
+        }
+        tclistdel(keys);
+
+        // drop stale sidecar
+        unsigned long long device = 0, inode = 0;
+        if (self->index && sscanf(root, "%llx:%llx:", &device, &inode) == 2) {
+            index_drop(self->index, device, inode);
+        }
+
+        // count
+        self->drops++;
+        TRACE("Dropped cached metadata of \"%s\".", path);
+    }
+
+    // done
+    FREE(link);
+    FREE(root);
+    FREE(current);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Read and process inotify events.
+ */
+static void _notify_read_cb(struct ev_loop* loop, ev_io* watcher, int events) {
+
+    // initialize
+    notify_t* self = (notify_t*)(((char*)watcher) - offsetof(notify_t, read_w));
+    char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)]
+         __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    // read
+    ssize_t length = read(self->inotify, buffer, sizeof(buffer));
+    if (length <= 0) return;
+
+    // walk events
+    char* p = buffer;
+    while (p < buffer + length) {
+        struct inotify_event* event = (struct inotify_event*)p;
+        p += sizeof(struct inotify_event) + event->len;
+
+        // overflow (identity keys still protect against stale entries)
+        if (event->mask & IN_Q_OVERFLOW) {
+            WARNING("File-system change events were lost!");
+            continue;
+        }
+
+        // locate folder
+        if (event->wd < 0 || event->wd >= self->paths_size || !self->paths[event->wd]) {
+            continue;
+        }
+
+        // folder gone
+        if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+            FREE(self->paths[event->wd]);
+            continue;
+        }
+
+        // qualify entry
+        if (!event->len) continue;
+        char* path = FORMAT("%s/%s", self->paths[event->wd], event->name);
+
+        // handle
+        if (event->mask & IN_ISDIR) {
+            if (event->mask & NOTIFY_DIRS) {
+                _notify_watch(self, path);
+            }
+        } else if (event->mask & NOTIFY_FILES) {
+            notify_drop(self, path, event->mask & IN_MOVED_FROM);
+            if (self->warmer && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+                warmer_enqueue(self->warmer, path);
+            }
+        }
+
+        // next
+        FREE(path);
+    }
+}
+
+/*
+ * Shutdown handler.
+ */
+static void _notify_stop_cb(struct ev_loop* loop, ev_async* watcher, int events) {
+    ev_unloop(loop, EVUNLOOP_ALL);
+}
+
+/*
+ * Watcher main work loop.
+ */
+static void* _notify_run(void* data) {
+
+    // get self
+    notify_t* self = (notify_t*)data;
+
+    // configure
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    // enter loop
+    TRACE("Notifier is up.");
+    ev_loop(self->loop, 0);
+
+    // end gracefully
+    TRACE("Notifier is down!");
+    pthread_exit(NULL);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int notify_new(notify_t* self) {
+
+    // inotify
+    self->inotify = inotify_init();
+    if (self->inotify < 0) {
+        ERROR("Could not initialize inotify!");
+        return 1;
+    }
+    fcntl(self->inotify, F_SETFL, fcntl(self->inotify, F_GETFL) | O_NONBLOCK);
+
+    // folders
+    char** folder;
+    for (folder = self->folders; *folder; folder++) {
+        size_t length = strlen(*folder);
+        char*  path = STRNDUP(*folder, length > 1 && (*folder)[length - 1] == '/' ? length - 1 : length);
+        _notify_watch(self, path);
+        FREE(path);
+    }
+
+    // event loop
+    self->loop = ev_loop_new(0);
+    if (!self->loop) {
+        ERROR("Could not create new event loop for notifier!");
+        return 1;
+    }
+
+    // watchers
+    ev_io_init(&self->read_w, _notify_read_cb, self->inotify, EV_READ);
+    ev_io_start(self->loop, &self->read_w);
+    ev_async_init(&self->stop_w, _notify_stop_cb);
+    ev_async_start(self->loop, &self->stop_w);
+
+    // spawn
+    return pthread_create(&self->thread, NULL, _notify_run, self);
+}
+
+/*
+ * Destructor.
+ */
+int notify_destroy(notify_t* self) {
+
+    // stop thread
+    if (self->thread) {
+        ev_async_send(self->loop, &self->stop_w);
+        if (pthread_join(self->thread, NULL)) {
+            pthread_cancel(self->thread);
+            WARNING("Notifier stalled, and was cancelled!");
+        }
+    }
+
+    // purge internals
+    if (self->loop) {
+        ev_loop_destroy(self->loop);
+    }
+    if (self->inotify >= 0) {
+        close(self->inotify);
+    }
+    int i;
+    for (i = 0; i < self->paths_size; i++) {
+        FREE(self->paths[i]);
+    }
+    FREE(self->paths);
+
+    // done
+    ZERO(self, sizeof(notify_t));
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * notify.h: File-system change watcher (cache invalidation).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __notify_h__
+#define __notify_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <ev.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "core.h"
+#include "warmer.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Watcher object. Every folder (and sub-folder) is watched through a
+ * single inotify descriptor; whenever a file is modified, replaced or
+ * deleted all cache entries (and the sidecar) of its previous identity
+ * are dropped right away instead of lingering until evicted. Files that
+ * were just written (or moved in) are also handed to the cache warmer.
+ */
+typedef struct notify_t {
+
+    // arguments
+    char**              folders;        // watched folders (NULL terminated)
+    cache_t*            db;             // cache database
+    char*               index;          // sidecar files folder
+    warmer_t*           warmer;         // cache warmer (for new files)
+
+    // internals
+    size_t              drops;          // number of files invalidated
+    int                 inotify;        // inotify descriptor
+    char**              paths;          // folder path for each watch descriptor
+    int                 paths_size;     // size of paths array
+
+    pthread_t           thread;         // thread handle
+    struct ev_loop*     loop;           // event loop
+
+    ev_io               read_w;         // inotify events watcher
+    ev_async            stop_w;         // shutdown handler
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(char**) * 2 +
+                        sizeof(cache_t*) +
+                        sizeof(char*) +
+                        sizeof(warmer_t*) +
+                        sizeof(size_t) +
+                        sizeof(int) * 2 +
+                        sizeof(pthread_t) +
+                        sizeof(struct ev_loop*) +
+                        sizeof(ev_io) +
+                        sizeof(ev_async));
+
+} notify_t CACHE_ALIGNED;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor (arguments are prepared in self).
+ */
+int notify_new(notify_t* self);
+
+/*
+ * Destructor.
+ */
+int notify_destroy(notify_t* self);
+
+/*
+ * Drop all cache entries (and the sidecar) of the given file path, unless
+ * the file still has the identity under which they were stored.
+ */
+void notify_drop(notify_t* self, const char* path, int moved);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
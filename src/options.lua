@@ -30,27 +30,53 @@ end
 bind = '*'
 port = 80
 workers = 2
+parsers = 2
 clients = 1000
 throttle = 20
+throttle_min = nil
+throttle_max = nil
+pacing = false
 cache = 256
+shared = nil
 hosts = setmetatable({}, { __newindex = __sortedindex })
 mimes = {}
+index = nil
+indexing = false
+warmers = 1
+warming = 10
+hotlist = nil
+
+-- Mime type of a file path (nil if the file type is not served).
+function mimeof(path)
+    local type = path:match('%.([%w_]+)$')
+    if type then
+        type = (',%s,'):format(type:lower())
+        for mime, types in pairs(mimes) do
+            if types:find(type, 1, true) then
+                return mime:lower()
+            end
+        end
+    end
+    return nil
+end
 
 --------------------------------------------------------------------------------------------------------------
 
 -- Arguments.
 local defs = {
     ['help']    = 'h',
+    ['index']   = 'i',
     ['options'] = 'o'
 }
 
 -- Configure.
 local exe = arg[0]
-local arg = getopts.get_opts(arg, 'ho:', defs)
+local arg = getopts.get_opts(arg, 'hio:', defs)
 if arg['h'] then
-    print(('Usage: %s [-h|--help] [-o|--options <.../options.lua>]'):format(exe))
+    print(('Usage: %s [-h|--help] [-i|--index] [-o|--options <.../options.lua>]'):format(exe))
     os.exit()
 end
+indexing = arg['i'] and true or false
 
 -- Hints.
 core.hint("To specify another configuration file, use '--options'.")
@@ -94,3 +120,24 @@ end
 for mime, types in pairs(mimes) do
     mimes[mime] = (',%s,'):format(types:gsub('%s+', ','))
 end
+
+-- Qualify index folder.
+if index then
+    index = core.realpath(index) or
+            core.fatal(('Unresolvable index folder %q!'):format(index))
+elseif indexing then
+    core.fatal('Indexing requires an index folder (options.index)!')
+end
+
+-- Qualify shared cache name.
+if shared and shared:sub(1, 1) ~= '/' then
+    shared = '/'..shared
+end
+
+-- Served file types (extension => mime).
+types = {}
+for mime, list in pairs(mimes) do
+    for type in list:gmatch('[^,]+') do
+        types[type:lower()] = mime:lower()
+    end
+end
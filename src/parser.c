@@ -0,0 +1,254 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * parser.c: Metadata parser thread pool (keeps parsing off the workers).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <pthread.h>
+
+#include "parser.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Retrieves the next stream to parse, waiting for one if needed.
+ * Returns 0 on success and 1 if the pool is shutting down.
+ */
+static int _queue_pop(parser_t* self, stream_t** stream, ev_tstamp* queued) {
+
+    // acquire lock
+    pthread_mutex_lock(&self->lock);
+
+    // wait
+    while (!self->stopping && self->head->next == self->tail) {
+        pthread_cond_wait(&self->ready, &self->lock);
+    }
+
+    // pop
+    int empty = 1;
+    if (!self->stopping) {
+
+        // extract
+        parse_node_t* node = self->head->next;
+        self->head->next = node->next;
+        node->next->prev = self->head;
+
+        // assign
+        *stream = node->stream;
+        *queued = node->queued;
+
+        // ready
+        FREE(node);
+        empty = 0;
+    }
+
+    // release lock
+    pthread_mutex_unlock(&self->lock);
+
+    // done
+    return empty;
+}
+
+/*
+ * Parse a single stream and hand it back to its worker.
+ */
+static void _parser_parse(parse_thread_t* self, stream_t* stream, ev_tstamp queued) {
+
+    // join (parked streams belong to the flight by now, see flight.h)
+    parser_t* parser = self->parser;
+    ev_tstamp start = ev_time();
+    int parked = stream_join(stream);
+
+    // measure wait
+    pthread_mutex_lock(&parser->lock);
+    parser->wait_sum += start - queued;
+    parser->wait_count++;
+    pthread_mutex_unlock(&parser->lock);
+    if (parked) return;
+
+    // borrow counters
+    size_t* cache_hits = stream->cache_hits;
+    size_t* cache_misses = stream->cache_misses;
+    size_t* parse_faults = stream->parse_faults;
+    stream->cache_hits = &self->cache_hits;
+    stream->cache_misses = &self->cache_misses;
+    stream->parse_faults = &self->parse_faults;
+
+    // parse
+    stream_load(stream);
+
+    // measure parse
+    pthread_mutex_lock(&parser->lock);
+    parser->parse_sum += ev_time() - start;
+    parser->parse_count++;
+    pthread_mutex_unlock(&parser->lock);
+
+    // hand back (detached streams were only parsed into the cache, see stream_complete)
+    stream->cache_hits = cache_hits;
+    stream->cache_misses = cache_misses;
+    stream->parse_faults = parse_faults;
+    if (!stream->loop) {
+        stream_destroy(stream);
+        FREE(stream);
+        return;
+    }
+    ev_async_send(stream->loop, &stream->wake_w);
+}
+
+/*
+ * Parser thread main loop.
+ */
+static void* _parser_run(void* data) {
+
+    // get self
+    parse_thread_t* self = (parse_thread_t*)data;
+    stream_t* stream = NULL;
+    ev_tstamp queued = 0;
+
+    // configure
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    // consume
+    TRACE("Parser %u is up.", self->id);
+    while (!_queue_pop(self->parser, &stream, &queued)) {
+        _parser_parse(self, stream, queued);
+    }
+
+    // end gracefully
+    TRACE("Parser %u is down!", self->id);
+    pthread_exit(NULL);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int parser_new(parser_t* self) {
+
+    // initialise
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->ready, NULL);
+    self->head = (parse_node_t*)ZALLOC(sizeof(parse_node_t));
+    self->tail = (parse_node_t*)ZALLOC(sizeof(parse_node_t));
+    self->head->next = self->tail;
+    self->tail->prev = self->head;
+
+    // spawn
+    int i;
+    self->pool = (parse_thread_t*)ZALLOC(sizeof(parse_thread_t) * self->threads);
+    for (i = 0; i < self->threads; i++) {
+        self->pool[i].id = i + 1;
+        self->pool[i].parser = self;
+        if (pthread_create(&self->pool[i].thread, NULL, _parser_run, &self->pool[i])) {
+            ERROR("Could not create parser thread %u!", i + 1);
+            return 1;
+        }
+    }
+
+    // success
+    return 0;
+}
+
+/*
+ * Destructor.
+ */
+int parser_destroy(parser_t* self) {
+
+    // stop threads (after their current stream)
+    pthread_mutex_lock(&self->lock);
+    self->stopping = 1;
+    pthread_cond_broadcast(&self->ready);
+    pthread_mutex_unlock(&self->lock);
+    int i;
+    for (i = 0; self->pool && i < self->threads; i++) {
+        parse_thread_t* thread = &self->pool[i];
+        if (thread->thread && pthread_join(thread->thread, NULL)) {
+            pthread_cancel(thread->thread);
+            WARNING("Parser %u stalled, and was cancelled!", thread->id);
+        }
+    }
+
+    // purge queue (streams belong to their workers, detached ones to the pool)
+    while (self->head && self->head->next != self->tail) {
+        parse_node_t* node = self->head->next;
+        self->head->next = node->next;
+        if (!node->stream->loop) {
+            stream_destroy(node->stream);
+            FREE(node->stream);
+        }
+        FREE(node);
+    }
+
+    // purge internals
+    pthread_cond_destroy(&self->ready);
+    pthread_mutex_destroy(&self->lock);
+    FREE(self->pool);
+    FREE(self->head);
+    FREE(self->tail);
+
+    // done
+    ZERO(self, sizeof(parser_t));
+    return 0;
+}
+
+/*
+ * Hand a stream over for parsing.
+ */
+int parser_enqueue(parser_t* self, stream_t* stream) {
+
+    // prepare node
+    parse_node_t* node = (parse_node_t*)ZALLOC(sizeof(parse_node_t));
+    node->stream = stream;
+    node->queued = ev_time();
+
+    // acquire lock
+    pthread_mutex_lock(&self->lock);
+
+    // refuse (shutting down)
+    if (self->stopping) {
+        pthread_mutex_unlock(&self->lock);
+        FREE(node);
+        return 1;
+    }
+
+    // append
+    node->prev = self->tail->prev;
+    node->next = self->tail;
+    self->tail->prev->next = node;
+    self->tail->prev = node;
+
+    // wake-up a thread
+    pthread_cond_signal(&self->ready);
+
+    // release lock
+    pthread_mutex_unlock(&self->lock);
+
+    // done
+    return 0;
+}
+
+/*
+ * Get the average queue wait (since the previous reading).
+ */
+double parser_wait(parser_t* self) {
+    pthread_mutex_lock(&self->lock);
+    double result = self->wait_count ? self->wait_sum / self->wait_count : 0;
+    self->wait_sum = self->wait_count = 0;
+    pthread_mutex_unlock(&self->lock);
+    return result;
+}
+
+/*
+ * Get the average parse time (since the previous reading).
+ */
+double parser_time(parser_t* self) {
+    pthread_mutex_lock(&self->lock);
+    double result = self->parse_count ? self->parse_sum / self->parse_count : 0;
+    self->parse_sum = self->parse_count = 0;
+    pthread_mutex_unlock(&self->lock);
+    return result;
+}
@@ -0,0 +1,132 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * parser.h: Metadata parser thread pool (keeps parsing off the workers).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __parser_h__
+#define __parser_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <ev.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "stream.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Job node for the parser queue.
+ */
+typedef struct parse_node_t {
+
+    // internals
+    stream_t*           stream;
+    ev_tstamp           queued;         // time of enqueuing
+    struct parse_node_t* next;
+    struct parse_node_t* prev;
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(stream_t*) +
+                        sizeof(ev_tstamp) +
+                        sizeof(struct parse_node_t*) * 2);
+} parse_node_t CACHE_ALIGNED;
+
+/*
+ * Parser thread (all threads share the parser queue). Streams are parsed
+ * with their cache counters pointing here, since the workers owning them
+ * keep updating their own counters meanwhile.
+ */
+typedef struct parse_thread_t {
+
+    // arguments
+    unsigned int        id;             // thread number
+    struct parser_t*    parser;         // owner
+
+    // internals
+    size_t              cache_hits;     // number of successful db gets
+    size_t              cache_misses;   // number of failed db gets
+    size_t              parse_faults;   // major page faults while loading metadata
+
+    pthread_t           thread;         // thread handle
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(unsigned int) +
+                        sizeof(struct parser_t*) +
+                        sizeof(size_t) * 3 +
+                        sizeof(pthread_t));
+
+} parse_thread_t CACHE_ALIGNED;
+
+/*
+ * Parser pool object. Workers hand over new streams right away and get
+ * them back (through the streams' wake_w watchers) once their headers,
+ * offsets and limits are ready, so a cold parse never stalls the other
+ * streams of a worker. Time spent waiting in the queue and time spent
+ * parsing are measured separately.
+ */
+typedef struct parser_t {
+
+    // arguments
+    unsigned int        threads;        // number of parser threads
+
+    // internals
+    int                 stopping;       // shutdown in progress
+    double              wait_sum;       // total queue wait (since last reading)
+    double              wait_count;     // streams dequeued (since last reading)
+    double              parse_sum;      // total parse time (since last reading)
+    double              parse_count;    // streams parsed (since last reading)
+
+    pthread_mutex_t     lock;           // queue lock
+    pthread_cond_t      ready;          // queue not empty (or stopping)
+    parse_node_t*       head;           // queue head
+    parse_node_t*       tail;           // queue tail
+    parse_thread_t*     pool;           // parser threads
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(unsigned int) +
+                        sizeof(int) +
+                        sizeof(double) * 4 +
+                        sizeof(pthread_mutex_t) +
+                        sizeof(pthread_cond_t) +
+                        sizeof(parse_node_t*) * 2 +
+                        sizeof(parse_thread_t*));
+
+} parser_t CACHE_ALIGNED;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor (arguments are prepared in self).
+ */
+int parser_new(parser_t* self);
+
+/*
+ * Destructor (streams still queued are left to their workers).
+ */
+int parser_destroy(parser_t* self);
+
+/*
+ * Hand a stream over for parsing (see stream_join() and stream_load()). The
+ * stream's wake_w watcher must be started; it is signalled once the stream
+ * is parsed. Detached streams (without a loop) are only parsed into the
+ * cache and then released by the pool (see stream_complete()). Returns 0 on
+ * success and 1 if the pool is shutting down.
+ */
+int parser_enqueue(parser_t* self, stream_t* stream);
+
+/*
+ * Get the average queue wait and parse time (in seconds) since the
+ * previous reading of the same indicator.
+ */
+double parser_wait(parser_t* self);
+double parser_time(parser_t* self);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
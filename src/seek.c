@@ -0,0 +1,85 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * seek.c: Seek resolution over keyframe and offset tables.
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include "seek.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Index of the last entry of table[low, high) not greater than the value
+ * (less than it, if strict), or low - 1 if there is none.
+ */
+static ssize_t _seek_double(const double* table, size_t low, size_t high, double value, int strict) {
+    while (low < high) {
+        size_t middle = low + ((high - low) >> 1);
+        if (table[middle] < value || (!strict && table[middle] == value)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return (ssize_t)low - 1;
+}
+
+static ssize_t _seek_off_t(const off_t* table, size_t low, size_t high, double value, int strict) {
+    while (low < high) {
+        size_t middle = low + ((high - low) >> 1);
+        if (table[middle] < value || (!strict && table[middle] == value)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return (ssize_t)low - 1;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Resolve a start/stop pair against a sorted table of keyframe points.
+ */
+void seek_points(const double* points, size_t count, double start, double stop, int strict,
+                 ssize_t* first, ssize_t* last) {
+    *first = start ? _seek_double(points, 0, count, start, strict) : -1;
+    if (!stop) {
+        *last = -1;
+    } else if (stop >= start && *first >= 0) {
+        *last = _seek_double(points, *first, count, stop, strict);
+    } else {
+        *last = _seek_double(points, 0, count, stop, strict);
+    }
+}
+
+/*
+ * Resolve a start/stop pair against a sorted table of file offsets.
+ */
+void seek_offsets(const off_t* offsets, size_t count, double start, double stop, int strict,
+                  ssize_t* first, ssize_t* last) {
+    *first = start ? _seek_off_t(offsets, 0, count, start, strict) : -1;
+    if (!stop) {
+        *last = -1;
+    } else if (stop >= start && *first >= 0) {
+        *last = _seek_off_t(offsets, *first, count, stop, strict);
+    } else {
+        *last = _seek_off_t(offsets, 0, count, stop, strict);
+    }
+}
+
+/*
+ * Convert the limits of a spatial request into seconds.
+ */
+void seek_spatial(stream_t* self) {
+    if (self->spatial) {
+        ssize_t first, last;
+        seek_offsets(self->offsets, self->periods, self->start, self->stop, 1, &first, &last);
+        self->start = first >= 0 ? first * self->period : 0;
+        self->stop = last >= 0 ? last * self->period : 0;
+        self->spatial = 0;
+    }
+}
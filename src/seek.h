@@ -0,0 +1,47 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * seek.h: Seek resolution over keyframe and offset tables.
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __seek_h__
+#define __seek_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "core.h"
+#include "stream.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Resolve a start/stop pair against a sorted table of keyframe points (times
+ * or file positions) in one pass, the stop search being narrowed down by the
+ * start result. Each index is that of the last point not after the limit
+ * (strictly before it, if strict), or -1 if the limit is zero or precedes
+ * all points.
+ */
+void seek_points(const double* points, size_t count, double start, double stop, int strict,
+                 ssize_t* first, ssize_t* last);
+
+/*
+ * Same as seek_points(), over a sorted table of file offsets.
+ */
+void seek_offsets(const off_t* offsets, size_t count, double start, double stop, int strict,
+                  ssize_t* first, ssize_t* last);
+
+/*
+ * Convert the limits of a spatial (byte units) request into seconds, each
+ * snapped to the start of the throttling period holding it.
+ */
+void seek_spatial(stream_t* self);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
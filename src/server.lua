@@ -49,11 +49,45 @@ end
 
 --------------------------------------------------------------------------------------------------------------
 
+-- Watched folders (cache invalidation).
+local folders = {}
+for _, host in ipairs(options.hosts) do
+    folders[#folders + 1] = host.folder
+end
+
 -- Workers.
 local engine = engine:new{ workers = options.workers,
+                           parsers = options.parsers,
                            throttle = options.throttle,
+                           throttle_min = options.throttle_min,
+                           throttle_max = options.throttle_max,
+                           pacing = options.pacing,
                            clients = options.clients,
-                           cache = options.cache * 1048576 }
+                           cache = options.cache * 1048576,
+                           shared = options.shared,
+                           index = options.index,
+                           watch = not options.indexing and folders or nil,
+                           types = options.types,
+                           warmers = not options.indexing and options.warmers or 0,
+                           warming = options.warming,
+                           hotlist = not options.indexing and options.hotlist or nil }
+
+-- Indexing mode (builds all sidecars, then exits).
+if options.indexing then
+    local count = 0
+    core.info(('Indexing into %q...'):format(options.index))
+    for _, host in ipairs(options.hosts) do
+        for _, path in ipairs(core.files(host.folder)) do
+            local mime = options.mimeof(path)
+            if mime and engine:index(path, mime) then
+                count = count + 1
+            end
+        end
+    end
+    engine:destroy()
+    core.info(('Indexing done (%u files).'):format(count))
+    os.exit()
+end
 
 -- Services.
 local services = {}
@@ -90,24 +124,11 @@ services['stream'].call = function(client)
     end
 
     -- Path and mime type.
-    local mime = nil
     local path = core.realpath(client.request.folder..client.request.location)
-
-    -- Check valid path.
-    if path then
-        local type = path:match('%.([%w_]+)$')
-        if type then
-            type = (',%s,'):format(type:lower())
-            for m, t in pairs(options.mimes) do
-                if t:find(type, 1, true) then
-                    mime = m:lower()
-                end
-            end
-        end
-    end
+    local mime = path and options.mimeof(path)
 
     -- Check proper file.
-    if not path or not mime or not type then
+    if not path or not mime then
         client:error_404('Unlocatable resource!')
         return
     end
@@ -123,6 +144,19 @@ services['stream'].call = function(client)
     local start = client.request.args['start'] or 0.0
     local stop  = client.request.args['stop'] or 0.0
     local units = (client.request.args['units'] or '?'):sub(1, 1)
+    local format = client.request.args['format']
+    local segment = client.request.args['segment']
+    local tracks = client.request.args['tracks']
+    local trick = client.request.args['trick']
+
+    -- Arguments carried over to segment URLs (tokens etc.), minus those they set.
+    local query = {}
+    for pair in (client.request.get:match('%?([^ ]*)') or ''):gmatch('[^&]+') do
+        local key = pair:match('^[^=]*')
+        if key ~= 'format' and key ~= 'segment' then
+            query[#query + 1] = pair
+        end
+    end
 
     -- Calibrate.
     if units ~= 'b' and units ~= 's' then
@@ -135,11 +169,17 @@ services['stream'].call = function(client)
 
     -- Dispatch.
     local success, error = engine:dispatch{ client  = client,
+                                            host    = client.request.host,
                                             path    = path,
                                             mime    = mime,
                                             spatial = units == 'b',
                                             start   = start,
-                                            stop    = stop }
+                                            stop    = stop,
+                                            format  = format,
+                                            segment = segment,
+                                            tracks  = tracks,
+                                            trick   = trick,
+                                            query   = table.concat(query, '&') }
 
     -- Success.
     if success then
@@ -187,7 +227,11 @@ local root = {
                         '',
                         '# Configuration:',
                         ('workers = %s'):format(options.workers),
+                        ('parsers = %s'):format(options.parsers),
                         ('throttle = %s'):format(options.throttle),
+                        ('throttle:min = %s'):format(tostring(options.throttle_min)),
+                        ('throttle:max = %s'):format(tostring(options.throttle_max)),
+                        ('pacing = %s'):format(tostring(options.pacing)),
                         '',
                         '# Run-time:',
                         ('start = %s'):format(os.date('%Y-%m-%d %H:%M:%S %Z', start)),
@@ -200,6 +244,15 @@ local root = {
                         ('cache:items = %u'):format(engine:monitor('cache:items')),
                         ('cache:hits = %u'):format(engine:monitor('cache:hits')),
                         ('cache:misses = %u'):format(engine:monitor('cache:misses')),
+                        ('cache:drops = %u'):format(engine:monitor('cache:drops')),
+                        ('parse:faults = %u'):format(engine:monitor('parse:faults')),
+                        ('parse:parked = %u'):format(engine:monitor('parse:parked')),
+                        ('parse:wait = %.3f seconds'):format(engine:monitor('parse:wait')),
+                        ('parse:time = %.3f seconds'):format(engine:monitor('parse:time')),
+                        ('index:built = %u'):format(engine:monitor('index:built')),
+                        ('index:failed = %u'):format(engine:monitor('index:failed')),
+                        ('warm:done = %u'):format(engine:monitor('warm:done')),
+                        ('warm:failed = %u'):format(engine:monitor('warm:failed')),
                         '',
                         '# Networking:',
                         monitor:render(),
@@ -208,7 +261,19 @@ local root = {
                         ('clients:limit = %s'):format(options.clients),
                         ('clients:active = %u'):format(engine:monitor('load')),
                         ('data:total = %.1f MB'):format(engine:monitor('data:total') / 1048576.0),
-                        ('data:delay = %.3f seconds'):format(engine:monitor('data:delay')) }
+                        ('data:delay = %.3f seconds'):format(engine:monitor('data:delay')),
+                        ('data:saved = %.1f MB'):format(engine:monitor('data:saved') / 1048576.0),
+                        ('data:wasted = %.1f MB'):format(engine:monitor('data:wasted') / 1048576.0),
+                        ('data:resent = %.2f %%'):format(engine:monitor('data:resent') * 100.0) }
+        local wasted = engine:wasted()
+        local hosts = {}
+        for host in pairs(wasted) do
+            hosts[#hosts + 1] = host
+        end
+        table.sort(hosts)
+        for _, host in ipairs(hosts) do
+            stats[#stats + 1] = ('data:wasted:%s = %.1f MB'):format(host, wasted[host] / 1048576.0)
+        end
 
         -- Publish.
         client:dynamic_200('text/plain', table.concat(stats, '\n'))
@@ -12,10 +12,15 @@
 #include <stddef.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "core.h"
+#include "flight.h"
+#include "index.h"
 #include "loomiere.h"
+#include "parser.h"
 #include "stream.h"
 #include "stream_flv.h"
 #include "stream_mp4.h"
@@ -70,6 +75,106 @@
     }
 #endif
 
+/*
+ * int _getlink(int socket, double* rate, double* rtt, double* unacked)
+ * Estimated link rate (bytes/second, congestion window over round-trip
+ * time), smoothed round-trip time (seconds) and bytes sent but unacked.
+ */
+#if defined(__linux__)
+    int _getlink(int socket, double* rate, double* rtt, double* unacked) {
+        struct tcp_info info;
+        socklen_t size = sizeof(info);
+        if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &size) || !info.tcpi_rtt) {
+            return 1;
+        }
+        *rtt = info.tcpi_rtt / 1000000.0;
+        *rate = (double)info.tcpi_snd_cwnd * info.tcpi_snd_mss / *rtt;
+        *unacked = (double)info.tcpi_unacked * info.tcpi_snd_mss;
+        return 0;
+    }
+#else
+    #warning "The _getlink() wrapper is not (yet) implemented on this system! Ignoring..."
+    int _getlink(int socket, double* rate, double* rtt, double* unacked) {
+        return 1;
+    }
+#endif
+
+/*
+ * int _getqueue(int socket, size_t* queued, int* closed)
+ * Bytes in the send queue (unsent or unacked) and whether the peer keeps
+ * its receive window closed (zero-window probes outstanding).
+ */
+#if defined(__linux__)
+    #include <linux/sockios.h>
+    #include <sys/ioctl.h>
+    int _getqueue(int socket, size_t* queued, int* closed) {
+        int bytes;
+        struct tcp_info info;
+        socklen_t size = sizeof(info);
+        if (ioctl(socket, SIOCOUTQ, &bytes) ||
+            getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &size)) {
+            return 1;
+        }
+        *queued = (size_t)MAX(bytes, 0);
+        *closed = info.tcpi_probes > 0;
+        return 0;
+    }
+#else
+    #warning "The _getqueue() wrapper is not (yet) implemented on this system! Ignoring..."
+    int _getqueue(int socket, size_t* queued, int* closed) {
+        return 1;
+    }
+#endif
+
+/*
+ * int _setpacing(int socket, double rate)
+ * Cap the rate (bytes/second, 0 = unlimited) at which the kernel transmits
+ * the socket's data, spreading it evenly in time (TCP internal pacing, or
+ * the fq queueing discipline on older kernels).
+ */
+#if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+    int _setpacing(int socket, double rate) {
+        unsigned int value = (rate > 0 && rate < ~0U) ? (unsigned int)rate : ~0U;
+        return setsockopt(socket, SOL_SOCKET, SO_MAX_PACING_RATE, &value, sizeof(value));
+    }
+#else
+    #warning "The _setpacing() wrapper is not (yet) implemented on this system! Ignoring..."
+    int _setpacing(int socket, double rate) {
+        return 1;
+    }
+#endif
+
+/*
+ * int _getresent(int socket, double* resent)
+ * Bytes retransmitted over the life of the connection (estimated from the
+ * retransmitted segments).
+ */
+#if defined(__linux__)
+    int _getresent(int socket, double* resent) {
+        struct tcp_info info;
+        socklen_t size = sizeof(info);
+        if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &size)) {
+            return 1;
+        }
+        *resent = (double)info.tcpi_total_retrans * info.tcpi_snd_mss;
+        return 0;
+    }
+#else
+    #warning "The _getresent() wrapper is not (yet) implemented on this system! Ignoring..."
+    int _getresent(int socket, double* resent) {
+        return 1;
+    }
+#endif
+
+/*
+ * Maximum vectors handed to a single writev() call.
+ */
+#ifdef IOV_MAX
+    #define _IOV_MAX IOV_MAX
+#else
+    #define _IOV_MAX 1024
+#endif
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
@@ -79,9 +184,21 @@ static void _hint_cb(struct ev_loop*, ev_io*, int);
 static void _send_cb(struct ev_loop*, ev_io*, int);
 static void _wait_cb(struct ev_loop*, ev_timer*, int);
 static void _jump_cb(struct ev_loop*, ev_timer*, int);
+static void _wake_cb(struct ev_loop*, ev_async*, int);
 
 /*----------------------------------------------------------------------------------------------------------*/
 
+/*
+ * Play-head (in seconds since the start of the transfer): the one reported
+ * by the player if any, or else assuming uninterrupted playback.
+ */
+static ev_tstamp _stream_play_head(stream_t* self, ev_tstamp now) {
+    if (self->hint_time) {
+        return self->hint_head + (self->hint_paused ? 0 : now - self->hint_time);
+    }
+    return now - self->tzero;
+}
+
 /*
  * Schedule the sending process.
  */
@@ -106,6 +223,148 @@ static void _stream_advance(stream_t* self) {
     ev_io_start(self->loop, &self->send_w);
 }
 
+/*
+ * Release the headers vectors and the buffers they reference.
+ */
+static void _stream_head_release(stream_t* self) {
+    int i;
+    for (i = 0; i < self->head_blocks_count; i++) {
+        FREE(self->head_blocks[i]);
+    }
+    FREE(self->head_blocks);
+    FREE(self->head_iovs);
+    self->head_blocks_count = self->head_count = self->head_index = 0;
+}
+
+/*
+ * Extend a lazily computed offsets table, one chunk at a time, while the
+ * given period is within a chunk of the offsets ready, so the loop never
+ * computes more than the throttling is about to need (the complete table
+ * is computed off the loop meanwhile, see stream_complete(), and adopted as
+ * soon as it is cached). Returns 0 on success and 1 if the table could not
+ * be extended, in which case throttling is abandoned.
+ */
+static int _stream_extend(stream_t* self, off_t target) {
+    while (self->extend && target + STREAM_OFFSETS_CHUNK >= (off_t)self->offsets_ready) {
+        if (self->extend(self, 0)) {
+            self->extend(self, 1);
+            self->extend = NULL;
+            self->throttle = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Adapt the run-ahead to the connection (at most once per period), given
+ * the play-head and the period of the current target (whose offset must be
+ * ready). The run-ahead needed shrinks as the link outpaces the media rate
+ * (a stall is made up for quickly), and grows with the media still in
+ * flight and with the round-trip time. It grows at once but shrinks slowly.
+ */
+static void _stream_adapt(stream_t* self, ev_tstamp now, ev_tstamp play_head, off_t target) {
+
+    // sample
+    if (now - self->throttle_sampled < self->period) return;
+    self->throttle_sampled = now;
+
+    // media rate ahead of the play-head (bytes/second)
+    off_t  from = (off_t)floor((self->start + play_head) / self->period);
+    double media = 0;
+    if (from >= 0 && from < target) {
+        media = (double)(self->offsets[target] - self->offsets[from]) / ((target - from) * self->period);
+    }
+
+    // link state
+    double rate, rtt, unacked;
+    if (media <= 0 || _getlink(self->socket, &rate, &rtt, &unacked)) return;
+
+    // needed run-ahead
+    double lead = self->throttle_max;
+    if (rate > media) {
+        lead = self->throttle_min + (self->throttle_max - self->throttle_min) * media / rate;
+    }
+    lead += unacked / media + rtt;
+    lead = MAX(MIN(lead, self->throttle_max), self->throttle_min);
+
+    // adapt
+    if (lead > self->throttle) {
+        self->throttle = lead;
+    } else {
+        self->throttle += (lead - self->throttle) / 4;
+    }
+}
+
+/*
+ * Pace the stream in the kernel (at most once per period, given the period
+ * of the current target, whose offset must be ready) at the rate it needs
+ * over the next STREAM_PACING_WINDOW periods: the data up to the target that
+ * many periods ahead, not sent yet (but no less than the media rate), plus
+ * some headroom. Each period's data then leaves the socket evenly instead of
+ * in a burst at line rate. A rate of 0 lifts the cap (see _setpacing).
+ */
+static void _stream_pace(stream_t* self, ev_tstamp now, off_t target) {
+
+    // sample
+    if (now - self->pacing_sampled < self->period) return;
+    self->pacing_sampled = now;
+
+    // window (offsets ready)
+    off_t ahead = MIN(target + STREAM_PACING_WINDOW, (off_t)self->periods - 1);
+    if (self->extend) {
+        ahead = MIN(ahead, (off_t)self->offsets_ready - 1);
+    }
+
+    // needed rate (bytes/second)
+    double rate = 0;
+    if (ahead > target) {
+        double span = (ahead - target) * self->period;
+        double media = (double)(self->offsets[ahead] - self->offsets[target]) / span;
+        double owed = (double)(MIN(self->offsets[ahead], self->file_finish) - self->file_offset) / span;
+        rate = MAX(media, owed) * STREAM_PACING_HEADROOM;
+    }
+
+    // apply
+    if (rate != self->pacing_rate && !_setpacing(self->socket, rate)) {
+        self->pacing_rate = rate;
+    }
+}
+
+/*
+ * Sample the send queue, counting the samples in a row over which nothing
+ * was delivered (bytes were queued but did not drain at all) or the peer
+ * kept its receive window closed. A viewer gone without a reset looks like
+ * this: the kernel still holds the connection, but the player reads no more.
+ */
+static void _stream_drain(stream_t* self, ev_tstamp now) {
+
+    // sample
+    size_t queued;
+    int    closed;
+    self->silent_sampled = now;
+    if (_getqueue(self->socket, &queued, &closed)) return;
+
+    // delivered since the previous sample
+    off_t delivered = (off_t)self->silent_queued + (self->data_sent - self->silent_sent) - (off_t)queued;
+    if (closed || (queued && delivered <= 0)) {
+        self->silent_stalls++;
+    } else {
+        self->silent_stalls = 0;
+    }
+    self->silent_queued = queued;
+    self->silent_sent = self->data_sent;
+}
+
+/*
+ * Park a silent stream: nothing more is sent, its send queue is only looked
+ * at once a period (see _jump_cb) until it drains or the send-timeout expires.
+ */
+static void _stream_park(stream_t* self) {
+    self->silent_parked = 1;
+    _stream_schedule(self);
+}
+
 /*
  * Generic (fake) parser to allow sending any file.
  */
@@ -134,14 +393,79 @@ int _stream_any_parse(stream_t* self) {
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
- * Read and process hint.
+ * Apply a player hint (unknown commands are ignored).
+ */
+static void _stream_hint(stream_t* self, const char* command, size_t size, double head) {
+
+    // decode
+    if (size == strlen(STREAM_HINT_PLAY) && !memcmp(command, STREAM_HINT_PLAY, size)) {
+        self->hint_paused = 0;
+    } else if (size == strlen(STREAM_HINT_PAUSE) && !memcmp(command, STREAM_HINT_PAUSE, size)) {
+        self->hint_paused = 1;
+    } else if (size != strlen(STREAM_HINT_SEEK) || memcmp(command, STREAM_HINT_SEEK, size)) {
+        return;
+    }
+
+    // follow
+    self->hint_head = head;
+    self->hint_time = ev_now(self->loop);
+
+    // retarget on the next loop iteration rather than at the next period
+    if (ev_is_active(&self->jump_w)) {
+        ev_timer_stop(self->loop, &self->jump_w);
+        ev_timer_set(&self->jump_w, 0, 0);
+        ev_timer_start(self->loop, &self->jump_w);
+    }
+}
+
+/*
+ * Read and process hints.
  */
 static void _hint_cb(struct ev_loop* loop, ev_io* watcher, int events) {
 
     // initialize
     stream_t* self = (stream_t*)(((char*)watcher) - offsetof(stream_t, hint_w));
 
-    // TODO: implement (AMF) hint capture!
+    // read (the transfer notices closed sockets by itself)
+    ssize_t result = read(self->socket, self->hint + self->hint_length, STREAM_HINT_SIZE - self->hint_length);
+    if (result <= 0) {
+        if (result == -1 && (errno == EAGAIN || errno == EINTR)) {
+            return;
+        }
+        goto stop;
+    }
+    self->hint_length += result;
+
+    // decode complete hints
+    const uint8_t* b = (const uint8_t*)self->hint;
+    const uint8_t* e = b + self->hint_length;
+    while (e - b >= 3) {
+
+        // command (anything else is not a hint channel)
+        if (b[0] != AMF0_STRING) goto stop;
+        size_t size = read_16(b + 1);
+        if (3 + size + 9 > STREAM_HINT_SIZE) goto stop;
+        if (e - b < 3 + size + 9) break;
+
+        // play-head
+        const uint8_t* value = b + 3 + size;
+        if (value[0] != AMF0_NUMBER) goto stop;
+        union { uint64_t u; double d; } head;
+        head.u = read_64(value + 1);
+        if (isfinite(head.d) && head.d >= 0) {
+            _stream_hint(self, (const char*)b + 3, size, head.d);
+        }
+        b = value + 9;
+    }
+
+    // keep partial hint
+    self->hint_length = e - b;
+    memmove(self->hint, b, self->hint_length);
+    return;
+
+    // stop listening
+    stop:
+    ev_io_stop(loop, watcher);
 }
 
 /*
@@ -152,6 +476,23 @@ static void _jump_cb(struct ev_loop* loop, ev_timer* watcher, int events) {
     // initialize
     stream_t* self = (stream_t*)(((char*)watcher) - offsetof(stream_t, jump_w));
 
+    // parked (resume once the queue drains, give up on timeout)
+    if (self->silent_parked) {
+        ev_tstamp now = ev_now(loop);
+        _stream_drain(self, now);
+        if (self->silent_stalls) {
+            if (self->last_send + STREAM_THROTTLE_TIMEOUT < now) {
+                stream_destroy(self);
+                FREE(self);
+            } else {
+                ev_timer_set(&self->jump_w, self->period, 0);
+                ev_timer_start(loop, &self->jump_w);
+            }
+            return;
+        }
+        self->silent_parked = 0;
+    }
+
     // advance
     _stream_advance(self);
 }
@@ -169,6 +510,50 @@ static void _send_cb(struct ev_loop* loop, ev_io* watcher, int events) {
     ev_tstamp now = ev_now(loop);
     self->last_send = now;
 
+    // compile next fragment headers
+    if (self->fragment && !self->head_count && !self->head &&
+        self->file_offset == self->fragment_finish && self->file_offset < self->file_finish) {
+        if (self->fragment(self, 0)) {
+            goto finish;
+        }
+    }
+
+    // send headers (vectors)
+    if (self->head_count) {
+
+        // push data
+        result = writev(self->socket, self->head_iovs + self->head_index,
+                        MIN(self->head_count - self->head_index, _IOV_MAX));
+        if (result == -1) {
+            result = 0;
+            if (errno != EAGAIN && errno != EINTR) {
+                goto finish;
+            }
+        }
+
+        // advance/retry
+        self->head_offset += result;
+        self->data_sent += result;
+        (*self->data_total) += result;
+        while (self->head_index < self->head_count) {
+            struct iovec* v = &self->head_iovs[self->head_index];
+            if ((size_t)result < v->iov_len) {
+                v->iov_base = (char*)v->iov_base + result;
+                v->iov_len -= result;
+                break;
+            }
+            result -= v->iov_len;
+            self->head_index++;
+        }
+        if (self->head_index < self->head_count) {
+            return;
+        }
+
+        // complete
+        self->head_offset = self->head_length = 0;
+        _stream_head_release(self);
+    }
+
     // send headers
     if (self->head) {
 
@@ -188,6 +573,7 @@ static void _send_cb(struct ev_loop* loop, ev_io* watcher, int events) {
 
         // advance/retry
         self->head_offset += result;
+        self->data_sent += result;
         (*self->data_total) += result;
         if (self->head_offset < self->head_length) {
             return;
@@ -206,18 +592,36 @@ static void _send_cb(struct ev_loop* loop, ev_io* watcher, int events) {
     if (self->throttle) {
 
         // measure
-        ev_tstamp play_head = now - self->tzero;
+        ev_tstamp play_head = _stream_play_head(self, now);
         self->load_head = self->start + play_head + self->throttle;
         off_t target = (off_t)ceil(self->load_head / self->period);
-        if (target >= self->periods) {
+        if (_stream_extend(self, target) || target >= self->periods) {
             self->file_target = self->file_finish;
+            if (self->pacing_rate && !_setpacing(self->socket, 0)) {
+                self->pacing_rate = 0;
+            }
         } else {
             self->file_target = self->offsets[target];
+            if (self->throttle_max && !self->nagle) {
+                _stream_adapt(self, now, play_head, target);
+            }
+            if (self->pacing && !self->nagle) {
+                _stream_pace(self, now, target);
+            }
         }
     } else {
         self->file_target = self->file_finish;
     }
 
+    // park silent streams instead of topping up their queues (once a period)
+    if (self->throttle && !self->nagle && now - self->silent_sampled >= self->period) {
+        _stream_drain(self, now);
+        if (self->silent_stalls >= STREAM_SILENT_SAMPLES) {
+            _stream_park(self);
+            return;
+        }
+    }
+
     // cumulate load delay
     double  dd = 0;
     double* ds = self->delay_sum;
@@ -239,12 +643,18 @@ static void _send_cb(struct ev_loop* loop, ev_io* watcher, int events) {
     (*dc)++;
     (*da) = (*ds) / (*dc);
 
-    // push file data
+    // limit to current fragment
+    off_t limit = self->file_target;
+    if (self->fragment && limit > self->fragment_finish) {
+        limit = self->fragment_finish;
+    }
+
+    // push file data (the target may lie in data skipped by a fragment)
     result = 0;
-    if (self->file_target - self->file_offset) {
+    if (limit > self->file_offset) {
         result = _sendfile(self->socket, self->file,
                            self->file_offset,
-                           self->file_target - self->file_offset);
+                           limit - self->file_offset);
         if (result == -1) {
             result = 0;
             if (errno != EAGAIN && errno != EINTR) {
@@ -255,8 +665,9 @@ static void _send_cb(struct ev_loop* loop, ev_io* watcher, int events) {
 
     // advance/retry
     self->file_offset += result;
+    self->data_sent += result;
     (*self->data_total) += result;
-    if (self->file_offset < self->file_target) {
+    if (self->file_offset < limit) {
         return;
     }
 
@@ -265,6 +676,11 @@ static void _send_cb(struct ev_loop* loop, ev_io* watcher, int events) {
         goto finish;
     }
 
+    // fragment complete (next one is sent as soon as the socket allows)
+    if (self->file_offset < self->file_target) {
+        return;
+    }
+
     // pop cork on first full target
     if (self->nagle) {
         self->nagle = 0;
@@ -320,6 +736,9 @@ static void _stream_error(stream_t* self, const char* code) {
     self->file_offset = self->file_target = self->file_finish = 0;
 
     // headers
+    _stream_head_release(self);
+    FREE(self->head);
+    self->head_offset = 0;
     self->head = FORMAT("HTTP/%s %s\n",
                         self->http, code, ID_NAME, ID_VERSION);
     self->head_length = strlen(self->head);
@@ -329,47 +748,52 @@ static void _stream_error(stream_t* self, const char* code) {
     _stream_advance(self);
 }
 
-/*----------------------------------------------------------------------------------------------------------*/
+/*
+ * Tell whether the metadata of the (opened) stream's file was already
+ * published in the cache under its current identity (see _stream_publish).
+ */
+static int _stream_known(stream_t* self) {
+    int   size = 0;
+    char* path = FORMAT("path:%s", self->path);
+    char* root = stream_cache_key(self, "");
+    char* data = (char*)cache_get(self->db, path, strlen(path), &size);
+    int   known = data && size == strlen(root) && !memcmp(data, root, size);
+    FREE(path);
+    FREE(root);
+    FREE(data);
+    return known;
+}
 
 /*
- * Constructor (arguments must be prepared in self). If successful,
- * this function will entirely take over the created stream. In case
- * of failure (only) the caller must call stream_destroy() and FREE()
- * on the stream opbject to ensure proper clean-up.
+ * Map the (parsed) stream's path to its identity, once all the metadata of
+ * the file is stored: streams opening it from then on skip the flight (see
+ * stream_join), and all its entries can be dropped as soon as the file is
+ * changed on disk (see notify.h).
  */
-int stream_new(stream_t* self) {
+static void _stream_publish(stream_t* self) {
+    if (!self->db || _stream_known(self)) return;
+    char* path = FORMAT("path:%s", self->path);
+    char* root = stream_cache_key(self, "");
+    cache_put(self->db, path, strlen(path), root, strlen(root));
+    FREE(path);
+    FREE(root);
+}
 
-    // increase load
-    (*self->load)++;
+/*
+ * Start the transfer of a loaded stream (see stream_load()), or report its
+ * failure to the client.
+ */
+static void _stream_start(stream_t* self) {
 
-    // initialize watchers
-    ev_io_init(&self->hint_w, _hint_cb, self->socket, EV_READ);
-    ev_io_init(&self->send_w, _send_cb, self->socket, EV_WRITE);
-    ev_init(&self->jump_w, _jump_cb);
-    ev_init(&self->wait_w, _wait_cb);
+    // loaded
+    ev_async_stop(self->loop, &self->wake_w);
+    if (self->parse_failed) goto error;
 
-    // choose parser
-    stream_f parse = NULL;
-    if (!strcmp(self->mime, STREAM_MP4_MIME)) {
-        parse = stream_mp4_parse;
-    } else if (!strcmp(self->mime, STREAM_FLV_MIME)) {
-        parse = stream_flv_parse;
-    } else {
-        parse = _stream_any_parse;
-        self->throttle = 0;
+    // schedule indexing
+    if (self->index_stale && self->indexer) {
+        indexer_enqueue(self->indexer, self->path, self->mime);
     }
 
-    // initialize
-    self->file = open(self->path, O_RDONLY);
-    if (self->file < 0) goto error;
-
-    // get length
-    self->file_length = lseek(self->file, 0, SEEK_END);
-    if (self->file_length < 0) goto error;
-
-    // parse
-    if (parse(self)) goto error;
-
     // push cork
     self->nagle = 1;
     _setcork(self->socket, self->nagle);
@@ -379,19 +803,86 @@ int stream_new(stream_t* self) {
         self->throttle = 0;
     }
 
+    // listen to player hints (throttling follows the reported play-head)
+    if (self->throttle) {
+        self->hint = (char*)ALLOC(STREAM_HINT_SIZE);
+        ev_io_start(self->loop, &self->hint_w);
+    }
+
     // trigger transfer
     self->last_send = self->tzero = ev_now(self->loop);
     _stream_advance(self);
-
-    // success
-    goto done;
+    return;
 
     // error
     error:
     _stream_error(self, "500 Internal Server Error");
+}
 
-    // done
-    done:
+/*
+ * Load the stream, off the loop when a parser pool is available (the
+ * transfer is then started by _wake_cb), or right away.
+ */
+static void _stream_load(stream_t* self) {
+
+    // hand over
+    if (self->parser && !parser_enqueue(self->parser, self)) {
+        return;
+    }
+
+    // parse here (unless parked)
+    if (!stream_join(self)) {
+        stream_load(self);
+        _stream_start(self);
+    }
+}
+
+/*
+ * Resume a stream parked behind the parse of the same file (which is in
+ * the cache by now), or start one parsed by the parser pool.
+ */
+static void _wake_cb(struct ev_loop* loop, ev_async* watcher, int events) {
+
+    // initialize
+    stream_t* self = (stream_t*)(((char*)watcher) - offsetof(stream_t, wake_w));
+
+    // unpark
+    if (self->flight_key) {
+        flight_leave(self->flight, self);
+        _stream_load(self);
+        return;
+    }
+
+    // parsed
+    _stream_start(self);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor (arguments must be prepared in self). If successful,
+ * this function will entirely take over the created stream. In case
+ * of failure (only) the caller must call stream_destroy() and FREE()
+ * on the stream opbject to ensure proper clean-up.
+ */
+int stream_new(stream_t* self) {
+
+    // increase load
+    (*self->load)++;
+    self->throttle_nominal = self->throttle;
+
+    // initialize watchers
+    ev_io_init(&self->hint_w, _hint_cb, self->socket, EV_READ);
+    ev_io_init(&self->send_w, _send_cb, self->socket, EV_WRITE);
+    ev_init(&self->jump_w, _jump_cb);
+    ev_init(&self->wait_w, _wait_cb);
+    ev_async_init(&self->wake_w, _wake_cb);
+
+    // await hand-overs (parser pool, parse in flight)
+    ev_async_start(self->loop, &self->wake_w);
+
+    // load
+    _stream_load(self);
     return 0;
 }
 
@@ -401,17 +892,63 @@ int stream_new(stream_t* self) {
 int stream_destroy(stream_t* self) {
 
     // decrease load
-    (*self->load)--;
+    if (self->load) {
+        (*self->load)--;
+    }
+
+    // account data the configured run-ahead would have sent by now
+    if (self->throttle && self->throttle_max && self->data_saved && self->loop) {
+        ev_tstamp play_head = _stream_play_head(self, ev_now(self->loop));
+        off_t target = (off_t)ceil((self->start + play_head + self->throttle_nominal) / self->period);
+        if (target < self->periods && (!self->extend || target < self->offsets_ready)) {
+            (*self->data_saved) += (double)(MIN(self->offsets[target], self->file_finish) - self->file_offset);
+        }
+    }
+
+    // account data sent past the play-head of an unfinished stream (viewer gone)
+    if (self->throttle && self->loop && self->file_offset < self->file_finish) {
+        ev_tstamp play_head = _stream_play_head(self, ev_now(self->loop));
+        off_t from = (off_t)floor((self->start + play_head) / self->period);
+        if (from >= 0 && from < self->periods && (!self->extend || from < self->offsets_ready) &&
+            self->offsets[from] < self->file_offset) {
+            double wasted = (double)(self->file_offset - self->offsets[from]);
+            if (self->data_wasted) {
+                (*self->data_wasted) += wasted;
+            }
+            if (self->wasted && self->host) {
+                tcadbadddouble(self->wasted, self->host, strlen(self->host), wasted);
+            }
+        }
+    }
+
+    // account retransmissions (paced vs. bursty sending)
+    if (self->socket && self->resent_sum && self->data_sent) {
+        double resent;
+        if (!_getresent(self->socket, &resent)) {
+            (*self->resent_sum) += resent;
+            (*self->resent_count) += (double)self->data_sent;
+        }
+    }
 
     // pop cork
     self->nagle = 0;
-    _setcork(self->socket, self->nagle);
+    if (self->socket) {
+        _setcork(self->socket, self->nagle);
+    }
 
     // stop watchers
-    ev_io_stop(self->loop, &self->hint_w);
-    ev_io_stop(self->loop, &self->send_w);
-    ev_timer_stop(self->loop, &self->jump_w);
-    ev_timer_stop(self->loop, &self->wait_w);
+    if (self->loop) {
+        ev_io_stop(self->loop, &self->hint_w);
+        ev_io_stop(self->loop, &self->send_w);
+        ev_timer_stop(self->loop, &self->jump_w);
+        ev_timer_stop(self->loop, &self->wait_w);
+        ev_async_stop(self->loop, &self->wake_w);
+    }
+
+    // leave flight (if parked)
+    if (self->flight_key) {
+        flight_leave(self->flight, self);
+    }
 
     // close socket
     if (self->socket) {
@@ -423,14 +960,254 @@ int stream_destroy(stream_t* self) {
         close(self->file);
     }
 
+    // unmap sidecar
+    index_close(self);
+
     // purge members
     FREE(self->path);
     FREE(self->mime);
+    FREE(self->host);
+    FREE(self->query);
     FREE(self->hint);
     FREE(self->head);
+    _stream_head_release(self);
+    if (self->fragment) {
+        self->fragment(self, 1);
+    }
+    if (self->extend) {
+        self->extend(self, 1);
+    }
     FREE(self->offsets);
     ZERO(self, sizeof(stream_t));
 
     // done
     return 0;
 }
+
+/*
+ * Create a stream without a client, used to parse files in the background
+ * (the caller still provides the context: db, index). Both statistic
+ * counters point to the given one. Release using stream_destroy() and FREE().
+ */
+stream_t* stream_detached(const char* path, const char* mime, double period, size_t* counter) {
+    stream_t* self = (stream_t*)ZALLOC(sizeof(stream_t));
+    strcpy(self->http, "1.1");
+    self->path = STRDUP(path);
+    self->mime = STRDUP(mime);
+    self->period = period;
+    self->cache_hits = counter;
+    self->cache_misses = counter;
+    return self;
+}
+
+/*
+ * Tell whether the parser may compute the stream's offsets table lazily
+ * (see stream_extend_f): only for throttled transfers, and only when the
+ * complete table can be computed off the loop and cached meanwhile (see
+ * stream_complete).
+ */
+int stream_lazy(stream_t* self) {
+    return self->socket && self->throttle > 0 && self->parser && self->db;
+}
+
+/*
+ * Hand the complete offsets table of a lazily served stream over to the
+ * parser pool: a detached copy of the stream (having no client, its table
+ * is computed at once) is parsed there, storing the table in the cache.
+ */
+void stream_complete(stream_t* self) {
+    stream_t* copy = stream_detached(self->path, self->mime, self->period, NULL);
+    copy->tracks = self->tracks;
+    copy->db = self->db;
+    if (parser_enqueue(self->parser, copy)) {
+        stream_destroy(copy);
+        FREE(copy);
+    }
+}
+
+/*
+ * Open the stream's file and establish its identity (size, inode etc.).
+ * Returns 0 on success and 1 on error.
+ */
+int stream_open(stream_t* self) {
+
+    // open
+    self->file = open(self->path, O_RDONLY);
+    if (self->file < 0) return 1;
+
+    // identify
+    struct stat info;
+    if (fstat(self->file, &info)) return 1;
+    self->file_length = info.st_size;
+    self->file_device = info.st_dev;
+    self->file_inode = info.st_ino;
+    self->file_mtime = info.st_mtime;
+
+    // success
+    return 0;
+}
+
+/*
+ * Parse the (opened) stream's file with the parser matching its mime,
+ * without performing any network i/o. Returns 0 on success, 1 on error.
+ */
+int stream_parse(stream_t* self) {
+
+    // choose parser
+    stream_f parse = NULL;
+    if (!strcmp(self->mime, STREAM_MP4_MIME)) {
+        parse = stream_mp4_parse;
+    } else if (!strcmp(self->mime, STREAM_FLV_MIME)) {
+        parse = stream_flv_parse;
+    } else {
+        parse = _stream_any_parse;
+        self->throttle = 0;
+    }
+
+    // parse
+    if (parse(self)) return 1;
+
+    // publish
+    if (parse != _stream_any_parse) {
+        _stream_publish(self);
+    }
+    return 0;
+}
+
+/*
+ * Open the stream's file and join the parse in flight of the same file, if
+ * any (see flight.h). Performs no socket i/o, so it may run off the loop.
+ * Returns 1 if the stream was parked (it must not be touched anymore until
+ * its wake_w watcher is signalled) and 0 if it must be loaded right away.
+ */
+int stream_join(stream_t* self) {
+
+    // once
+    if (self->parse_joined) return 0;
+    self->parse_joined = 1;
+
+    // open
+    if (stream_open(self)) {
+        self->parse_failed = 1;
+        return 0;
+    }
+
+    // park behind a parse of the same file in progress elsewhere
+    return self->flight && self->db && !_stream_known(self) && flight_join(self->flight, self);
+}
+
+/*
+ * Parse the joined stream and publish the result to the streams parked
+ * behind it (if leading). Performs no socket i/o, so it may run off the
+ * loop. The outcome is kept in parse_failed.
+ */
+void stream_load(stream_t* self) {
+
+    // parse
+    if (!self->parse_failed) {
+        self->parse_failed = stream_parse(self);
+    }
+
+    // publish
+    if (self->flight_key) {
+        flight_leave(self->flight, self);
+    }
+}
+
+/*
+ * Append a vector to the headers sent before the file data.
+ */
+void stream_head_add(stream_t* self, const void* base, size_t size) {
+    if (!size) return;
+    if (!(self->head_count % 16)) {
+        self->head_iovs = (struct iovec*)REALLOC(self->head_iovs, sizeof(struct iovec) * (self->head_count + 16));
+    }
+    self->head_iovs[self->head_count].iov_base = (void*)base;
+    self->head_iovs[self->head_count].iov_len = size;
+    self->head_count++;
+    self->head_length += size;
+}
+
+/*
+ * Hand over a buffer referenced by the headers vectors to the stream.
+ */
+void stream_head_keep(stream_t* self, void* block) {
+    if (!block) return;
+    if (!(self->head_blocks_count % 4)) {
+        self->head_blocks = (void**)REALLOC(self->head_blocks, sizeof(void*) * (self->head_blocks_count + 4));
+    }
+    self->head_blocks[self->head_blocks_count++] = block;
+}
+
+/*
+ * Build the cache key of a named metadata blob of this stream's file. Keys
+ * are made of the file identity (device, inode, size and modification time)
+ * so a file replaced or modified in place never matches stale entries. The
+ * returned string must be released using FREE().
+ */
+char* stream_cache_key(stream_t* self, const char* name) {
+    return FORMAT("%llx:%llx:%llx:%llx:%s",
+                  (unsigned long long)self->file_device,
+                  (unsigned long long)self->file_inode,
+                  (unsigned long long)self->file_length,
+                  (unsigned long long)self->file_mtime,
+                  name);
+}
+
+/*
+ * Fetch a named metadata blob of this stream's file from the cache, or
+ * from the file's sidecar if not cached (in which case it is promoted to
+ * the cache). The returned buffer must be released using FREE().
+ */
+void* stream_cache_get(stream_t* self, const char* name, int* size) {
+
+    // key
+    char* key  = stream_cache_key(self, name);
+    void* data = NULL;
+    *size = 0;
+
+    // cache
+    if (self->db) {
+        data = cache_get(self->db, key, strlen(key), size);
+    }
+
+    // sidecar (checked once, even on hits, so warm files get indexed too)
+    if (self->index && !self->index_map && !self->index_stale) {
+        self->index_stale = index_open(self);
+    }
+
+    // extract
+    if (!data && self->index_map) {
+        const void* blob = index_find(self, name, size);
+        if (blob) {
+            data = ALLOC(*size + 1);
+            memcpy(data, blob, *size);
+            stream_cache_put(self, name, data, *size);
+        }
+    }
+
+    // ready
+    FREE(key);
+    return data;
+}
+
+/*
+ * Store a named metadata blob of this stream's file in the cache. The file
+ * is only known once stream_parse() maps its path (see _stream_publish).
+ */
+void stream_cache_put(stream_t* self, const char* name, const void* data, int size) {
+    struct iovec vector = { (void*)data, size };
+    stream_cache_putv(self, name, &vector, 1);
+}
+
+void stream_cache_putv(stream_t* self, const char* name, const struct iovec* data, int count) {
+
+    // check
+    if (!self->db) return;
+
+    // store
+    char* key = stream_cache_key(self, name);
+    cache_putv(self->db, key, strlen(key), data, count);
+    FREE(key);
+
+}
@@ -16,8 +16,10 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <stddef.h>
+#include <sys/uio.h>
 #include <tcadb.h>
 
+#include "cache.h"
 #include "core.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -27,9 +29,61 @@
  */
 #define STREAM_THROTTLE_FROM    1048576 // minimum length to throttle (1 MegaByte)
 #define STREAM_THROTTLE_TIMEOUT 60.0    // send-timeout while playing (60 seconds)
+#define STREAM_OFFSETS_CHUNK    300     // periods of offsets computed at once by lazy parsers
+#define STREAM_HINT_SIZE        64      // hint input buffer size (longest hint accepted)
+#define STREAM_SILENT_SAMPLES   3       // samples in a row without draining that park a stream
+#define STREAM_PACING_WINDOW    4       // periods ahead of the target the pacing rate is computed over
+#define STREAM_PACING_HEADROOM  1.25    // pacing rate over the rate strictly needed
+
+/*
+ * Player hints, read from the client socket while throttling. Each hint is
+ * an AMF0 string (the command) followed by an AMF0 number (the play-head, in
+ * seconds since the start of the transfer, i.e. on the player's own clock).
+ */
+#define STREAM_HINT_PLAY        "play"  // playing from the given position
+#define STREAM_HINT_PAUSE       "pause" // paused at the given position
+#define STREAM_HINT_SEEK        "seek"  // moved to the given position (still playing or paused)
+
+/*
+ * Output formats (parsers fall back to the plain format when not supported).
+ */
+#define STREAM_FORMAT_PLAIN     0       // progressive file (as stored)
+#define STREAM_FORMAT_FMP4      1       // fragmented MP4 (init segment, then moof/mdat fragments)
+#define STREAM_FORMAT_HLS       2       // HLS playlist of fragmented MP4 segments
+#define STREAM_FORMAT_DASH      3       // DASH manifest of fragmented MP4 segments
+#define STREAM_FORMAT_SEGMENT   4       // single fragmented MP4 segment (see segment)
+
+/*
+ * Track selections (parsers send all tracks when not supported).
+ */
+#define STREAM_TRACKS_ALL       0       // all tracks
+#define STREAM_TRACKS_VIDEO     1       // video track only
+#define STREAM_TRACKS_AUDIO     2       // audio track only
 
 /*----------------------------------------------------------------------------------------------------------*/
 
+/*
+ * Fragment compiler (called with release = 0 whenever the current fragment,
+ * i.e. file_offset up to fragment_finish, has been sent and the file is not
+ * finished yet; it must add the headers of the next fragment using
+ * stream_head_add() and move fragment_finish forward, returning 0 on success
+ * or 1 to end the stream; file_offset may also be moved forward to skip file
+ * data; with release = 1 it must only free its state).
+ */
+struct stream_t;
+typedef int (*stream_fragment_f)(struct stream_t* self, int release);
+
+/*
+ * Offsets extender of lazily computed offsets tables (called with release = 0
+ * whenever throttling needs an offset within a chunk of offsets_ready; it must
+ * adopt the complete table if cached meanwhile, see stream_complete(), or else
+ * compute one more chunk of offsets, moving offsets_ready forward, returning
+ * 0 on success or 1 on failure; once the table is complete it must store it
+ * (unless adopted), release its state and clear the extend field; with
+ * release = 1 it must only free its state).
+ */
+typedef int (*stream_extend_f)(struct stream_t* self, int release);
+
 /*
  * Stream object.
  */
@@ -40,48 +94,111 @@ typedef struct stream_t {
     char                http[8];        // HTTP protocol version
     double              period;         // throttling period (in seconds)
     double              throttle;       // run-ahead buffer (in seconds)
+    double              throttle_min;   // adaptive run-ahead lower bound (0 = fixed run-ahead)
+    double              throttle_max;   // adaptive run-ahead upper bound
+    int                 pacing;         // kernel-side pacing of throttled sends (SO_MAX_PACING_RATE)
 
     size_t*             load;           // external
     size_t*             cache_hits;     // external
     size_t*             cache_misses;   // external
+    size_t*             parse_faults;   // external (optional)
     size_t*             data_total;     // external
     double*             delay_sum;      // external
     double*             delay_count;    // external
     double*             delay_average;  // external
+    double*             data_saved;     // external (optional)
+    double*             data_wasted;    // external (optional)
+    double*             resent_sum;     // external (optional)
+    double*             resent_count;   // external (optional)
+    TCADB*              wasted;         // data wasted by host (external, optional)
 
     char*               path;           // file path on disk
     char*               mime;           // file mime-type
+    char*               host;           // virtual host (accounting, optional)
+    char*               query;          // query arguments carried over to segment URLs (optional)
     int                 spatial;        // bytes if true, else seconds
+    int                 format;         // output format (STREAM_FORMAT_*)
+    int                 segment;        // segment number (-1 for the init segment)
+    int                 tracks;         // track selection (STREAM_TRACKS_*)
+    int                 trick;          // trick-play: every Nth keyframe only (0 = off)
     double              start;          // start position (in units)        <-- turned to seconds by parser
     double              stop;           // stop position (in units)         <-- turned to seconds by parser
 
-    TCADB*              db;             // cache database
+    cache_t*            db;             // cache database
     struct ev_loop*     loop;           // event loop
-    lua_State*          lua;            // utility Lua state
+
+    char*               index;          // sidecar files folder (external)
+    struct indexer_t*   indexer;        // background indexer (external)
+    struct flight_t*    flight;         // parses in flight (external, optional)
+    struct parser_t*    parser;         // parser pool (external, optional)
 
     // internals
     ev_tstamp           load_head;      // previous load-head (statistics)
+    double              throttle_nominal; // configured run-ahead (statistics)
+    ev_tstamp           throttle_sampled; // last run-ahead adaptation
+    double              pacing_rate;    // kernel pacing rate (bytes/second, 0 = unlimited)
+    ev_tstamp           pacing_sampled; // last pacing rate update
     size_t              periods;        // number of offsets (periods)      <-- set by parser
     off_t*              offsets;        // file offsets for each period     <-- set by parser
+    size_t              offsets_ready;  // offsets computed so far (lazy)   <-- set by parser
+    stream_extend_f     extend;         // offsets extender (if lazy)       <-- set by parser
+    void*               extend_state;   // offsets extender state (owned by the extender)
 
     // headers i/o
     char*               head;           // headers data buffer              <-- set by parser
     off_t               head_length;    // size of headers data buffer      <-- set by parser
     off_t               head_offset;    // position within headers data     <-- set by parser
+    struct iovec*       head_iovs;      // headers vectors (instead of head) <-- set by parser
+    int                 head_count;     // number of headers vectors
+    int                 head_index;     // first vector not entirely sent
+    void**              head_blocks;    // buffers referenced by the vectors (owned)
+    int                 head_blocks_count; // number of owned buffers
+
+    // fragments i/o (file data is sent in fragments, each preceded by its own headers)
+    stream_fragment_f   fragment;       // fragment compiler (if any)       <-- set by parser
+    void*               fragment_state; // fragment compiler state (owned by the compiler)
+    off_t               fragment_finish;// end of current fragment in file  <-- set by compiler
 
     // file-data i/o
     int                 file;           // file descriptor
-    size_t              file_length;    // file size in bytes
+    off_t               file_length;    // file size in bytes
     off_t               file_finish;    // final send target position       <-- set by parser
     off_t               file_offset;    // position within file             <-- set by parser
     off_t               file_target;    // send target position in file
+    uint64_t            file_device;    // file identity: device
+    uint64_t            file_inode;     // file identity: inode
+    uint64_t            file_mtime;     // file identity: modification time
+
+    // sidecar i/o
+    void*               index_map;      // mapped sidecar (if any)
+    size_t              index_size;     // size of mapped sidecar
+    int                 index_stale;    // sidecar missing or outdated
+
+    // loading (single-flight, off-loop)
+    int                 parse_joined;   // opened and joined the flight (see stream_join)
+    int                 parse_failed;   // outcome of loading (see stream_load)
+    char*               flight_key;     // file identity while leading or parked
+    struct stream_t*    flight_next;    // next stream parked behind the same leader
+    ev_async            wake_w;         // hand-over watcher (parked or parsed off-loop)
 
     // adjustments
     int                 nagle;          // 0 = off, 1 = on
     ev_tstamp           tzero;          // timestamp of play-start
 
+    // abandonment (silent viewers)
+    off_t               data_sent;      // bytes written so far (headers included)
+    off_t               silent_sent;    // bytes written at the previous sample
+    size_t              silent_queued;  // bytes in the send queue at the previous sample
+    int                 silent_stalls;  // samples in a row without draining
+    int                 silent_parked;  // parked until the queue drains (see _jump_cb)
+    ev_tstamp           silent_sampled; // last send queue sample
+
     // AMF hints i/o
     char*               hint;           // hint input buffer
+    int                 hint_length;    // bytes in hint input buffer
+    int                 hint_paused;    // player reported a pause
+    double              hint_head;      // play-head last reported (in seconds)
+    ev_tstamp           hint_time;      // timestamp of last report (0 = none yet)
 
     // i/o watchers
     ev_io               hint_w;         // read-hint watcher
@@ -90,21 +207,32 @@ typedef struct stream_t {
     ev_timer            jump_w;         // future-scheduling watcher
     ev_tstamp           last_send;      // timestamp of last send
 
-    CACHE_ALIGNMENT(    sizeof(int) * 4 +
-                        sizeof(double) * 4 +
-                        sizeof(double*) * 3 +
-                        sizeof(off_t) * 5 +
+    CACHE_ALIGNMENT(    sizeof(int) * 19 +
+                        sizeof(struct iovec*) +
+                        sizeof(void**) +
+                        sizeof(double) * 9 +
+                        sizeof(double*) * 7 +
+                        sizeof(off_t) * 9 +
                         sizeof(off_t*) +
-                        sizeof(size_t) * 2 +
-                        sizeof(size_t*) * 4+
+                        sizeof(size_t) * 4 +
+                        sizeof(size_t*) * 5 +
+                        sizeof(uint64_t) * 3 +
+                        sizeof(void*) * 3 +
+                        sizeof(stream_fragment_f) +
+                        sizeof(stream_extend_f) +
                         sizeof(ev_io) * 2 +
                         sizeof(ev_timer) * 2 +
-                        sizeof(ev_tstamp) * 3 +
+                        sizeof(ev_tstamp) * 7 +
                         sizeof(char) * 8 +
-                        sizeof(char*) * 4 +
+                        sizeof(char*) * 8 +
+                        sizeof(struct indexer_t*) +
+                        sizeof(struct flight_t*) +
+                        sizeof(struct parser_t*) +
+                        sizeof(struct stream_t*) +
+                        sizeof(ev_async) +
+                        sizeof(cache_t*) +
                         sizeof(TCADB*) +
-                        sizeof(struct ev_loop*) +
-                        sizeof(lua_State*));
+                        sizeof(struct ev_loop*));
 
 } stream_t CACHE_ALIGNED;
 
@@ -130,6 +258,79 @@ int stream_new(stream_t* self);
  */
 int stream_destroy(stream_t* self);
 
+/*
+ * Create a stream without a client, used to parse files in the background
+ * (the caller still provides the context: db, index). Both statistic
+ * counters point to the given one. Release using stream_destroy() and FREE().
+ */
+stream_t* stream_detached(const char* path, const char* mime, double period, size_t* counter);
+
+/*
+ * Tell whether the parser may compute the stream's offsets table lazily, and
+ * hand the complete table of such a stream over to the parser pool, which
+ * parses a detached copy of the stream to store it in the cache.
+ */
+int stream_lazy(stream_t* self);
+void stream_complete(stream_t* self);
+
+/*
+ * Open the stream's file and establish its identity (size, inode etc.).
+ * Returns 0 on success and 1 on error.
+ */
+int stream_open(stream_t* self);
+
+/*
+ * Parse the (opened) stream's file with the parser matching its mime,
+ * without performing any network i/o. Returns 0 on success, 1 on error.
+ */
+int stream_parse(stream_t* self);
+
+/*
+ * Open the stream's file and join the parse in flight of the same file, if
+ * any (see flight.h). Returns 1 if the stream was parked (it must not be
+ * touched until its wake_w watcher is signalled), 0 if it must be loaded.
+ */
+int stream_join(stream_t* self);
+
+/*
+ * Parse the joined stream and publish the result to the streams parked
+ * behind it (if leading). The outcome is kept in parse_failed. Neither
+ * function performs any network i/o, so both may run off the loop.
+ */
+void stream_load(stream_t* self);
+
+/*
+ * Append a vector to the headers sent before the file data (written using
+ * writev() when the parser provides vectors instead of a single buffer).
+ */
+void stream_head_add(stream_t* self, const void* base, size_t size);
+
+/*
+ * Hand over a buffer referenced by the headers vectors to the stream (it
+ * is released using FREE() once the headers are sent or with the stream).
+ */
+void stream_head_keep(stream_t* self, void* block);
+
+/*
+ * Build the cache key of a named metadata blob of this stream's file (the
+ * file identity must be known). The result must be released using FREE().
+ */
+char* stream_cache_key(stream_t* self, const char* name);
+
+/*
+ * Fetch a named metadata blob of this stream's file from the cache, or
+ * from the file's sidecar if not cached (in which case it is promoted to
+ * the cache). The returned buffer must be released using FREE().
+ */
+void* stream_cache_get(stream_t* self, const char* name, int* size);
+
+/*
+ * Store a named metadata blob of this stream's file in the cache (the
+ * vector version stores the concatenation of the given buffers).
+ */
+void stream_cache_put(stream_t* self, const char* name, const void* data, int size);
+void stream_cache_putv(stream_t* self, const char* name, const struct iovec* data, int count);
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 #endif
@@ -7,23 +7,564 @@
  * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
  */
 
+#include <fcntl.h>
+#include <math.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "loomiere.h"
+#include "seek.h"
 #include "stream_flv.h"
-#include "stream_flv_meta.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
- * Prepare worker for FLV parsing.
+ * Meaning of the AMF0 value being decoded.
  */
-int stream_flv_setup(worker_t* worker) {
-    load_stream_flv_meta_lua(worker->lua);
+#define AMF_SKIP        0                       // irrelevant (validated and skipped)
+#define AMF_ROOT        1                       // the onMetaData object
+#define AMF_DURATION    2                       // onMetaData.duration
+#define AMF_KEYFRAMES   3                       // onMetaData.keyframes
+#define AMF_TIMES       4                       // onMetaData.keyframes.times
+#define AMF_SPOTS       5                       // onMetaData.keyframes.filepositions
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Consume size bytes from the buffer (NULL if truncated).
+ */
+static const uint8_t* amf_take(amf_t* amf, size_t size) {
+    const uint8_t* data = amf->data;
+    if ((size_t)(amf->end - data) < size) {
+        return NULL;
+    }
+    amf->data += size;
+    return data;
+}
+
+/*
+ * Read a big-endian double.
+ */
+static double amf_double(const uint8_t* b) {
+    union { uint64_t u; double d; } value;
+    value.u = read_64(b);
+    return value.d;
+}
+
+/*
+ * Decode a strict array of numbers (into a freshly allocated table).
+ */
+static int amf_numbers(amf_t* amf, double** table, uint32_t* count) {
+    const uint8_t* b = amf_take(amf, 4);
+    if (!b) {
+        return 1;
+    }
+
+    // each item takes at least 9 bytes
+    uint32_t i, n = read_32(b);
+    if (n > (amf->end - amf->data) / 9) {
+        return 1;
+    }
+
+    // decode
+    FREE(*table);
+    *table = (double*)ALLOC(MAX(n, 1) * sizeof(double));
+    *count = n;
+    for (i = 0; i < n; i++) {
+        if (!(b = amf_take(amf, 9)) || b[0] != AMF0_NUMBER) {
+            return 1;
+        }
+        (*table)[i] = amf_double(b + 1);
+    }
+    return 0;
+}
+
+static int amf_value(amf_t* amf, flv_meta_t* meta, int context, int depth);
+
+/*
+ * Decode object properties up to (and including) the object-end marker. A
+ * buffer ending right before a property name is accepted as a terminator,
+ * since many muxers truncate onMetaData this way.
+ */
+static int amf_properties(amf_t* amf, flv_meta_t* meta, int context, int depth) {
+    const uint8_t* b;
+    while (amf->data < amf->end) {
+
+        // name
+        if (!(b = amf_take(amf, 2))) {
+            return 1;
+        }
+        uint16_t size = read_16(b);
+        const uint8_t* name = amf_take(amf, size);
+        if (!name) {
+            return 1;
+        }
+
+        // terminator
+        if (!size && amf->data < amf->end && *amf->data == AMF0_OBJECT_END) {
+            amf->data++;
+            return 0;
+        }
+
+        // relevance
+        int inner = AMF_SKIP;
+        if (context == AMF_ROOT) {
+            if (size == 8 && !memcmp(name, "duration", 8)) {
+                inner = AMF_DURATION;
+            } else if (size == 9 && !memcmp(name, "keyframes", 9)) {
+                inner = AMF_KEYFRAMES;
+            }
+        } else if (context == AMF_KEYFRAMES) {
+            if (size == 5 && !memcmp(name, "times", 5)) {
+                inner = AMF_TIMES;
+            } else if (size == 13 && !memcmp(name, "filepositions", 13)) {
+                inner = AMF_SPOTS;
+            }
+        }
+
+        // value
+        if (amf_value(amf, meta, inner, depth + 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Decode a single AMF0 value, collecting whatever is relevant in the given
+ * context and skipping everything else. Returns 0 on success and 1 otherwise.
+ */
+static int amf_value(amf_t* amf, flv_meta_t* meta, int context, int depth) {
+    const uint8_t* b = amf_take(amf, 1);
+    if (!b || depth > AMF0_DEPTH) {
+        return 1;
+    }
+
+    // dispatch
+    switch (*b) {
+        case AMF0_NUMBER:
+            if (!(b = amf_take(amf, 8))) {
+                return 1;
+            }
+            if (context == AMF_DURATION) {
+                meta->duration = amf_double(b);
+                meta->found = 1;
+            }
+            return 0;
+        case AMF0_BOOLEAN:
+            return !amf_take(amf, 1);
+        case AMF0_STRING:
+            return !(b = amf_take(amf, 2)) || !amf_take(amf, read_16(b));
+        case AMF0_LONG_STRING:
+        case AMF0_XML_DOCUMENT:
+            return !(b = amf_take(amf, 4)) || !amf_take(amf, read_32(b));
+        case AMF0_NULL:
+        case AMF0_UNDEFINED:
+        case AMF0_UNSUPPORTED:
+            return 0;
+        case AMF0_REFERENCE:
+            return !amf_take(amf, 2);
+        case AMF0_DATE:
+            return !amf_take(amf, 10);
+        case AMF0_TYPED_OBJECT:
+            if (!(b = amf_take(amf, 2)) || !amf_take(amf, read_16(b))) {
+                return 1;
+            }
+            return amf_properties(amf, meta, context, depth);
+        case AMF0_ECMA_ARRAY:
+            if (!amf_take(amf, 4)) {
+                return 1;
+            }
+            return amf_properties(amf, meta, context, depth);
+        case AMF0_OBJECT:
+            return amf_properties(amf, meta, context, depth);
+        case AMF0_STRICT_ARRAY:
+            if (context == AMF_TIMES) {
+                return amf_numbers(amf, &meta->times, &meta->times_count);
+            }
+            if (context == AMF_SPOTS) {
+                return amf_numbers(amf, &meta->spots, &meta->spots_count);
+            }
+            if (!(b = amf_take(amf, 4))) {
+                return 1;
+            }
+            uint32_t i, n = read_32(b);
+            for (i = 0; i < n; i++) {
+                if (amf_value(amf, meta, AMF_SKIP, depth + 1)) {
+                    return 1;
+                }
+            }
+            return 0;
+    }
+
+    // unknown marker
+    return 1;
+}
+
+/*
+ * Release the keyframe tables.
+ */
+static void clear_meta(flv_meta_t* meta) {
+    FREE(meta->times);
+    FREE(meta->spots);
+    meta->times_count = meta->spots_count = 0;
+}
+
+/*
+ * Decode the onMetaData value (the data following the "onMetaData" name).
+ * Keyframe tables are only kept if complete and accompanied by a duration.
+ */
+static int decode_meta(flv_meta_t* meta, const uint8_t* data, size_t size) {
+    amf_t amf = { data, data + size };
+    if (amf_value(&amf, meta, AMF_ROOT, 0)) {
+        return 1;
+    }
+    if (!meta->found || !meta->times || !meta->spots) {
+        clear_meta(meta);
+    }
+    return 0;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Append a keyframe to the tables (growing them as needed).
+ */
+static void add_keyframe(flv_meta_t* meta, double time, double spot) {
+    if (!(meta->times_count % 1024)) {
+        meta->times = (double*)REALLOC(meta->times, (meta->times_count + 1024) * sizeof(double));
+        meta->spots = (double*)REALLOC(meta->spots, (meta->spots_count + 1024) * sizeof(double));
+    }
+    meta->times[meta->times_count++] = time;
+    meta->spots[meta->spots_count++] = spot;
+}
+
+/*
+ * Collect the keyframes of a file lacking them in its metadata by walking
+ * all its tags. The file is read sequentially in large blocks and payloads
+ * larger than a block are skipped without being read. Returns 0 on success
+ * and 1 on i/o errors (a file without any keyframe is not an error).
+ */
+static int scan_keyframes(stream_t* self, flv_meta_t* meta) {
+
+    // exit status
+    int status = 1;
+
+    // buffer
+    uint8_t* buffer = (uint8_t*)ALLOC(STREAM_FLV_SCAN_BUFFER);
+    off_t    base = 0;
+    size_t   fill = 0;
+
+    // hint sequential access
+    posix_fadvise(self->file, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // walk tags (the first one follows the file header)
+    off_t offset = 13;
+    while (offset + FLV_TAG_HEAD <= self->file_length) {
+
+        // refill (tag header and the two leading payload bytes)
+        if (offset < base || offset + FLV_TAG_HEAD + 2 > base + fill) {
+            ssize_t result = pread(self->file, buffer, STREAM_FLV_SCAN_BUFFER, offset);
+            if (result < 0) {
+                goto error;
+            }
+            base = offset;
+            fill = result;
+        }
+        size_t available = base + fill - offset;
+        if (available < FLV_TAG_HEAD) {
+            break;
+        }
+
+        // header
+        const uint8_t* tag = buffer + (offset - base);
+        uint32_t size = read_24(tag + 1);
+        uint32_t stamp = read_24(tag + 4) | ((uint32_t)tag[7] << 24);
+
+        // keyframe (AVC headers and sequence ends are not frames)
+        if ((tag[0] & 0x1F) == FLV_TAG_VIDEO && size >= 1 && available > FLV_TAG_HEAD &&
+            (tag[FLV_TAG_HEAD] >> 4) == FLV_KEYFRAME) {
+            if ((tag[FLV_TAG_HEAD] & 0x0F) != FLV_AVC ||
+                (size >= 2 && available > FLV_TAG_HEAD + 1 && tag[FLV_TAG_HEAD + 1] == FLV_AVC_NALU)) {
+                add_keyframe(meta, stamp / 1000.0, offset);
+            }
+        }
+
+        // next (skipping the trailing tag size)
+        offset += FLV_TAG_HEAD + size + 4;
+    }
+
+    // success
+    status = 0;
+
+    // error
+    error:
+    FREE(buffer);
+    return status;
+}
+
+/*
+ * Obtain the keyframes of a file lacking them in its metadata, from the
+ * cache (or sidecar) if already scanned, or by scanning the file in place.
+ * Like the rest of the parse, the scan runs in the parser pool, behind the
+ * flight of the file (see stream_join), so concurrent requests wait for a
+ * single scan instead of being served unseekable. The cached blob is the
+ * keyframes count followed by the times and positions. Returns 0 on success
+ * and 1 on error.
+ */
+static int load_keyframes(stream_t* self, flv_meta_t* meta) {
+
+    // cached
+    int       size = 0;
+    uint64_t* blob = (uint64_t*)stream_cache_get(self, "keyframes", &size);
+    if (blob) {
+        (*self->cache_hits)++;
+        if (size < sizeof(uint64_t) || size != sizeof(uint64_t) + blob[0] * 2 * sizeof(double)) {
+            FREE(blob);
+            return 1;
+        }
+        uint32_t count = blob[0];
+        if (count) {
+            meta->times = (double*)ALLOC(count * sizeof(double));
+            meta->spots = (double*)ALLOC(count * sizeof(double));
+            memcpy(meta->times, blob + 1, count * sizeof(double));
+            memcpy(meta->spots, blob + 1 + count, count * sizeof(double));
+            meta->times_count = meta->spots_count = count;
+        }
+        FREE(blob);
+        return 0;
+    }
+
+    // scan
+    if (self->db) {
+        (*self->cache_misses)++;
+    }
+    if (scan_keyframes(self, meta)) {
+        return 1;
+    }
+
+    // store
+    uint32_t count = meta->times_count;
+    size = sizeof(uint64_t) + count * 2 * sizeof(double);
+    blob = (uint64_t*)ALLOC(size);
+    blob[0] = count;
+    if (count) {
+        memcpy(blob + 1, meta->times, count * sizeof(double));
+        memcpy(blob + 1 + count, meta->spots, count * sizeof(double));
+    }
+    stream_cache_put(self, "keyframes", blob, size);
+    FREE(blob);
+    return 0;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Validate the keyframe tables and anchor them at time zero.
+ */
+static int check_meta(flv_meta_t* meta) {
+    uint32_t i;
+
+    // sanity checks
+    if (meta->times_count != meta->spots_count || meta->times_count < 1) {
+        return 1;
+    }
+    for (i = 0; i < meta->times_count; i++) {
+        if (!isfinite(meta->times[i]) || !isfinite(meta->spots[i])) {
+            return 1;
+        }
+    }
+
+    // correct start
+    if (meta->times[0] != 0) {
+        uint32_t count = meta->times_count + 1;
+        meta->times = (double*)REALLOC(meta->times, count * sizeof(double));
+        meta->spots = (double*)REALLOC(meta->spots, count * sizeof(double));
+        memmove(meta->times + 1, meta->times, meta->times_count * sizeof(double));
+        memmove(meta->spots + 1, meta->spots, meta->spots_count * sizeof(double));
+        meta->times[0] = 0;
+        meta->times_count = meta->spots_count = count;
+    }
     return 0;
 }
 
+/*
+ * Allocate the offsets table and anchor the walk at the first keyframe.
+ */
+static void start_offsets(stream_t* self, flv_walk_t* walk) {
+    flv_meta_t* meta = &walk->meta;
+
+    // table (grows if floating point drift needs more room)
+    double tend = meta->times[meta->times_count - 1];
+    walk->size = (size_t)MIN(ceil(tend / self->period), 65536.0) + 3;
+    self->offsets = (off_t*)ALLOC(walk->size * sizeof(off_t));
+    self->periods = (size_t)ceil(tend / self->period) + 3;
+
+    // initialize
+    walk->time = 0;
+    walk->here_time = walk->next_time = meta->times[0];
+    walk->here_spot = walk->next_spot = meta->spots[0];
+    walk->eof = 0;
+    self->offsets[0] = (off_t)walk->next_spot;
+    self->offsets_ready = 1;
+}
+
+/*
+ * Interpolate the byte offset of every period boundary between keyframes
+ * (the last offset is the end of the file), walking the keyframes up to the
+ * given number of offsets. The walk can be resumed later on to extend the
+ * table (lazily computed tables). Returns 1 once the table is complete, 0 if
+ * more is left and -1 if the keyframes are out of order.
+ */
+static int walk_offsets(stream_t* self, flv_walk_t* walk, size_t limit) {
+    const double* times = walk->meta.times;
+    const double* spots = walk->meta.spots;
+    uint32_t count = walk->meta.times_count;
+    double   tend = times[count - 1];
+    double   last_time, last_spot;
+
+    // walk key-points
+    while (self->offsets_ready < limit) {
+        last_time = walk->next_time;
+        last_spot = walk->next_spot;
+        walk->next_time += self->period;
+
+        // overcome
+        while (walk->here_time < walk->next_time) {
+            last_time = walk->here_time;
+            last_spot = walk->here_spot;
+
+            // next frame
+            if (++walk->time >= count) {
+                walk->eof = 1;
+                break;
+            }
+            walk->here_time = times[walk->time];
+            walk->here_spot = spots[walk->time];
+
+            // check order
+            if (walk->here_time < last_time) {
+                return -1;
+            }
+        }
+
+        // advance
+        walk->next_spot = last_spot;
+        if (walk->here_time > last_time) {
+            walk->next_spot += ((walk->next_time - last_time) * (walk->here_spot - last_spot)) /
+                               (walk->here_time - last_time);
+        }
+
+        // store (keeping room for the endpoint)
+        if (last_time < walk->next_time) {
+            if (self->offsets_ready + 1 >= walk->size) {
+                walk->size *= 2;
+                self->offsets = (off_t*)REALLOC(self->offsets, walk->size * sizeof(off_t));
+            }
+            self->offsets[self->offsets_ready++] = (off_t)floor(walk->next_spot);
+        }
+
+        // endpoint
+        if (walk->next_time >= tend || walk->eof) {
+            self->offsets[self->offsets_ready++] = self->file_length;
+            self->periods = self->offsets_ready;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Offsets extender of lazily computed tables (see stream_extend_f).
+ */
+static int compile_lazy(stream_t* self, int release) {
+    flv_walk_t* walk = (flv_walk_t*)self->extend_state;
+
+    // release
+    if (release) {
+        if (walk) {
+            clear_meta(&walk->meta);
+            FREE(walk);
+        }
+        self->extend_state = NULL;
+        return 0;
+    }
+
+    // adopt the complete table (if stored meanwhile by another stream)
+    int    complete = 0;
+    int    size = 0;
+    off_t* offsets = (off_t*)stream_cache_get(self, "offsets", &size);
+    if (offsets && size >= 2 * sizeof(off_t)) {
+        FREE(self->offsets);
+        self->offsets = offsets;
+        self->periods = self->offsets_ready = size / sizeof(off_t);
+        complete = 1;
+    } else {
+        FREE(offsets);
+
+        // next chunk
+        complete = walk_offsets(self, walk, self->offsets_ready + STREAM_OFFSETS_CHUNK);
+        if (complete < 0) {
+            return 1;
+        }
+
+        // store (complete tables only)
+        if (complete) {
+            stream_cache_put(self, "offsets", self->offsets, self->periods * sizeof(off_t));
+        }
+    }
+
+    // complete
+    if (complete) {
+        compile_lazy(self, 1);
+        self->extend = NULL;
+    }
+    return 0;
+}
+
+/*
+ * Snap the requested limits to the keyframes at or before them (in seconds,
+ * or in bytes for spatial requests) and derive the file range to send.
+ */
+static void seek_meta(stream_t* self, flv_meta_t* meta) {
+    const double* times = meta->times;
+    const double* spots = meta->spots;
+    const double* points = self->spatial ? spots : times;
+    size_t count = meta->times_count;
+
+    // data ends
+    self->file_offset = (off_t)spots[0];
+    self->file_finish = self->file_length;
+
+    // sanity checks
+    if (self->start < points[0]) {
+        self->start = 0;
+    }
+    if (self->stop > points[count - 1]) {
+        self->stop = 0;
+    }
+
+    // locate ends
+    ssize_t first, last;
+    seek_points(points, count, MAX(self->start, 0), MAX(self->stop, 0), 0, &first, &last);
+    if (first >= 0) {
+        self->file_offset = (off_t)spots[first];
+        self->start = times[first];
+    }
+    if (last >= 0) {
+        self->file_finish = (off_t)spots[last];
+        self->stop = times[last];
+    }
+
+    // sanity checks
+    if (self->file_finish < self->file_offset) {
+        self->file_finish = self->file_offset;
+        self->stop = self->start;
+    }
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
 /*
  * Parser function implementation for the FLV file format.
  */
@@ -36,16 +577,16 @@ int stream_flv_parse(stream_t* self) {
     static char onMetaData[14] = "\x02\x00\x0AonMetaData";
 
     // search cache
-    char* mkey_name = FORMAT("%s:meta", self->path);
-    int   mkey_size = strlen(mkey_name);
-    char* okey_name = FORMAT("%s:offsets", self->path);
-    int   okey_size = strlen(okey_name);
     int   meta_size = 0;
     char* meta_data = NULL;
 
+    // decoded meta
+    flv_meta_t meta;
+    ZERO(&meta, sizeof(flv_meta_t));
+
     // get offsets
-    int periods;
-    self->offsets = self->db ? tcadbget(self->db, okey_name, okey_size, &periods) : NULL;
+    int periods = 0;
+    self->offsets = stream_cache_get(self, "offsets", &periods);
     self->periods = periods / sizeof(off_t);
 
     // avoid zero-seek
@@ -61,7 +602,7 @@ int stream_flv_parse(stream_t* self) {
     } else {
 
         // get cache
-        meta_data = self->db ? tcadbget(self->db, mkey_name, mkey_size, &meta_size) : NULL;
+        meta_data = stream_cache_get(self, "meta", &meta_size);
 
         // (re)generate
         if (meta_data) {
@@ -124,67 +665,73 @@ int stream_flv_parse(stream_t* self) {
             }
 
             // store meta
-            if (self->db) {
-                tcadbput(self->db, mkey_name, mkey_size, meta_data, meta_size);
-            }
-        }
-
-        // prepare call
-        lua_getglobal(self->lua, "flv");
-        lua_getfield(self->lua, -1, "onMetaData");
-        lua_remove(self->lua, -2);
-        lua_pushlstring(self->lua, meta_data, meta_size);
-        lua_pushnumber(self->lua, self->period);
-        lua_pushnumber(self->lua, self->start);
-        lua_pushnumber(self->lua, self->stop);
-        lua_pushboolean(self->lua, self->spatial);
-        lua_pushinteger(self->lua, self->file_length);
-        FREE(meta_data);
-
-        // invoke compiler
-        if (lua_pcall(self->lua, 6, 6, 0) ||
-            lua_isnil(self->lua, -1)) {
-            lua_pop(self->lua, 1);
+            stream_cache_put(self, "meta", meta_data, meta_size);
+        }
+
+        // decode
+        if (decode_meta(&meta, (uint8_t*)meta_data, meta_size) || self->period <= 0) {
             goto error;
         }
 
-        // extract results
-        self->stop = lua_tonumber(self->lua, -1);
-        self->start = lua_tonumber(self->lua, -2);
-        self->file_finish = lua_tointeger(self->lua, -3);
-        self->file_offset = lua_tointeger(self->lua, -4);
-        self->periods = lua_tointeger(self->lua, -5);
-        lua_pop(self->lua, 5);
+        // keyframes lacking from metadata
+        if (!meta.times && load_keyframes(self, &meta)) {
+            goto error;
+        }
 
-        // safety
-        if (self->start == 0) {
+        // unseekable (no keyframes)
+        if (!meta.times_count) {
+            FREE(self->offsets);
+            self->periods = 0;
+            self->throttle = 0;
+            self->start = self->stop = 0;
             self->file_offset = 13;
-        }
-        if (self->stop == 0) {
             self->file_finish = self->file_length;
+            goto headers;
         }
 
-        // regenerate offsets
-        if (!self->offsets) {
+        // sanitize
+        if (check_meta(&meta)) {
+            goto error;
+        }
+
+        // locate ends
+        seek_meta(self, &meta);
 
-            // extract
-            int i;
-            self->offsets = (off_t*)ZALLOC(self->periods * sizeof(off_t));
-            for (i = 0; i < self->periods; i++) {
-                lua_rawgeti(self->lua, -1, i + 1);
-                self->offsets[i] = lua_tointeger(self->lua, -1);
-                lua_pop(self->lua, 1);
+        // regenerate offsets (lazily when served, the keyframes being kept until complete)
+        if (!self->offsets) {
+            flv_walk_t* walk = (flv_walk_t*)ZALLOC(sizeof(flv_walk_t));
+            walk->meta = meta;
+            start_offsets(self, walk);
+            int result = walk_offsets(self, walk, (stream_lazy(self) && self->periods > STREAM_OFFSETS_CHUNK) ?
+                                                  STREAM_OFFSETS_CHUNK : (size_t)-1);
+            if (result < 0) {
+                FREE(walk);
+                goto error;
             }
-            lua_pop(self->lua, 1);
 
             // store offsets
-            if (self->db) {
-                tcadbput(self->db, okey_name, okey_size, self->offsets, self->periods * sizeof(off_t));
+            if (result) {
+                FREE(walk);
+                stream_cache_put(self, "offsets", self->offsets, self->periods * sizeof(off_t));
+            } else {
+                self->extend = compile_lazy;
+                self->extend_state = walk;
+                ZERO(&meta, sizeof(flv_meta_t));
+                stream_complete(self);
             }
         }
+
+        // safety
+        if (self->start == 0) {
+            self->file_offset = 13;
+        }
+        if (self->stop == 0) {
+            self->file_finish = self->file_length;
+        }
     }
 
     // generate HTTP headers
+    headers:
     self->head = FORMAT("HTTP/%s 200 OK\n"
                         "Content-Type: %s\n"
                         "Content-Length: %llu\n"
@@ -209,12 +756,15 @@ int stream_flv_parse(stream_t* self) {
     error:
     self->periods = 0;
     FREE(self->offsets);
+    if (self->extend) {
+        self->extend(self, 1);
+        self->extend = NULL;
+    }
     status = 1;
 
     // done
     done:
-    FREE(mkey_name);
-    FREE(okey_name);
+    clear_meta(&meta);
     FREE(meta_data);
     return status;
 }
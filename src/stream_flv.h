@@ -12,9 +12,10 @@
 
 /*----------------------------------------------------------------------------------------------------------*/
 
+#include <stdint.h>
+
 #include "core.h"
 #include "stream.h"
-#include "worker.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
 
@@ -23,12 +24,85 @@
  */
 #define STREAM_FLV_MIME "video/x-flv"
 
+/*
+ * Read size used when scanning the tags of files lacking keyframes metadata.
+ */
+#define STREAM_FLV_SCAN_BUFFER  1048576
+
+/*
+ * FLV tag types and video tag fields.
+ */
+#define FLV_TAG_HEAD        11                  // tag header size
+#define FLV_TAG_AUDIO       0x08                // audio tag
+#define FLV_TAG_VIDEO       0x09                // video tag
+#define FLV_TAG_SCRIPT      0x12                // script data tag
+#define FLV_KEYFRAME        1                   // video frame type (upper nibble)
+#define FLV_AVC             7                   // video codec id (lower nibble)
+#define FLV_AVC_NALU        1                   // AVC packet type of actual frames
+
+/*
+ * AMF0 type markers.
+ */
+#define AMF0_NUMBER         0x00                // 64bit double
+#define AMF0_BOOLEAN        0x01                // 8bit boolean
+#define AMF0_STRING         0x02                // 16bit sized string
+#define AMF0_OBJECT         0x03                // properties (until object-end)
+#define AMF0_MOVIECLIP      0x04                // reserved
+#define AMF0_NULL           0x05                // no payload
+#define AMF0_UNDEFINED      0x06                // no payload
+#define AMF0_REFERENCE      0x07                // 16bit reference index
+#define AMF0_ECMA_ARRAY     0x08                // 32bit count + properties (until object-end)
+#define AMF0_OBJECT_END     0x09                // properties terminator
+#define AMF0_STRICT_ARRAY   0x0A                // 32bit count + values
+#define AMF0_DATE           0x0B                // 64bit double + 16bit timezone
+#define AMF0_LONG_STRING    0x0C                // 32bit sized string
+#define AMF0_UNSUPPORTED    0x0D                // no payload
+#define AMF0_XML_DOCUMENT   0x0F                // 32bit sized string
+#define AMF0_TYPED_OBJECT   0x10                // 16bit sized class name + properties
+
+/*
+ * Maximum AMF0 nesting depth accepted by the decoder.
+ */
+#define AMF0_DEPTH          32
+
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
- * Prepare worker for FLV parsing.
+ * AMF0 decoding cursor.
+ */
+typedef struct {
+    const uint8_t*      data;                   // current position
+    const uint8_t*      end;                    // end of the buffer
+} amf_t;
+
+/*
+ * The parts of onMetaData needed for streaming.
  */
-int stream_flv_setup(worker_t* worker);
+typedef struct {
+    int                 found;                  // duration was present?
+    double              duration;               // total duration (seconds)
+    double*             times;                  // keyframe times (seconds)
+    double*             spots;                  // keyframe positions (bytes)
+    uint32_t            times_count;            // number of times
+    uint32_t            spots_count;            // number of positions
+} flv_meta_t;
+
+/*
+ * Offsets walk over the keyframes, kept along with them between the chunks
+ * of lazily computed offsets tables (see stream_extend_f).
+ */
+typedef struct {
+    flv_meta_t          meta;                   // keyframe tables
+    size_t              size;                   // allocated offsets
+    uint32_t            time;                   // keyframe reached
+    double              here_time;              // time of the keyframe reached
+    double              here_spot;              // position of the keyframe reached
+    double              next_time;              // time of the last period boundary
+    double              next_spot;              // offset of the last period boundary
+    int                 eof;                    // keyframes exhausted?
+} flv_walk_t;
+
+/*----------------------------------------------------------------------------------------------------------*/
 
 /*
  * Parser function implementation for the FLV file format.
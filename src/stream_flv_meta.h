@@ -1,216 +0,0 @@
-/*
- * LUA SCRIPT "src/stream_flv_meta.lua" EMBEDDED AS A C PROCEDURE.
- *
- * C SOURCE CODE AUTO-GENERATED FROM THE LUA FILE. DON'T EDIT!
- * INCLUDE THIS HEADER FILE USING THE '#include' DIRECTIVE AND
- * THEN CALL THE DEFINED FUNCTION GIVING IT A VALID LUA STATE!
- */
-
-#ifndef __lua2c_stream_flv_meta_lua__
-#define __lua2c_stream_flv_meta_lua__
-
-#include <lua.h>
-#include <lauxlib.h>
-
-/*
- * Load the file "src/stream_flv_meta.lua" inside the given Lua state.
- * Returns zero on success and non-zero on errors.
- */
-void load_stream_flv_meta_lua(lua_State* L) {
-    static unsigned char content[2965] = {
-          2, 10,  6,193,156,250, 38, 80,137,170,211,  8, 45, 98,143,188,233,
-         22, 67,112,238,184,148, 11, 34, 10,217,189,100, 95,  0,234,213,144,
-         76, 45,  8,238,166,218, 77, 59, 26,168,213,  2, 47, 92,137,182,227,
-         16, 61,106,149,195,229, 30, 75,120,160,210,255, 44, 24,198,179,224,
-         17,186,103,149,132,238, 27, 72,244, 34,207,252,117,214,131,177, 88,
-         10, 55,100, 80,126,235, 24,217,242,159,205, 60, 38, 82,128,168,155,
-          6, 52, 36, 15,186,232,148,131,110,156,149,183, 35, 81, 25,171,215,
-          4, 49, 94,139,184,229, 18, 63,110,153,198,115, 33, 10,123,165,212,
-         31, 46,219,136,188,226, 15, 60,109,158,195,240, 29, 74,119,164,209,
-        140, 78, 41,240,219,173,105, 57, 98,151,192,237, 26, 71,116,161,206,
-        154, 69, 51,130,171,217,  9, 54, 99,144,189,234, 23, 39, 30,236,174,
-        248, 33, 87,127,172,217,  6, 51, 96,141,214,151,113, 38,110,159,205,
-        245, 34, 79,124,169,214,  3, 93, 60,254,223,228, 21, 56,107,152,197,
-        242, 31, 76,121,210,178, 98, 65, 63,135,176,230, 14, 59,104,149,194,
-        239, 28, 36, 25,199,165,145, 79, 87,128,181,222, 11, 56,101,146,191,
-        236,127, 42,  5,160,201,241, 39, 84,129,174,219,  8, 53, 13,225,241,
-        140, 98, 34, 52,252,190,150, 36, 80,126,171,216,  5, 50, 95,140,185,
-        230, 19, 64,117,154,199,244,182, 78,123,168,214,  4, 47, 70, 73,182,
-        227, 16,185,107,151,196,119, 31, 11,123,101,211,255, 44, 93,132,179,
-        224, 11,120, 39,144,202,108, 91, 76,105,160,207,253,181,215,131,176,
-         27,203,119,103, 75,191,235, 24, 83,178,158, 76, 63, 39, 18,131,107,
-        155,198, 55,187,143,187,232,  3,130,111, 28, 15,247, 98, 83,187, 43,
-         22,  7,235, 31,139,184,243, 82, 63,236, 90,199,115, 35,147,123,167,
-        213,199, 47, 26,139,115,163,206, 63,111,148,130,243, 27,200, 54,160,
-        133,252,171, 91, 17,176,223,  8, 46,230, 17,196,251, 26, 70,244,245,
-        204,123, 43, 13, 66,110,216, 31,118, 99, 16,170,234,213, 68,103,222,
-        203,120,102, 80,255,168,135,  4, 51, 97,203,120, 38, 23, 22,110, 89,
-        204,227,226, 77,252,237,212,131, 48, 27,200,117,224,145, 60,235,155,
-          4, 48, 30, 76,120,165,209,  0,113, 24,135,182,165, 12,187,104,211,
-        128, 45, 24,201,116,163,212, 60,232, 86,132,183, 29, 74, 60, 57,208,
-        191,238, 88,132,114,160, 71,120, 39, 84, 71,236, 89, 11,188,160,141,
-         57, 47, 84, 65,116, 20,  8,117,161,155,252,171,216,  3,177, 29,137,
-        112,228, 16,197,107, 89,133,241,232, 76,248, 45,193,  1,175, 95,143,
-        181, 96, 19,119,105,151,196,123, 29, 75,120,100, 17,254, 44, 95, 66,
-        113,229,132, 57,227,147,195,234, 27, 72, 51, 38, 13,249,175,146, 65,
-        181,148,137,179,225,216,253,239,157,  3,246, 93,201,181, 98,211,136,
-        100,152,  3,177, 39, 10,249,237,147,198,173,153,209,118,167, 88,107,
-        170,210,132,119,218,201,189, 99,214,125,105,208, 69,119,165,  4, 57,
-        163, 81, 77,236,154,140,243,166,141, 63, 51,210,195,240, 11, 10,119,
-         36,211,250,171, 88,147, 50,221,140,127, 34, 17,195,107, 94, 69,112,
-         40, 76,127,173,220,192,171, 89, 79,178, 33,149, 59,110,213, 66,105,
-         30, 79,240, 51, 18,133,211,154,  2,179,104,211,190,231, 21, 87,238,
-         98,183,179,230,141,122, 96,148,135,181, 27, 14,245,225,151,186,169,
-        158,221,178, 27, 69,111,230,208,128,107,158, 69,177,103,138,249,109,
-         83, 70, 45, 26,196,178,167,217, 59,238, 21,129,183, 27,201, 62,168,
-        150, 58,229,151,130,119,169, 11,126,101, 81,135, 43, 25, 14,248,102,
-         10,181,102,210, 71,121,209, 78,115, 44,152, 60, 47, 93, 67,182,157,
-        138, 63, 98,209, 69,117, 26, 67,252, 55, 14,122, 40, 25,193,238, 91,
-        205,178,227, 17,123,110, 84,204,119,218,137,125,249, 86,255, 45,208,
-        197, 55,231, 75,190,165,145,152,174, 31, 78, 99,226,207,124, 51, 82,
-        131,176,203, 10,216, 27, 93,125, 42, 31,204, 49, 30,203,191,226, 18,
-        132, 45,222,135, 54,161,138, 59,235, 15, 67,111,156,223,246, 35,208,
-        189,174,215,  0, 55,155, 74,177,253, 18, 58,109,143,198,243,160,204,
-        122,165,212, 21, 43,219,129,179,231,138, 53,113, 86,195,250, 11, 74,
-        119, 36, 16,254, 41, 88,157, 50,223,136, 47,230,145, 64,249, 31,199,
-        125,224, 11,250, 40,212,199,172,220, 41,115, 98, 16,187, 44,146, 77,
-        104, 30,203,244, 51,210,127, 44,159,194, 54,100, 11,122, 98, 23, 87,
-        110,155, 72,234, 39,177,  3,177, 22,  3,180, 75, 10,181,100,  5, 59,
-        235,145,132, 55, 30, 76,248,227,208,  0, 13, 31,134, 52,231,200,190,
-         97,140,  2,239, 16, 95,246,163, 80,123,238, 82,128,119, 30,142, 59,
-        115,146,191,108,  6, 67,141,223,213,186, 35, 93,151,238,219,136,181,
-        102, 15,180, 41, 22, 67,113,157,207,247, 35, 17,123, 43,223,133, 55,
-        223,132,121,227, 19, 73,109,156,199,245, 97, 72,251,169,203,  7,175,
-         95,151,182, 99, 16, 51,106,151,196,245, 25, 75,120,165,210,255, 44,
-         89,226,214,131, 98, 94,  2,148,197,235, 27, 72,117,162,207,252, 41,
-         55,238,214,237, 10, 51, 98,145,190,235, 24, 69,114,159,186,152, 74,
-         38,229,173,222, 14, 52, 97,142,187,232, 21, 66, 11,233,187,151, 87,
-         57, 18,196,215,  0, 59, 94,139,184,229, 18, 63,108,242,163,138, 70,
-         63, 27,202,177,114, 46, 95,142,181,226, 15, 60,105,150,195,132,116,
-         39, 18,215,209,250, 37, 88,133,178,223, 12, 57,102,245,169,129,127,
-         55, 27,210,167,143, 65, 58,236,220,220, 10, 54, 99,144,189,234, 23,
-        180, 78,157,203,248, 37, 82,127,172,217,  6, 55,103,141,186,231, 20,
-         65,110,155,161,155, 81, 42, 14,221,214,  7, 53, 93,138,183,228, 17,
-         62,107,236,172,159,122, 76,125,163,211,  0, 45, 90,135,180,225,125,
-         75,  7,225,194,235, 26, 73,118,163,208,253, 42, 87,226,221,177,100,
-         74,101,145,191,236, 25, 70,115,160, 61, 69, 39, 84,129,174, 27,  8,
-         53, 98,148,188,233, 22, 88,112,157,202,236, 36, 81,126,176,216,  5,
-         50, 68,140,185,230,  8, 64,109,154,220,244, 33, 78, 96,168,213,  2,
-         49, 92,137,182,253, 16, 61,106,137,196,241, 30, 84,120,165,210,224,
-         44, 89,134,172,224, 13, 58,120,148,193,238, 59, 72,117,162,239,252,
-         41, 86,163,176,221, 10, 23,100,145,190,202, 24, 69,114,190,204,249,
-         38,118,128,173,218, 34, 52, 97,142,157,232, 21, 66, 73,156,201,246,
-         10, 80,125,170,254,  4, 49, 94,162,184,229, 18, 22,108,153,198,218,
-         32, 77,122,142,212,  1, 46,114,136,181,226, 38, 60,105,150,234,240,
-         29, 74, 93,164,209,254,  1, 88,133,178,241, 12, 57,102,189,192,237,
-         26,105,116,161,206,212, 40, 85,130,128,220,  9, 54, 76,144,189,234,
-         56, 68,113,158,228,248, 37, 82, 80,172,217,  6,  3, 96,141,186,215,
-         20, 65,110,171,200,245, 34,127,124,169,214, 51, 48, 93,138,135,228,
-         17, 62, 95,152,197,242, 42, 76,121,166,230,  0, 45, 90,178,180,225,
-         14, 14,104,149,194,218, 28, 73,118,149,208,253, 42, 97,132,177,222,
-         61, 56,101,146,137,236, 25, 70, 69,160,205,250, 16, 84,129,174,236,
-          8, 53, 98,183,188,233, 22,122,112,157,202,205, 36, 81,126,144,216,
-          5, 50,100,140,185,230, 45, 64,109,154,135,244, 33, 78, 59,168,213,
-          2,111, 92,137,182,163, 16, 61,106,214,196,241, 30, 10,120,165,210,
-        190, 44, 89,134,247,224, 13, 58, 35,148,193,238, 95, 72,117,162,139,
-        252, 41, 86,198,176,221, 10,114,100,145,190,174, 24, 69,114,218,204,
-        249, 38, 27,128,173,218, 78, 52, 97,142,242,232, 21, 66, 38,156,201,
-        246,105, 80,125,170,156,  4, 49, 94,198,184,229, 18,114,108,153,198,
-        190, 32, 77,122,234,212,  1, 46, 11,136,181,226, 95, 60,105,150,147,
-        240, 29, 74, 39,164,209,254,122, 88,133,178,142, 12, 57,102,193,192,
-        237, 26, 17,116,161,206,173, 40, 85,130,248,220,  9, 54, 52,144,189,
-        234, 64, 68,113,158,156,248, 37, 82, 39,172,217,  6,106, 96,141,186,
-        190, 20, 65,110,194,200,245, 34, 22,124,169,214, 90, 48, 93,138,238,
-        228, 17, 62, 50,152,197,242, 69, 76,121,166,137,  0, 45, 90,221,180,
-        225, 14, 97,104,149,194,181, 28, 73,118,249,208,253, 42,  9,132,177,
-        222, 85, 56,101,146,225,236, 25, 70, 45,160,205,250,120, 84,129,174,
-        187,  8, 53, 98,239,188,233, 22, 35,112,157,202,151, 36, 81,126,203,
-        216,  5, 50, 60,140,185,230,112, 64,109,154,164,244, 33, 78, 24,168,
-        213,  2, 76, 92,137,182,133, 16, 61,106,240,196,241, 30, 33,120,165,
-        210,148, 44, 89,134,221,224, 13, 58,  8,148,193,238,116, 72,117,162,
-        191,252, 41, 86,247,176,221, 10, 67,100,145,190,159, 24, 69,114,234,
-        204,249, 38, 36,128,173,218,112, 52, 97,142,204,232, 21, 66, 24,156,
-        201,246, 91, 80,125,170,171,  4, 49, 94,247,184,229, 18, 66,108,153,
-        198,142, 32, 77,122,218,212,  1, 46, 38,136,181,226,113, 60,105,150,
-        189,240, 29, 74,  9,164,209,254, 84, 88,133,178, 95, 12, 57,102, 18,
-        192,237, 26, 58,116,161,206,126, 40, 85,130, 42,220,  9, 54,229,144,
-        189,234,145, 68,113,158, 77,248, 37, 82,249,172,217,  6,180, 96,141,
-        186, 96, 20, 65,110, 28,200,245, 34,199,124,169,214,138, 48, 93,138,
-         61,228, 17, 62,237,152,197,242,143, 76,121,166, 67,  0, 45, 90, 22,
-        180,225, 14,169,104,149,194,121, 28, 73,118, 53,208,253, 42,193,132,
-        177,222,157, 56,101,146, 41,236, 25, 70,229,160,205,250,177, 84,129,
-        174, 76,  8, 53, 98,147,188,233, 22, 70,112,157,202,247, 36, 81,126,
-        207,185,113, 83, 95,140,185,230, 19,255,109,154,199,243, 33, 78,123,
-        168,213,  2, 47, 44,236,196,138,127, 89,106,151,196,241, 30,244,120,
-        165,210,249, 44, 89,134,179,224, 13, 58, 20,224,160,156,111, 72,117,
-        162,207,252,150, 86,131,176,216, 10, 55,100,145,190,235, 24, 54,  6,
-        240,188,249, 38, 83,128,173,101,  7, 52, 97,134,187,232, 21, 66,111,
-        156,201,133, 83, 49,  9,195,182,104, 49, 94,139,184,229,173, 63,108,
-        153,202,243, 32, 77,122,167,212,  1, 72, 50,228,208,189, 99, 89,  7,
-        241,183,152, 29, 74,119,164,209, 65, 43, 88,133,180,223, 12, 57,102,
-        147,192,237,106, 38,  6,210,171,251, 32, 85,130,175, 99,  9, 54, 99,
-        150,189,234, 23, 68,113,158,203,140, 76, 63, 26,223,217, 17, 51, 96,
-        141,  5,231, 20, 65,104,155,200,245, 34, 79,124,169,165,115, 95, 41,
-        249,183,253, 17, 62,107, 39,197,242, 31, 73,121,166,211,  0, 45, 90,
-        135,192,136, 99, 94,104,161,194,239, 28,246,118,163,208,248, 42, 87,
-        132,177,222, 11, 56, 13,247,205,137, 25,127,115,160,205, 69, 39, 84,
-        129,171,219,  8, 53, 98,143,188,233,120, 38,  8,233,202,201, 36, 81,
-        126, 20,216,  5, 50, 90,140,185,230, 19, 64,109,154,179,145, 79, 42,
-        123,232,213,  2, 47,227,137,182,227, 21, 61,106,151,196,241, 30, 75,
-         20,196,161,139, 44, 24,134,179,224,178, 58,103,148,201,238, 27, 72,
-        117,162,207,252, 70, 48,229,195,184,126, 68,100,211,190,235, 24,250,
-        114,159,204,241, 38, 83,128,173,218,  7, 52, 17,235,201,129,122, 38,
-         28,156,138,246, 35, 80,194,170,215,  4, 53, 94,139,184,229, 18, 63,
-        108,252,169,149, 32, 11,122,167,212,190, 46, 91,136,185,226, 15, 60,
-        105,150,195,240,123, 35, 27,193,142,145, 77, 62,246,215,171, 12,181,
-        102,147,192, 82, 26, 71,116,173,206,251, 40, 85,130,175,220,111, 95,
-         15,245,226,140,126, 42, 24,237,163,248,168, 82,127,172,102,  6, 51,
-         96,138,186,231, 20, 65,110,155,200,133, 77, 38, 18,221,165,  3,190,
-         93,138,183, 91, 17, 62,107,148,197,242, 31, 76,121,166,211, 40, 75,
-         53,245,148,136, 96, 95, 13,237,235,239,131, 73,118,163,119,253, 42,
-         87,136,177,222, 11, 56,101,146,191,196,127, 41,  1,128,161,147, 74,
-         61,245,135,219,151, 53, 98,143, 27,233, 22, 67,123,157,202,247, 36,
-         81,126,171,240, 99, 93, 45,172,202,146,118, 48, 68,154, 88,244, 33,
-         78,220,168,213,  2, 45, 92,137,182,227, 16, 61,106,254,196, 81, 30,
-         75,120,  3,210,255, 44, 85,134,179,224, 13, 58,103,148,233,136,116,
-         58, 85,203,161,152, 76, 46,170,176,113, 10, 55,100, 37,190,235, 24,
-         73,114,159,204,249, 38, 83,128,133,188,104, 70, 65,226,210,133,124,
-         54, 70,156,101,246, 35, 80,201,170,215,  4, 58, 94,139,184,229, 18,
-         63,108,177,160,156, 82,109,  9,211,177,113,  7, 91, 36,181,226, 15,
-        136,105,150,195,242, 29, 74,119,164,209,254, 43, 49,133, 31,223, 12,
-         57,213,147,192,237, 25, 71,116,161,202,251, 40, 85,130,175,220,  9,
-         87, 14,246,189,236, 23, 68,113,158,203,248, 37, 38, 30,206,181, 99,
-         51,101,141,186,231, 20, 65,110,155,165,148, 86, 39,124,189,214,  3,
-         48, 81,138,183,228, 29, 62,107,152,201,242, 31, 76,116,166,211,  0,
-         32, 90,135,180,236, 14, 59,104,155,194,239, 28, 71,118,163,208,243,
-         42, 87,132,161,222, 11, 56,117,146,191,236, 11, 70,115,160,223,250,
-         39, 84,147,174,219,  8,162, 98,143,188,126, 22, 67,112, 10,202,247,
-         36,198,126,171,216, 29, 50, 95,140, 46,230, 19, 64,104,154,199,244,
-         37, 78,123,168,213,  2, 47, 92,232,219,133, 16, 62,106,151,196,226,
-         30, 75,120,160,210,255, 44, 89,134,179,224,110, 85, 21,241,193,232,
-         27, 72,117,177,207,252, 41, 83,131,176,221, 10, 55,100,145,210,155,
-        125, 34,114,150,204,249, 38, 64,128,173,218,  2, 52, 97,142,187,232,
-         21, 66,  2,253,189,158, 35, 91,125,170,215, 23, 49, 94,139,190,229,
-         18, 63,108,153,198,243, 84, 44, 24,203,177,  1, 37, 91,136,181,241,
-         15, 60,105,150,195,240, 29,
-    };
-
-    static int i = 0;
-    int mask = 25, step = 45;
-    while (i < 2965) {
-        content[i++] ^= mask % 256;
-        mask += step;
-    }
-
-    int result = luaL_loadbuffer(L, (const char*)content,
-                                 2965, "src/stream_flv_meta.lua");
-    if (!result) {
-        result = lua_pcall(L, 0, 0, 0);
-    }
-
-    if (result) {
-        lua_error(L);
-    }
-}
-
-#endif
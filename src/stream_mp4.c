@@ -7,14 +7,21 @@
  * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
  */
 
+#define _GNU_SOURCE
+
 /*----------------------------------------------------------------------------------------------------------*/
 
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include "core.h"
+#include "decode.h"
 #include "loomiere.h"
+#include "seek.h"
 #include "stream_mp4.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -237,6 +244,11 @@ static int parse_trak(stream_t* stream, trak_t* trak) {
     return 0;
 }
 
+static void clear_mvhd(xxhd_t* mvhd) {
+    int offset = (mvhd->version ? 20 : 12) + 52 + (mvhd->version ? 12 : 8);
+    memset(&mvhd->atom.data[offset], 0, 24);
+}
+
 static int parse_moov(stream_t* stream, moov_t* moov) {
     atom_t atom;
     trak_t trak;
@@ -279,9 +291,7 @@ static int parse_moov(stream_t* stream, moov_t* moov) {
     moov->mvhd.duration = moov->mvhd.version ? read_64(p) : read_32(p);
 
     // clear preview/select times
-    offset += 52 + (moov->mvhd.version ? 12 : 8);
-    moov->mvhd.atom.data[offset] = 0;
-    memset(&moov->mvhd.atom.data[offset], 0, 24);
+    clear_mvhd(&moov->mvhd);
 
     // success
     return 0;
@@ -290,57 +300,269 @@ static int parse_moov(stream_t* stream, moov_t* moov) {
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
- * Seek compilation functions.
+ * Seek index functions.
  */
-static void compile_maxs(stbl_t* stbl) {
-    uint32_t i, c;
-    uint8_t* p = stbl->stts.data;
+static size_t index_size(uint32_t stts, uint32_t stss, uint32_t ctts, uint32_t stsc, uint32_t stsz, uint32_t coxx) {
+    return sizeof(tidx_head_t) + sizeof(uint64_t) * (3 * (size_t)stts + stss + ctts +
+                                                     3 * (size_t)stsc + 1 + stsz + 1 + coxx);
+}
 
-    // initialize
-    stbl->max_samples = 0;
-    stbl->max_time = 0;
+static int map_index(stbl_t* stbl, void* blob, size_t size) {
+    tidx_head_t* head = (tidx_head_t*)blob;
+    tidx_t*      x = &stbl->index;
+
+    // validate
+    if (!blob || size < sizeof(tidx_head_t)) return 1;
+    if (head->stts_count != stbl->stts.count || head->stss_count != stbl->stss.count ||
+        head->ctts_count != stbl->ctts.count || head->stsc_count != stbl->stsc.count ||
+        head->stsz_count != stbl->stsz.count || head->coxx_count != stbl->coxx.count) return 1;
+    if (size != index_size(head->stts_count, head->stss_count, head->ctts_count,
+                           head->stsc_count, head->stsz_count, head->coxx_count)) return 1;
+
+    // locate tables
+    x->head = head;
+    x->stts_samples = (uint64_t*)(head + 1);
+    x->stts_times = x->stts_samples + head->stts_count;
+    x->stts_durations = x->stts_times + head->stts_count;
+    x->stss_samples = x->stts_durations + head->stts_count;
+    x->ctts_samples = x->stss_samples + head->stss_count;
+    x->stsc_samples = x->ctts_samples + head->ctts_count;
+    x->stsc_chunks = x->stsc_samples + head->stsc_count;
+    x->stsc_sizes = x->stsc_chunks + head->stsc_count + 1;
+    x->stsz_offsets = x->stsc_sizes + head->stsc_count;
+    x->coxx_offsets = x->stsz_offsets + head->stsz_count + 1;
+
+    // limits
+    stbl->max_offset = head->max_offset;
+    stbl->max_chunks = head->max_chunks;
+    stbl->max_samples = head->max_samples;
+    stbl->max_time = head->max_time;
 
-    // sample, time
-    for (i = 0; i < stbl->stts.count; i++, p += 8) {
-        c = read_32(&p[0]);                                                     // sample count
-        stbl->max_samples += c;                                                 // samples
-        stbl->max_time += c * read_32(&p[4]);                                   // time
+    // success
+    return 0;
+}
+
+static void* compile_index(stbl_t* stbl, size_t* size) {
+    uint32_t i, c, d, u;
+    uint64_t n, t;
+    uint8_t* p;
+
+    // allocate
+    *size = index_size(stbl->stts.count, stbl->stss.count, stbl->ctts.count,
+                       stbl->stsc.count, stbl->stsz.count, stbl->coxx.count);
+    tidx_head_t* head = (tidx_head_t*)ZALLOC(*size);
+    head->stts_count = stbl->stts.count;
+    head->stss_count = stbl->stss.count;
+    head->ctts_count = stbl->ctts.count;
+    head->stsc_count = stbl->stsc.count;
+    head->stsz_count = stbl->stsz.count;
+    head->coxx_count = stbl->coxx.count;
+    map_index(stbl, head, *size);
+    tidx_t* x = &stbl->index;
+
+    // decode plain tables
+    decode_table(x->stts_durations, stbl->stts.data + 4, stbl->stts.count, 8, 32);
+    decode_table(x->stss_samples, stbl->stss.data, stbl->stss.count, 4, 32);
+    decode_table(x->stsc_sizes, stbl->stsc.data + 4, stbl->stsc.count, 12, 32);
+    decode_table(x->coxx_offsets, stbl->coxx.data, stbl->coxx.count,
+                 stbl->coxx.bytes, stbl->coxx.bytes << 3);
+
+    // decode counting tables (summed below)
+    decode_table(x->stts_samples, stbl->stts.data, stbl->stts.count, 8, 32);
+    decode_table(x->ctts_samples, stbl->ctts.data, stbl->ctts.count, 8, 32);
+    decode_table(x->stsz_offsets, stbl->stsz.data, stbl->stsz.count, 4, 32);
+
+    // stts (cumulative samples and time)
+    for (i = 0, n = 0, t = 0; i < stbl->stts.count; i++) {
+        t += x->stts_samples[i] * x->stts_durations[i];                         // increment time
+        n += x->stts_samples[i];                                                // increment count
+        x->stts_samples[i] = n;
+        x->stts_times[i] = t;
     }
 
-    // chunk
-    stbl->max_chunks = stbl->coxx.count;
+    // stss (zero based keyframes)
+    for (i = 0; i < stbl->stss.count; i++) {
+        x->stss_samples[i]--;
+    }
 
-    // offset
-    c = read_32(&stbl->stsc.data[(stbl->stsc.count - 1) * 12 + 4]);             // sample count
-    stbl->max_offset = read_xx(&stbl->coxx.data[(stbl->coxx.count - 1) *        // last chunk offset
-                                                 stbl->coxx.bytes],
-                               stbl->coxx.bytes << 3);
-    for (i = 0; i < c; i++) {
-        stbl->max_offset += stbl->stsz.size ? stbl->stsz.size :
-                            read_32(&stbl->stsz.data[(stbl->stsz.count - i - 1) << 2]);
+    // ctts (cumulative samples)
+    for (i = 0, n = 0; i < stbl->ctts.count; i++) {
+        n += x->ctts_samples[i];                                                // increment count
+        x->ctts_samples[i] = n;
+    }
+
+    // stsc (cumulative samples and chunks)
+    p = stbl->stsc.data;
+    for (i = 0, n = 0, t = 0; i < stbl->stsc.count; i++, p += 12) {
+        c = x->stsc_sizes[i];                                                   // samples per chunk
+        d = (i == (stbl->stsc.count - 1)) ?                                     // read next chunk number
+             stbl->coxx.count : (read_32(&p[12]) - 1);
+        u = d - t;                                                              // chunks in this entry
+        x->stsc_chunks[i] = t;
+        n += (uint64_t)u * c;                                                   // increment samples
+        t += u;                                                                 // increment chunks
+        x->stsc_samples[i] = n;
+    }
+    x->stsc_chunks[stbl->stsc.count] = t;
+
+    // stsz (bytes before each sample)
+    for (i = 0, n = 0; i < stbl->stsz.count; i++) {
+        t = x->stsz_offsets[i];                                                 // sample size
+        x->stsz_offsets[i] = n;
+        n += t;                                                                 // increment bytes
+    }
+    x->stsz_offsets[stbl->stsz.count] = n;
+
+    // limits (samples, time and chunks)
+    head->max_samples = stbl->stts.count ? x->stts_samples[stbl->stts.count - 1] : 0;
+    head->max_time = stbl->stts.count ? x->stts_times[stbl->stts.count - 1] : 0;
+    head->max_chunks = stbl->coxx.count;
+
+    // limits (end of the last chunk)
+    if (stbl->stsc.count && stbl->coxx.count) {
+        c = x->stsc_sizes[stbl->stsc.count - 1];                                // sample count
+        head->max_offset = x->coxx_offsets[stbl->coxx.count - 1];               // last chunk offset
+        if (stbl->stsz.size) {
+            head->max_offset += (uint64_t)c * stbl->stsz.size;
+        } else {
+            c = MIN(c, stbl->stsz.count);
+            head->max_offset += x->stsz_offsets[stbl->stsz.count] -
+                                x->stsz_offsets[stbl->stsz.count - c];
+        }
+    }
+    map_index(stbl, head, *size);
+
+    // ready
+    return head;
+}
+
+static uint32_t search_index(const uint64_t* table, uint32_t count, uint64_t value) {
+    uint32_t low = 0, high = count;
+
+    // first entry greater than value (count if none)
+    while (low < high) {
+        uint32_t middle = (low + high) >> 1;
+        if (table[middle] <= value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
+    return low;
 }
 
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Model functions.
+ */
+static void rebase_atom(atom_t* atom, uint8_t* from, uint8_t* to) {
+    if (atom->data) {
+        atom->data = (uint8_t*)((uintptr_t)atom->data - (uintptr_t)from + (uintptr_t)to);
+    }
+}
+
+static void rebase_stxx(stxx_t* stxx, uint8_t* from, uint8_t* to) {
+    rebase_atom(&stxx->atom, from, to);
+    if (stxx->data) {
+        stxx->data = (uint8_t*)((uintptr_t)stxx->data - (uintptr_t)from + (uintptr_t)to);
+    }
+}
+
+static void rebase_trak(trak_t* trak, uint8_t* from, uint8_t* to) {
+    if (VOID(*trak)) return;
+    stbl_t* stbl = &trak->mdia.minf.stbl;
+    rebase_atom(&trak->atom, from, to);
+    rebase_atom(&trak->tkhd.atom, from, to);
+    rebase_atom(&trak->mdia.atom, from, to);
+    rebase_atom(&trak->mdia.mdhd.atom, from, to);
+    rebase_atom(&trak->mdia.hdlr.atom, from, to);
+    rebase_atom(&trak->mdia.minf.atom, from, to);
+    rebase_atom(&trak->mdia.minf.xmhd.atom, from, to);
+    rebase_atom(&stbl->atom, from, to);
+    rebase_atom(&stbl->stsd.atom, from, to);
+    rebase_stxx(&stbl->stts, from, to);
+    rebase_stxx(&stbl->ctts, from, to);
+    rebase_stxx(&stbl->stss, from, to);
+    rebase_stxx(&stbl->stsc, from, to);
+    rebase_stxx(&stbl->stsz, from, to);
+    rebase_stxx(&stbl->coxx, from, to);
+}
+
+static void rebase_moov(moov_t* moov, uint8_t* from, uint8_t* to) {
+    rebase_atom(&moov->atom, from, to);
+    rebase_atom(&moov->mvhd.atom, from, to);
+    rebase_trak(&moov->vtrak, from, to);
+    rebase_trak(&moov->strak, from, to);
+}
+
+static int map_model(moov_t* moov, model_t* model, size_t size, uint8_t* base, size_t base_size) {
+
+    // validate
+    if (!model || size < sizeof(model_t)) return 1;
+    if (model->version != STREAM_MP4_MODEL || model->moov_size != base_size) return 1;
+    if (size != sizeof(model_t) + model->vtidx_size + model->stidx_size) return 1;
+
+    // restore pointers
+    *moov = model->moov;
+    rebase_moov(moov, NULL, base);
+
+    // locate indexes
+    uint8_t* p = (uint8_t*)(model + 1);
+    if (!VOID(moov->vtrak) && map_index(&moov->vtrak.mdia.minf.stbl, p, model->vtidx_size)) return 1;
+    p += model->vtidx_size;
+    if (!VOID(moov->strak) && map_index(&moov->strak.mdia.minf.stbl, p, model->stidx_size)) return 1;
+
+    // success
+    return 0;
+}
+
+static model_t* compile_model(moov_t* moov, uint8_t* base, size_t base_size, size_t* size) {
+    void*  vtidx = NULL;
+    void*  stidx = NULL;
+    size_t vtidx_size = 0;
+    size_t stidx_size = 0;
+
+    // build indexes
+    if (!VOID(moov->vtrak)) vtidx = compile_index(&moov->vtrak.mdia.minf.stbl, &vtidx_size);
+    if (!VOID(moov->strak)) stidx = compile_index(&moov->strak.mdia.minf.stbl, &stidx_size);
+
+    // assemble
+    *size = sizeof(model_t) + vtidx_size + stidx_size;
+    model_t* model = (model_t*)ZALLOC(*size);
+    model->version = STREAM_MP4_MODEL;
+    model->moov_size = base_size;
+    model->vtidx_size = vtidx_size;
+    model->stidx_size = stidx_size;
+    model->moov = *moov;
+    ZERO(&model->moov.vtrak.mdia.minf.stbl.index, sizeof(tidx_t));
+    ZERO(&model->moov.strak.mdia.minf.stbl.index, sizeof(tidx_t));
+    rebase_moov(&model->moov, base, NULL);
+    if (vtidx) memcpy((uint8_t*)(model + 1), vtidx, vtidx_size);
+    if (stidx) memcpy((uint8_t*)(model + 1) + vtidx_size, stidx, stidx_size);
+
+    // ready
+    FREE(vtidx);
+    FREE(stidx);
+    return model;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Seek compilation functions.
+ */
 static void compile_seek(stbl_t* stbl, seek_t* seek) {
-    uint32_t i;
-    uint32_t t, u, c, d, n;
-    uint8_t* p;
+    tidx_t*  x = &stbl->index;
+    uint32_t i, c, d;
+    uint64_t n, t, s;
 
     // look-up stts
-    p = stbl->stts.data;
-    seek->stts.index = 0;
-    for (u = 0, c = 0, t = 0, n = 0;
-         seek->stts.index < stbl->stts.count;
-         seek->stts.index++, p += 8) {
-
-        c  = read_32(&p[0]);                                                    // read count
-        d  = read_32(&p[4]);                                                    // read duration
-        u  = c * d;                                                             // whole entry time
-        if ((t + u) > seek->time) break;                                        // break if passed
-        n += c;                                                                 // increment count
-        t += u;                                                                 // increment time
-        d  = 1;
-    }
+    i = search_index(x->stts_times, stbl->stts.count, seek->time);
+    seek->stts.index = i;
+    n = i ? x->stts_samples[i - 1] : 0;                                         // samples before entry
+    t = i ? x->stts_times[i - 1] : 0;                                           // time before entry
+    d = (i < stbl->stts.count) ? x->stts_durations[i] : 1;                      // duration
     seek->stts.offset  = (seek->time - t) / d;                                  // save offset
     seek->time         = MIN(t + seek->stts.offset * d, stbl->max_time);        // save sample time
     seek->stsz.index   = MIN(n + seek->stts.offset, stbl->max_samples);         // save sample number
@@ -348,86 +570,49 @@ static void compile_seek(stbl_t* stbl, seek_t* seek) {
     // look-up stss (if available) and snap to keyframe
     seek->stss.index = 0;                                                       // first keyframe
     if (!VOID(stbl->stss)) {
-        t = seek->stsz.index;                                                   // initial sample number
-
-        if (t < stbl->stsz.count) {
-            p = stbl->stss.data + 4;                                            // second keyframe
-            seek->stsz.index = 0;
-            seek->stss.index = 1;
-            for (n = 0;
-                 seek->stss.index < stbl->stss.count;
-                 seek->stss.index++, p += 4) {
-
-                n = read_32(&p[0]) - 1;                                         // read new sample id
-                if (n > t) {                                                    // went too far?
-                    seek->stss.index--;                                         // devance index
-                    break;
-                }
-                seek->stsz.index = n;                                           // correct sample number
-            }
+        s = seek->stsz.index;                                                   // initial sample number
+
+        if (s < stbl->stsz.count) {
+            c = stbl->stss.count > 1 ?                                          // keyframes (past the
+                search_index(x->stss_samples + 1, stbl->stss.count - 1, s) : 0; // first) up to sample
+            seek->stss.index = (c == stbl->stss.count - 1) ? stbl->stss.count : c;
+            seek->stsz.index = c ? x->stss_samples[c] : 0;                      // correct sample number
         } else {
             seek->stss.index = stbl->stss.count;
         }
 
         // correct stts offsets
-        t -= seek->stsz.index;
-        d  = seek->stts.offset ?
-             read_32(&stbl->stts.data[(seek->stts.index << 3) + 4]) : 0;        // read duration
-        while (t > 0) {
-            if (seek->stts.offset) {
-                seek->stts.offset--;                                            // decrease offset
-            } else {
-                p = &stbl->stts.data[--seek->stts.index << 3];                  // decrease index
-                seek->stts.offset = read_32(&p[0]) - 1;                         // read count
-                d = read_32(&p[4]);                                             // read duration
-            }
-            seek->time -= d;                                                    // decrease duration
-            t--;                                                                // decrease step
+        if (seek->stsz.index != s) {
+            i = search_index(x->stts_samples, stbl->stts.count, seek->stsz.index);
+            n = i ? x->stts_samples[i - 1] : 0;                                 // samples before entry
+            t = i ? x->stts_times[i - 1] : 0;                                   // time before entry
+            d = (i < stbl->stts.count) ? x->stts_durations[i] : 1;              // duration
+            seek->stts.index = i;
+            seek->stts.offset = seek->stsz.index - n;                           // save offset
+            seek->time = t + seek->stts.offset * d;                             // save keyframe time
         }
     }
 
     // look-up ctts (if available)
     if (!VOID(stbl->ctts)) {
-        p = stbl->ctts.data;
-        seek->ctts.index = 0;
-        for (i = 0, n = 0;
-             seek->ctts.index < stbl->ctts.count;
-             seek->ctts.index++, p += 8) {
-            c = read_32(&p[0]);                                                 // read count
-            d = read_32(&p[4]);                                                 // read time offset
-            if ((n + c) > seek->stsz.index) break;                              // went too far?
-            n += c;                                                             // increment count
-        }
-        seek->ctts.offset = seek->stsz.index - n;                               // save offset
+        i = search_index(x->ctts_samples, stbl->ctts.count, seek->stsz.index);
+        seek->ctts.index = i;
+        seek->ctts.offset = seek->stsz.index - (i ? x->ctts_samples[i - 1] : 0);// save offset
     }
 
     // look-up stsc
-    p = stbl->stsc.data;
-    seek->stsc.index = 0;
-    seek->coxx.index = 0;                                                       // first chunk number
-    for (n = 0;
-         seek->stsc.index < stbl->stsc.count;
-         seek->stsc.index++, p += 12) {
-        c = read_32(&p[4]);                                                     // read samples per chunk
-        d = (seek->stsc.index == (stbl->stsc.count - 1)) ?                      // read next chunk number
-             stbl->max_chunks : (read_32(&p[12]) - 1);
-        u = d - seek->coxx.index;                                               // chunks in this entry
-        d = u * c;                                                              // samples in this entry
-        if ((n + d) > seek->stsz.index) break;                                  // went too far?
-        n += d;                                                                 // increment samples
-        seek->coxx.index += u;                                                  // increment chunks
-        c = 1;
-    }
+    i = search_index(x->stsc_samples, stbl->stsc.count, seek->stsz.index);
+    seek->stsc.index = i;
+    n = i ? x->stsc_samples[i - 1] : 0;                                         // samples before entry
+    c = (i < stbl->stsc.count) ? x->stsc_sizes[i] : 1;                          // samples per chunk
     d = seek->stsz.index - n;                                                   // sample within entry
     seek->stsc.offset = d / c;                                                  // save offset
-    seek->coxx.index += seek->stsc.offset;                                      // save chunk number
+    seek->coxx.index  = x->stsc_chunks[i] + seek->stsc.offset;                  // save chunk number
     seek->coxx.offset = d % c;                                                  // sample within chunk
 
     // look-up stco/co64
     if (seek->coxx.index < stbl->max_chunks) {
-        seek->offset = read_xx(&stbl->coxx.data[seek->coxx.index *              // read offset from array
-                                                stbl->coxx.bytes],
-                                stbl->coxx.bytes << 3);
+        seek->offset = x->coxx_offsets[seek->coxx.index];                       // chunk offset
     } else {
         seek->offset = stbl->max_offset;                                        // use end-of-data
     }
@@ -436,12 +621,108 @@ static void compile_seek(stbl_t* stbl, seek_t* seek) {
     if (stbl->stsz.size) {
         seek->offset += seek->coxx.offset * stbl->stsz.size;
     } else if (seek->coxx.offset) {
-        n = seek->coxx.offset;
-        while (n) {
-            seek->offset += read_32(&stbl->stsz.data[(seek->stsz.index - n) << 2]);
-            n--;
+        seek->offset += x->stsz_offsets[seek->stsz.index] -                     // previous samples
+                        x->stsz_offsets[seek->stsz.index - seek->coxx.offset];  // in chunk
+    }
+}
+
+static void extend_offsets(stbl_t* stbl, uint64_t period, uint32_t* cursors, off_t* offsets,
+                           size_t from, size_t to) {
+    tidx_t*  x = &stbl->index;
+    uint32_t a = cursors[0], b = cursors[1];                                    // stts and stsc cursors
+    uint64_t i, n, t, d, c, k;
+    uint64_t time, sample, chunk, offset;
+
+    // merge period times with the (cumulative) tables, all cursors only advance
+    for (i = from, time = from * period; i < to; i++, time += period) {
+
+        // find sample number
+        while (a < stbl->stts.count && x->stts_times[a] <= time) a++;
+        if (a < stbl->stts.count) {
+            n = a ? x->stts_samples[a - 1] : 0;                                 // samples before entry
+            t = a ? x->stts_times[a - 1] : 0;                                   // time before entry
+            sample = MIN(n + (time - t) / x->stts_durations[a], stbl->max_samples);
+        } else {
+            sample = stbl->max_samples;
+        }
+
+        // find chunk number
+        while (b < stbl->stsc.count && x->stsc_samples[b] <= sample) b++;
+        if (b < stbl->stsc.count) {
+            k = b ? x->stsc_samples[b - 1] : 0;                                 // samples before entry
+            c = x->stsc_sizes[b];                                               // samples per chunk
+            d = sample - k;                                                     // sample within entry
+            chunk = x->stsc_chunks[b] + d / c;                                  // chunk number
+            d = d % c;                                                          // sample within chunk
+        } else {
+            chunk = stbl->max_chunks;
+            d = 0;
         }
+
+        // look-up stco/co64
+        offset = (chunk < stbl->max_chunks) ? x->coxx_offsets[chunk] : stbl->max_offset;
+
+        // look-up stsz
+        if (stbl->stsz.size) {
+            offset += d * stbl->stsz.size;
+        } else if (d) {
+            offset += x->stsz_offsets[sample] - x->stsz_offsets[sample - d];
+        }
+
+        // store offset
+        offsets[i] = offset;
     }
+
+    // resume point
+    cursors[0] = a;
+    cursors[1] = b;
+}
+
+static void compile_offsets(stbl_t* stbl, uint64_t period, off_t* offsets, size_t periods) {
+    uint32_t cursors[2] = { 0, 0 };
+    extend_offsets(stbl, period, cursors, offsets, 0, periods);
+}
+
+static int compile_lazy(stream_t* self, int release) {
+    lazy_t* lazy = (lazy_t*)self->extend_state;
+
+    // release
+    if (release) {
+        if (lazy) {
+            FREE(lazy->model);
+            FREE(lazy);
+        }
+        self->extend_state = NULL;
+        return 0;
+    }
+
+    // adopt the complete table (if stored meanwhile by another stream)
+    int    size = 0;
+    off_t* offsets = (off_t*)stream_cache_get(self, lazy->name, &size);
+    if (offsets && size == sizeof(off_t) * self->periods) {
+        FREE(self->offsets);
+        self->offsets = offsets;
+        self->offsets_ready = self->periods;
+    } else {
+        FREE(offsets);
+
+        // next chunk
+        size_t to = MIN(self->periods, self->offsets_ready + STREAM_OFFSETS_CHUNK);
+        extend_offsets(&lazy->stbl, lazy->period, lazy->cursors, self->offsets, self->offsets_ready, to);
+        self->offsets_ready = to;
+
+        // store (complete tables only)
+        if (to == self->periods) {
+            stream_cache_put(self, lazy->name, self->offsets, sizeof(off_t) * self->periods);
+        }
+    }
+
+    // complete
+    if (self->offsets_ready == self->periods) {
+        compile_lazy(self, 1);
+        self->extend = NULL;
+    }
+    return 0;
 }
 
 static void resize_xxxx(stxx_t* xxxx, tbli_t* start, tbli_t* end, tbli_t* end2) {
@@ -571,7 +852,7 @@ static void write_time(xxhd_t* xxhd, uint32_t pos32, uint32_t pos64) {
     write_xx(&xxhd->atom.data[xxhd->version ? pos64 : pos32], xxhd->duration, xxhd->version ? 64 : 32);
 }
 
-static void compile_trak(stream_t* stream, file_t* file, trak_t* trak) {
+static void seek_trak(stream_t* stream, file_t* file, trak_t* trak) {
     if (VOID(*trak)) return;
 
     // get requested times from stream
@@ -614,6 +895,10 @@ static void compile_trak(stream_t* stream, file_t* file, trak_t* trak) {
         stream->file_finish = trak->end.offset;
         //stream->stop += stream->stop ? 0 : 1;
     }
+}
+
+static void compile_trak(stream_t* stream, file_t* file, trak_t* trak) {
+    if (VOID(*trak)) return;
 
     // restructuring stbl
     stbl_t* _stbl  = &trak->mdia.minf.stbl;
@@ -670,9 +955,9 @@ static void compile_moov(stream_t* stream, file_t* file) {
     write_time(&file->moov.mvhd, 16, 24);
 }
 
-static void compile_mdat(stream_t* stream, file_t* file) {
-    // resize moov
-    file->mdat.atom.data_size = stream->file_finish - stream->file_offset;
+static void compile_mdat(stream_t* stream, file_t* file, runs_t* runs) {
+    // resize mdat
+    file->mdat.atom.data_size = runs ? runs->size : stream->file_finish - stream->file_offset;
 
     // make size non-zero
     file->mdat.atom.size = file->mdat.atom.data_size;
@@ -681,10 +966,10 @@ static void compile_mdat(stream_t* stream, file_t* file) {
     resize_atom(&file->mdat.atom);
 }
 
-static void relocate_trak(stream_t* stream, file_t* file, trak_t* trak, uint64_t start) {
+static void relocate_trak(stream_t* stream, file_t* file, trak_t* trak, runs_t* runs, uint64_t start) {
     if (VOID(*trak)) return;
 
-    uint64_t i;
+    uint64_t i, r, base;
     int64_t  delta;
     uint8_t* p;
 
@@ -706,8 +991,21 @@ static void relocate_trak(stream_t* stream, file_t* file, trak_t* trak, uint64_t
     uint8_t _bits = trak->mdia.minf.stbl.coxx.bytes << 3;
     i = trak->mdia.minf.stbl.coxx.count;
     p = trak->mdia.minf.stbl.coxx.data;
-    for (; i > 0; i--, p += trak->mdia.minf.stbl.coxx.bytes) {
-        write_xx(p, (int64_t)read_xx(p, _bits) - delta, _bits);
+    if (!runs || !runs->count) {
+        for (; i > 0; i--, p += trak->mdia.minf.stbl.coxx.bytes) {
+            write_xx(p, (int64_t)read_xx(p, _bits) - delta, _bits);
+        }
+        return;
+    }
+
+    // translate into the ranges (both in file order)
+    for (r = 0, base = start; i > 0; i--, p += trak->mdia.minf.stbl.coxx.bytes) {
+        uint64_t offset = read_xx(p, _bits);
+        while (r + 1 < runs->count && runs->ranges[2 * r + 1] <= offset) {
+            base += runs->ranges[2 * r + 1] - runs->ranges[2 * r];              // data before range
+            r++;
+        }
+        write_xx(p, base + offset - runs->ranges[2 * r], _bits);
     }
 }
 
@@ -730,8 +1028,8 @@ static void iovs_head(iovs_t* i, xxxx_t* s, uint8_t** heads) {
     }
 
     // register vector
-    i->iovs[i->count].base = *heads;
-    i->iovs[i->count].size = _hs;
+    i->iovs[i->count].iov_base = *heads;
+    i->iovs[i->count].iov_len = _hs;
     i->count++;
     i->size += _hs;
     *heads = (*heads) + _hs;
@@ -744,18 +1042,18 @@ static void iovs_full(iovs_t* i, xxxx_t* s, uint8_t** heads) {
     iovs_head(i, s, heads);
 
     // data
-    i->iovs[i->count].base = s->atom.data;
-    i->iovs[i->count].size = s->atom.data_size;
+    i->iovs[i->count].iov_base = s->atom.data;
+    i->iovs[i->count].iov_len = s->atom.data_size;
     i->count++;
     i->size += s->atom.data_size;
 }
 
-static void iovs_stsc(iovs_t* i, stxx_t* s, seek_t* start, seek_t* end) {
+static void iovs_stsc(iovs_t* i, stxx_t* s, seek_t* start, seek_t* end, uint8_t** heads) {
     if (VOID(*s)) return;
 
     // pre-bulk data (version, flags, count)
-    i->iovs[i->count].base = s->atom.data;
-    i->iovs[i->count].size = 8;
+    i->iovs[i->count].iov_base = s->atom.data;
+    i->iovs[i->count].iov_len = 8;
     i->count++;
     i->size += 8;
     s->atom.data += 8;
@@ -763,24 +1061,28 @@ static void iovs_stsc(iovs_t* i, stxx_t* s, seek_t* start, seek_t* end) {
 
     // prepending additional stsc entry
     if (start->coxx.offset) {
-        i->iovs[i->count].base = start->stsc_entry;
-        i->iovs[i->count].size = 12;
+        memcpy(*heads, start->stsc_entry, 12);
+        i->iovs[i->count].iov_base = *heads;
+        i->iovs[i->count].iov_len = 12;
         i->count++;
         i->size += 12;
+        *heads = (*heads) + 12;
     }
 
     // bulk data
-    i->iovs[i->count].base = s->atom.data;
-    i->iovs[i->count].size = s->atom.data_size;
+    i->iovs[i->count].iov_base = s->atom.data;
+    i->iovs[i->count].iov_len = s->atom.data_size;
     i->count++;
     i->size += s->atom.data_size;
 
     // prepending additional stsc entry
     if (end->coxx.offset) {
-        i->iovs[i->count].base = end->stsc_entry;
-        i->iovs[i->count].size = 12;
+        memcpy(*heads, end->stsc_entry, 12);
+        i->iovs[i->count].iov_base = *heads;
+        i->iovs[i->count].iov_len = 12;
         i->count++;
         i->size += 12;
+        *heads = (*heads) + 12;
     }
 }
 
@@ -789,21 +1091,19 @@ static void iovs_stsc(iovs_t* i, stxx_t* s, seek_t* start, seek_t* end) {
 /*
  * Delivery functions.
  */
-static void compile_head(stream_t* self, file_t* file) {
+static void compile_head(stream_t* self, file_t* file, runs_t* runs, iovs_t* iovs, uint8_t* heads) {
 
     // initialize
     int i;
-    iovs_t _iovs;
-    ZERO(&_iovs, sizeof(iovs_t));
+    ZERO(iovs, sizeof(iovs_t));
 
-    // initialize atom header buffers
-    uint8_t  _heads_base[70 * 16];                                              // assume 70 16-byte heads
-    uint8_t* _heads = _heads_base;
+    // atom header buffers (and stsc edge entries)
+    uint8_t* _heads = heads;
 
     // gather deta atoms
-    iovs_full(&_iovs, (xxxx_t*)&file->ftyp, &_heads);                           // file compatibility
-    iovs_head(&_iovs, (xxxx_t*)&file->moov, &_heads);                           // movie metadata
-    iovs_full(&_iovs, (xxxx_t*)&file->moov.mvhd, &_heads);                      // metadata header
+    iovs_full(iovs, (xxxx_t*)&file->ftyp, &_heads);                             // file compatibility
+    iovs_head(iovs, (xxxx_t*)&file->moov, &_heads);                             // movie metadata
+    iovs_full(iovs, (xxxx_t*)&file->moov.mvhd, &_heads);                        // metadata header
 
     // gather tracks
     trak_t* ts[2];
@@ -811,64 +1111,1283 @@ static void compile_head(stream_t* self, file_t* file) {
     ts[1] = &file->moov.strak;                                                  // audio track
     for (i = 0; i < 2; i++) {
         if (!VOID(*ts[i])) {
-            iovs_head(&_iovs, (xxxx_t*)ts[i], &_heads);                         // track box
-            iovs_full(&_iovs, (xxxx_t*)&ts[i]->tkhd, &_heads);                  // track header
+            iovs_head(iovs, (xxxx_t*)ts[i], &_heads);                           // track box
+            iovs_full(iovs, (xxxx_t*)&ts[i]->tkhd, &_heads);                    // track header
 
             mdia_t* mdia = &ts[i]->mdia;                                        // mdia alias
-            iovs_head(&_iovs, (xxxx_t*)mdia, &_heads);                          // media box
-            iovs_full(&_iovs, (xxxx_t*)&mdia->mdhd, &_heads);                   // media header
-            iovs_full(&_iovs, (xxxx_t*)&mdia->hdlr, &_heads);                   // media header
+            iovs_head(iovs, (xxxx_t*)mdia, &_heads);                            // media box
+            iovs_full(iovs, (xxxx_t*)&mdia->mdhd, &_heads);                     // media header
+            iovs_full(iovs, (xxxx_t*)&mdia->hdlr, &_heads);                     // media header
 
             minf_t* minf = &ts[i]->mdia.minf;                                   // minf alias
-            iovs_head(&_iovs, (xxxx_t*)minf, &_heads);                          // media information box
-            iovs_full(&_iovs, (xxxx_t*)&minf->xmhd, &_heads);                   // video media header
+            iovs_head(iovs, (xxxx_t*)minf, &_heads);                            // media information box
+            iovs_full(iovs, (xxxx_t*)&minf->xmhd, &_heads);                     // video media header
 
             stbl_t* stbl = &minf->stbl;                                         // stbl alias
-            iovs_head(&_iovs, (xxxx_t*)stbl, &_heads);                          // samples tables
-            iovs_full(&_iovs, (xxxx_t*)&stbl->stsd, &_heads);                   // samples description table
-            iovs_full(&_iovs, (xxxx_t*)&stbl->stts, &_heads);                   // decoding time-to-sample
-            iovs_full(&_iovs, (xxxx_t*)&stbl->stss, &_heads);                   // sync sample table
-            iovs_head(&_iovs, (xxxx_t*)&stbl->stsc, &_heads);                   // sample-to-chunk
-            iovs_stsc(&_iovs, (stxx_t*)&stbl->stsc,                             // stsc with extra entries
-                               &ts[i]->start, &ts[i]->end);
-            iovs_full(&_iovs, (xxxx_t*)&stbl->ctts, &_heads);                   // composition offsets
-            iovs_full(&_iovs, (xxxx_t*)&stbl->stsz, &_heads);                   // sample sizes
-            iovs_full(&_iovs, (xxxx_t*)&stbl->coxx, &_heads);                   // 32bit chunk offsets
+            iovs_head(iovs, (xxxx_t*)stbl, &_heads);                            // samples tables
+            iovs_full(iovs, (xxxx_t*)&stbl->stsd, &_heads);                     // samples description table
+            iovs_full(iovs, (xxxx_t*)&stbl->stts, &_heads);                     // decoding time-to-sample
+            iovs_full(iovs, (xxxx_t*)&stbl->stss, &_heads);                     // sync sample table
+            iovs_head(iovs, (xxxx_t*)&stbl->stsc, &_heads);                     // sample-to-chunk
+            iovs_stsc(iovs, (stxx_t*)&stbl->stsc,                               // stsc with extra entries
+                            &ts[i]->start, &ts[i]->end, &_heads);
+            iovs_full(iovs, (xxxx_t*)&stbl->ctts, &_heads);                     // composition offsets
+            iovs_full(iovs, (xxxx_t*)&stbl->stsz, &_heads);                     // sample sizes
+            iovs_full(iovs, (xxxx_t*)&stbl->coxx, &_heads);                     // 32bit chunk offsets
         }
     }
 
     // gather media data
-    iovs_head(&_iovs, (xxxx_t*)&file->mdat, &_heads);                           // media data
+    iovs_head(iovs, (xxxx_t*)&file->mdat, &_heads);                             // media data
 
     // relocate sample chunks
-    relocate_trak(self, file, &file->moov.vtrak, _iovs.size);                   // video trak
-    relocate_trak(self, file, &file->moov.strak, _iovs.size);                   // sound trak
+    relocate_trak(self, file, &file->moov.vtrak, runs, iovs->size);             // video trak
+    relocate_trak(self, file, &file->moov.strak, runs, iovs->size);             // sound trak
+}
+
+static void compile_http(stream_t* self, iovs_t* iovs, off_t length) {
+    int i;
+
+    // type
+    const char* mime = (self->format == STREAM_FORMAT_HLS) ? STREAM_MP4_HLS_MIME :
+                       (self->format == STREAM_FORMAT_DASH) ? STREAM_MP4_DASH_MIME : STREAM_MP4_MIME;
+
+    // length of file data (fragment sizes are only known while sending, so end with the connection)
+    char* size = (length < 0) ?
+        FORMAT("Connection: close\n") :
+        FORMAT("Content-Length: %llu\n", (unsigned long long)(length + iovs->size));
+
+    // caching (segmented output never changes for the same file)
+    char* cache = (self->format == STREAM_FORMAT_HLS || self->format == STREAM_FORMAT_DASH ||
+                   self->format == STREAM_FORMAT_SEGMENT) ?
+        FORMAT("Cache-Control: public, max-age=%d\n", STREAM_MP4_MAX_AGE) :
+        FORMAT("Cache-Control: no-store, no-cache, must-revalidate, post-check=0, pre-check=0\n"
+               "Expires: Mon, 29 Mar 1982 12:00:00 GMT\n");
 
     // generate HTTP headers
-    char* head = FORMAT("HTTP/%s 200 OK\n"
+    char* http = FORMAT("HTTP/%s 200 OK\n"
                         "Content-Type: %s\n"
-                        "Content-Length: %llu\n"
-                        "Cache-Control: no-store, no-cache, must-revalidate, post-check=0, pre-check=0\n"
-                        "Expires: Mon, 29 Mar 1982 12:00:00 GMT\n"
+                        "%s"
+                        "%s"
                         "Server: %s %s\n\n",
-                        self->http, STREAM_MP4_MIME,
-                        (unsigned long long)(self->file_finish - self->file_offset + _iovs.size),
+                        self->http, mime, size, cache,
                         ID_NAME, ID_VERSION);
-    size_t head_length = strlen(head);
+    FREE(size);
+    FREE(cache);
 
-    // prepare headers
+    // send headers, then atoms (straight from their buffers)
+    self->head_length = 0;
     self->head_offset = 0;
-    self->head_length = head_length + _iovs.size;
-    self->head = (char*)ALLOC(self->head_length);
-    memcpy(self->head, head, head_length);
-    FREE(head);
-    head = self->head + head_length;
+    stream_head_add(self, http, strlen(http));
+    stream_head_keep(self, http);
+    for (i = 0; i < iovs->count; i++) {
+        stream_head_add(self, iovs->iovs[i].iov_base, iovs->iovs[i].iov_len);
+    }
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Fragmented delivery functions. The init segment holds the movie with empty
+ * sample tables (and the mvex defaults) and every fragment is a moof atom,
+ * built from the seek indexes, followed by the header of an mdat atom whose
+ * payload is the untouched byte range of the file (sent using sendfile() like
+ * the progressive output). Fragments end where the first video keyframe past
+ * STREAM_MP4_FRAGMENT seconds is stored, so the samples of all tracks that
+ * are found in that byte range are described by one track run per chunk.
+ */
+static uint64_t locate_sample(stbl_t* stbl, uint64_t sample) {
+    tidx_t*  x = &stbl->index;
+    uint32_t i = search_index(x->stsc_samples, stbl->stsc.count, sample);
+    uint64_t n, c, d, chunk;
+
+    // past all samples
+    if (i >= stbl->stsc.count) return stbl->max_offset;
+
+    // chunk and sample within chunk
+    n = i ? x->stsc_samples[i - 1] : 0;                                         // samples before entry
+    c = x->stsc_sizes[i];                                                       // samples per chunk
+    d = sample - n;                                                             // sample within entry
+    chunk = x->stsc_chunks[i] + d / c;                                          // chunk number
+    d = d % c;                                                                  // sample within chunk
+    if (chunk >= stbl->max_chunks) return stbl->max_offset;
+
+    // offset
+    if (stbl->stsz.size) {
+        return x->coxx_offsets[chunk] + d * stbl->stsz.size;
+    }
+    return x->coxx_offsets[chunk] + x->stsz_offsets[sample] - x->stsz_offsets[sample - d];
+}
+
+static void cursor_init(cursor_t* c, trak_t* trak) {
+    ZERO(c, sizeof(cursor_t));
+    if (VOID(*trak)) return;
+
+    // track
+    stbl_t*  stbl = &trak->mdia.minf.stbl;
+    tidx_t*  x = &stbl->index;
+    uint64_t n, d;
+    c->trak = trak;
+    c->id = read_32(&trak->tkhd.atom.data[trak->tkhd.version ? 20 : 12]);
+    c->sample = trak->start.stsz.index;
+    c->samples = MIN(trak->end.stsz.index, stbl->max_samples);
+    c->time = trak->start.time;
+
+    // table entries of the first sample
+    c->stts = search_index(x->stts_samples, stbl->stts.count, c->sample);
+    c->ctts = search_index(x->ctts_samples, stbl->ctts.count, c->sample);
+    c->stss = c->sample ? search_index(x->stss_samples, stbl->stss.count, c->sample - 1) : 0;
+    c->stsc = search_index(x->stsc_samples, stbl->stsc.count, c->sample);
+    if (c->stsc < stbl->stsc.count) {
+        n = c->stsc ? x->stsc_samples[c->stsc - 1] : 0;                         // samples before entry
+        d = c->sample - n;                                                      // sample within entry
+        c->chunk = x->stsc_chunks[c->stsc] + d / x->stsc_sizes[c->stsc];        // chunk number
+        c->chunk_sample = c->sample - d % x->stsc_sizes[c->stsc];               // first sample in chunk
+    } else {
+        c->chunk = stbl->max_chunks;
+        c->chunk_sample = c->sample;
+    }
+}
+
+static void cursor_sample(cursor_t* c, uint64_t* offset, uint64_t* size) {
+    stbl_t* stbl = &c->trak->mdia.minf.stbl;
+    tidx_t* x = &stbl->index;
+
+    // size
+    if (stbl->stsz.size) {
+        *size = stbl->stsz.size;
+    } else {
+        *size = (c->sample < stbl->stsz.count) ?
+                x->stsz_offsets[c->sample + 1] - x->stsz_offsets[c->sample] : 0;
+    }
+
+    // offset
+    if (c->chunk >= stbl->max_chunks) {
+        *offset = stbl->max_offset;
+    } else if (stbl->stsz.size) {
+        *offset = x->coxx_offsets[c->chunk] + (c->sample - c->chunk_sample) * stbl->stsz.size;
+    } else {
+        *offset = x->coxx_offsets[c->chunk] + x->stsz_offsets[c->sample] - x->stsz_offsets[c->chunk_sample];
+    }
+}
+
+static void cursor_next(cursor_t* c) {
+    stbl_t* stbl = &c->trak->mdia.minf.stbl;
+    tidx_t* x = &stbl->index;
+
+    // time
+    if (c->stts < stbl->stts.count) {
+        c->time += x->stts_durations[c->stts];
+    }
+
+    // sample
+    c->sample++;
+    while (c->stts < stbl->stts.count && x->stts_samples[c->stts] <= c->sample) c->stts++;
+    while (c->ctts < stbl->ctts.count && x->ctts_samples[c->ctts] <= c->sample) c->ctts++;
+    while (c->stss < stbl->stss.count && x->stss_samples[c->stss] < c->sample) c->stss++;
+
+    // chunk
+    if (c->stsc < stbl->stsc.count && (c->sample - c->chunk_sample) >= x->stsc_sizes[c->stsc]) {
+        c->chunk_sample = c->sample;
+        c->chunk++;
+        while (c->stsc < stbl->stsc.count && x->stsc_chunks[c->stsc + 1] <= c->chunk) c->stsc++;
+    }
+}
+
+static uint32_t cursor_flags(cursor_t* c) {
+    stbl_t* stbl = &c->trak->mdia.minf.stbl;
+    if (c->stss < stbl->stss.count && stbl->index.stss_samples[c->stss] == c->sample) {
+        return 0x02000000;                                                      // sync sample
+    }
+    return 0x01010000;                                                          // dependent, non-sync
+}
+
+static uint32_t cursor_composition(cursor_t* c) {
+    stbl_t* stbl = &c->trak->mdia.minf.stbl;
+    return (c->ctts < stbl->ctts.count) ? read_32(&stbl->ctts.data[(c->ctts << 3) + 4]) : 0;
+}
+
+static uint32_t cursor_fields(cursor_t* c) {
+    stbl_t*  stbl = &c->trak->mdia.minf.stbl;
+    uint32_t fields = 0x000001 | 0x000100 | 0x000200;                           // offset, duration, size
+    if (!VOID(stbl->stss)) fields |= 0x000400;                                  // flags (keyframes)
+    if (!VOID(stbl->ctts)) fields |= 0x000800;                                  // composition offsets
+    return fields;
+}
+
+static uint8_t* box_open(uint8_t** p, uint32_t type) {
+    uint8_t* box = *p;
+    write_32(box + 4, type);
+    *p += 8;
+    return box;
+}
+
+static void box_close(uint8_t* box, uint8_t* p) {
+    write_32(box, p - box);
+}
+
+static void box_word(uint8_t** p, uint32_t value) {
+    write_32(*p, value);
+    *p += 4;
+}
+
+static void box_copy(uint8_t** p, xxxx_t* s) {
+    if (VOID(*s)) return;
+    write_32(*p, s->atom.data_size + 8);
+    write_32(*p + 4, s->atom.type);
+    memcpy(*p + 8, s->atom.data, s->atom.data_size);
+    *p += s->atom.data_size + 8;
+}
+
+static size_t box_size(xxxx_t* s) {
+    return VOID(*s) ? 0 : s->atom.data_size + 8;
+}
+
+static void box_empty(uint8_t** p, uint32_t type, int words) {
+    uint8_t* box = box_open(p, type);
+    for (; words > 0; words--) {
+        box_word(p, 0);
+    }
+    box_close(box, *p);
+}
+
+static uint8_t* compile_moof(stream_t* self, frag_t* frag, size_t* head_size) {
+    uint8_t* box[4];
+    uint64_t offset, size, finish, time;
+    uint64_t counts[2], runs[2], end;
+    uint32_t i, j, k, fields;
+
+    // main track (video unless missing)
+    cursor_t* m = frag->cursors[0].trak ? &frag->cursors[0] : &frag->cursors[1];
+    if (!m->trak) return NULL;
+    stbl_t*   stbl = &m->trak->mdia.minf.stbl;
+    tidx_t*   x = &stbl->index;
+
+    // end sample (first keyframe past the fragment duration, segments are a single fragment)
+    time = m->time + (uint64_t)(STREAM_MP4_FRAGMENT * m->trak->mdia.mdhd.scale);
+    i = search_index(x->stts_times, stbl->stts.count, time);
+    if (frag->segment >= 0) {
+        end = m->samples;
+    } else if (i < stbl->stts.count) {
+        end = (i ? x->stts_samples[i - 1] : 0) +
+              (time - (i ? x->stts_times[i - 1] : 0)) / x->stts_durations[i];
+    } else {
+        end = stbl->max_samples;
+    }
+    end = MAX(end, m->sample + 1);
+    if (stbl->stss.count && end < m->samples) {
+        i = search_index(x->stss_samples, stbl->stss.count, end - 1);
+        end = (i < stbl->stss.count) ? x->stss_samples[i] : m->samples;
+    }
+
+    // end offset (rest of the file for the last fragment)
+    finish = (end < m->samples) ? locate_sample(stbl, end) : self->file_finish;
+    if (finish <= self->file_offset || finish > self->file_finish) {
+        finish = self->file_finish;
+    }
+
+    // measure (samples and runs stored within the fragment, for each track)
+    uint64_t moof_size = 8 + 16;
+    for (i = 0; i < 2; i++) {
+        cursor_t c = frag->cursors[i];
+        uint64_t last = 0;
+        counts[i] = runs[i] = 0;
+        for (; c.trak && c.sample < c.samples; cursor_next(&c)) {
+            cursor_sample(&c, &offset, &size);
+            if (offset >= finish) break;
+            runs[i] += !counts[i] || offset != last;
+            counts[i]++;
+            last = offset + size;
+        }
+        if (counts[i]) {
+            fields = cursor_fields(&frag->cursors[i]);
+            moof_size += 8 + 20 + 20 + runs[i] * 20 +
+                         counts[i] * (8 + ((fields & 0x000400) ? 4 : 0) + ((fields & 0x000800) ? 4 : 0));
+        }
+    }
+    if (moof_size > UINT32_MAX) return NULL;
+
+    // allocate (moof and mdat header)
+    uint64_t mdat_size = finish - self->file_offset;
+    *head_size = moof_size + ((mdat_size + 8 > UINT32_MAX) ? 16 : 8);
+    uint8_t* head = (uint8_t*)ALLOC(*head_size);
+    uint8_t* p = head;
+
+    // moof, mfhd
+    box[0] = box_open(&p, MOOF);
+    box[1] = box_open(&p, MFHD);
+    box_word(&p, 0);
+    box_word(&p, ++frag->sequence);
+    box_close(box[1], p);
+
+    // traf
+    for (i = 0; i < 2; i++) {
+        cursor_t* c = &frag->cursors[i];
+        if (!counts[i]) continue;
+        fields = cursor_fields(c);
+        box[1] = box_open(&p, TRAF);
+
+        // tfhd (default-base-is-moof, sync samples unless flagged)
+        box[2] = box_open(&p, TFHD);
+        box_word(&p, 0x020020);
+        box_word(&p, c->id);
+        box_word(&p, 0x02000000);
+        box_close(box[2], p);
+
+        // tfdt (segments keep the movie timeline, fragments start at zero)
+        box[2] = box_open(&p, TFDT);
+        box_word(&p, 0x01000000);
+        write_64(p, c->time - ((frag->segment < 0) ? c->trak->start.time : 0));
+        p += 8;
+        box_close(box[2], p);
+
+        // trun (one per contiguous run of samples)
+        uint64_t last = 0;
+        box[2] = NULL;
+        for (j = 0, k = 0; j < counts[i]; j++, cursor_next(c)) {
+            cursor_sample(c, &offset, &size);
+            if (offset < self->file_offset || offset + size > finish) {         // not in this fragment
+                FREE(head);
+                return NULL;
+            }
+            if (!box[2] || offset != last) {
+                if (box[2]) {
+                    write_32(box[2] + 12, k);
+                    box_close(box[2], p);
+                }
+                box[2] = box_open(&p, TRUN);
+                box_word(&p, (c->trak->mdia.minf.stbl.ctts.version ? 0x01000000 : 0) | fields);
+                box_word(&p, 0);
+                box_word(&p, *head_size + (offset - self->file_offset));
+                k = 0;
+            }
+            box_word(&p, (c->stts < c->trak->mdia.minf.stbl.stts.count) ?
+                         c->trak->mdia.minf.stbl.index.stts_durations[c->stts] : 0);
+            box_word(&p, size);
+            if (fields & 0x000400) box_word(&p, cursor_flags(c));
+            if (fields & 0x000800) box_word(&p, cursor_composition(c));
+            last = offset + size;
+            k++;
+        }
+        write_32(box[2] + 12, k);
+        box_close(box[2], p);
+        box_close(box[1], p);
+    }
+    box_close(box[0], p);
+
+    // mdat header
+    if (*head_size - moof_size > 8) {
+        write_32(p, 1);
+        write_32(p + 4, MDAT);
+        write_64(p + 8, mdat_size + 16);
+    } else {
+        write_32(p, mdat_size + 8);
+        write_32(p + 4, MDAT);
+    }
+
+    // ready
+    self->fragment_finish = finish;
+    return head;
+}
+
+static int compile_fragment(stream_t* self, int release) {
+    frag_t* frag = (frag_t*)self->fragment_state;
+
+    // release
+    if (release) {
+        if (frag) {
+            FREE(frag->moov);
+            FREE(frag->model);
+            FREE(frag);
+        }
+        self->fragment_state = NULL;
+        return 0;
+    }
+
+    // compile and send
+    size_t   size = 0;
+    uint8_t* head = compile_moof(self, frag, &size);
+    if (!head) return 1;
+    stream_head_add(self, head, size);
+    stream_head_keep(self, head);
+    return 0;
+}
+
+static void seek_frag(stream_t* self, frag_t* frag) {
+    file_t* file = &frag->file;
+
+    // perform seek on each track
+    seek_trak(self, file, &file->moov.vtrak);
+    seek_trak(self, file, &file->moov.strak);
+    cursor_init(&frag->cursors[0], &file->moov.vtrak);
+    cursor_init(&frag->cursors[1], &file->moov.strak);
+
+    // nothing sent yet
+    self->fragment_finish = self->file_offset;
+    frag->sequence = MAX(frag->segment, 0);
+}
+
+static void compile_init(stream_t* self, frag_t* frag, iovs_t* iovs) {
+    file_t*  file = &frag->file;
+    uint8_t* box[6];
+    int      i;
+
+    // ajust movie timeline (longest track)
+    file->moov.mvhd.duration = MAX(file->moov.strak.tkhd.duration,
+                                   file->moov.vtrak.tkhd.duration);
+    write_time(&file->moov.mvhd, 16, 24);
+
+    // allocate (copied atoms, containers and empty tables)
+    size_t size = file->ftyp.atom.size + file->moov.mvhd.atom.size + 8 + 8;
+    for (i = 0; i < 2; i++) {
+        cursor_t* c = &frag->cursors[i];
+        if (!c->trak) continue;
+        size += c->trak->tkhd.atom.size + c->trak->mdia.mdhd.atom.size + c->trak->mdia.hdlr.atom.size +
+                c->trak->mdia.minf.xmhd.atom.size + c->trak->mdia.minf.stbl.stsd.atom.size +
+                4 * 8 + 36 + 16 + 16 + 20 + 16 + 32;
+    }
+    uint8_t* init = (uint8_t*)ALLOC(size);
+    uint8_t* p = init;
+
+    // ftyp, moov, mvhd
+    box_copy(&p, &file->ftyp);
+    box[0] = box_open(&p, MOOV);
+    box_copy(&p, (xxxx_t*)&file->moov.mvhd);
+
+    // tracks (samples tables are left empty)
+    for (i = 0; i < 2; i++) {
+        cursor_t* c = &frag->cursors[i];
+        if (!c->trak) continue;
+        box[1] = box_open(&p, TRAK);
+        box_copy(&p, (xxxx_t*)&c->trak->tkhd);
+        box[2] = box_open(&p, MDIA);
+        box_copy(&p, (xxxx_t*)&c->trak->mdia.mdhd);
+        box_copy(&p, &c->trak->mdia.hdlr);
+        box[3] = box_open(&p, MINF);
+        box_copy(&p, &c->trak->mdia.minf.xmhd);
+        box[4] = box_open(&p, DINF);
+        box[5] = box_open(&p, DREF);
+        box_word(&p, 0);
+        box_word(&p, 1);
+        uint8_t* url = box_open(&p, URL_);
+        box_word(&p, 1);                                                        // self-contained
+        box_close(url, p);
+        box_close(box[5], p);
+        box_close(box[4], p);
+        box[4] = box_open(&p, STBL);
+        box_copy(&p, &c->trak->mdia.minf.stbl.stsd);
+        box_empty(&p, STTS, 2);
+        box_empty(&p, STSC, 2);
+        box_empty(&p, STSZ, 3);
+        box_empty(&p, STCO, 2);
+        box_close(box[4], p);
+        box_close(box[3], p);
+        box_close(box[2], p);
+        box_close(box[1], p);
+    }
+
+    // track defaults
+    box[1] = box_open(&p, MVEX);
+    for (i = 0; i < 2; i++) {
+        cursor_t* c = &frag->cursors[i];
+        if (!c->trak) continue;
+        box[2] = box_open(&p, TREX);
+        box_word(&p, 0);
+        box_word(&p, c->id);
+        box_word(&p, 1);                                                        // sample description
+        box_word(&p, 0);
+        box_word(&p, 0);
+        box_word(&p, 0);
+        box_close(box[2], p);
+    }
+    box_close(box[1], p);
+    box_close(box[0], p);
+
+    // single vector
+    ZERO(iovs, sizeof(iovs_t));
+    iovs->iovs[0].iov_base = init;
+    iovs->iovs[0].iov_len = p - init;
+    iovs->count = 1;
+    iovs->size = p - init;
+    stream_head_keep(self, init);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Segmented delivery functions. Segment start times are computed once per
+ * title ("segments": scale, duration and the decoding time each segment
+ * starts at) on the keyframes of the video track, at least STREAM_MP4_SEGMENT
+ * seconds apart. Playlists refer to the segments of the same resource with
+ * relative query-only URLs ("?format=fmp4&segment=N", followed by the other
+ * arguments of the playlist request, such as access tokens) and each segment
+ * is a single fragment that keeps the movie timeline.
+ */
+static uint64_t* compile_segments(file_t* file, uint64_t* keys, int keys_size, int* size) {
+    trak_t*  trak = VOID(file->moov.vtrak) ? &file->moov.strak : &file->moov.vtrak;
+    uint64_t scale = trak->mdia.mdhd.scale;
+    uint64_t duration = MIN(trak->mdia.mdhd.duration, trak->mdia.minf.stbl.max_time);
+    uint64_t step = MAX((uint64_t)(STREAM_MP4_SEGMENT * scale), 1);
+    uint64_t t;
+    int      count = (keys && keys_size > sizeof(uint64_t) * 3) ? keys_size / sizeof(uint64_t) - 3 : 0;
+    int      i, n = 0;
+
+    // layout: scale, duration, segment start times
+    uint64_t* segments = (uint64_t*)ALLOC(sizeof(uint64_t) * (3 + MAX(count, duration / step + 1)));
+    segments[0] = scale;
+    segments[1] = duration;
+
+    // on keyframes (or evenly if all samples are keyframes)
+    if (count) {
+        for (i = 0; i < count && keys[3 + i] < duration; i++) {
+            if (!n || keys[3 + i] >= segments[1 + n] + step) {
+                segments[2 + n++] = keys[3 + i];
+            }
+        }
+    } else {
+        for (t = 0; t < duration; t += step) {
+            segments[2 + n++] = t;
+        }
+    }
+    if (!n) {
+        segments[2 + n++] = 0;
+    }
+
+    // ready
+    *size = sizeof(uint64_t) * (2 + n);
+    return segments;
+}
 
-    // assemble headers
-    for (i = 0; i < _iovs.count; i++) {
-        memcpy(head, _iovs.iovs[i].base, _iovs.iovs[i].size);
-        head += _iovs.iovs[i].size;
+static uint8_t* find_box(uint8_t* p, uint8_t* end, uint32_t type) {
+    while (p + 8 <= end) {
+        uint32_t size = read_32(p);
+        if (size < 8 || size > end - p) return NULL;
+        if (read_32(p + 4) == type) return p;
+        p += size;
     }
+    return NULL;
+}
+
+static uint8_t* find_descriptor(uint8_t* p, uint8_t* end, uint8_t tag) {
+    uint32_t i;
+    if (p >= end || *p++ != tag) return NULL;
+    for (i = 0; i < 4 && p < end && (*p++ & 0x80); i++);                        // skip length
+    return p;
+}
+
+static void compile_codec(trak_t* trak, char* codec, size_t size) {
+    xxxx_t*  stsd = &trak->mdia.minf.stbl.stsd;
+    uint8_t* p, *q, *end;
+    uint32_t type;
+    char     name[5];
+
+    // first sample entry
+    codec[0] = 0;
+    if (VOID(*stsd) || stsd->atom.data_size < 16) return;
+    p = stsd->atom.data + 8;
+    end = stsd->atom.data + stsd->atom.data_size;
+    if (read_32(p) < 8 || read_32(p) > end - p) return;
+    end = p + read_32(p);
+    type = read_32(p + 4);
+    write_32((uint8_t*)name, type);
+    name[4] = 0;
+    snprintf(codec, size, "%s", name);
+
+    // AVC: profile, compatibility and level
+    if ((type == AVC1 || type == AVC3) && end - p > 86 && (q = find_box(p + 86, end, AVCC))) {
+        if (q + 12 <= end) {
+            snprintf(codec, size, "%s.%02x%02x%02x", name, q[9], q[10], q[11]);
+        }
+    }
+
+    // MPEG-4 audio: object type (and audio object type)
+    if (type == MP4A && end - p > 36) {
+        uint32_t version = ((uint32_t)p[16] << 8) | p[17];                      // sound entry version
+        q = p + 36 + ((version == 1) ? 16 : (version == 2) ? 36 : 0);
+        if (q < end && (q = find_box(q, end, ESDS))) {
+            q = find_descriptor(q + 12, end, 0x03);                             // ES descriptor
+            if (q && q + 3 <= end) {
+                uint8_t flags = q[2];
+                q += 3;
+                q += (flags & 0x80) ? 2 : 0;                                    // depends on ES id
+                q += (flags & 0x40 && q < end) ? 1 + *q : 0;                    // URL
+                q += (flags & 0x20) ? 2 : 0;                                    // OCR ES id
+                q = find_descriptor(q, end, 0x04);                              // decoder configuration
+            }
+            if (q && q + 13 < end) {
+                uint8_t object = q[0];
+                q = (object == 0x40) ? find_descriptor(q + 13, end, 0x05) : NULL; // decoder specific info
+                if (q && q + 2 <= end) {
+                    uint32_t aot = q[0] >> 3;
+                    aot = (aot == 31) ? 32 + (((q[0] & 0x07) << 3) | (q[1] >> 5)) : aot;
+                    snprintf(codec, size, "%s.%02x.%u", name, object, aot);
+                } else {
+                    snprintf(codec, size, "%s.%02x", name, object);
+                }
+            }
+        }
+    }
+}
+
+static char* compile_query(stream_t* self, int xml) {
+    const char* q = self->query ? self->query : "";
+    char*       query = (char*)ALLOC(5 * strlen(q) + 8);
+    char*       p = query;
+
+    // carried over arguments (quotes never end the quoted URLs, XML escaped if needed)
+    if (*q) {
+        p += sprintf(p, xml ? "&amp;" : "&");
+    }
+    for (; *q; q++) {
+        if (*q == '"') {
+            p += sprintf(p, "%%22");
+        } else if (xml && *q == '&') {
+            p += sprintf(p, "&amp;");
+        } else if (xml && *q == '<') {
+            p += sprintf(p, "&lt;");
+        } else {
+            *p++ = *q;
+        }
+    }
+    *p = 0;
+    return query;
+}
+
+static char* compile_playlist(stream_t* self, file_t* file, uint64_t* segments, int segments_size) {
+    int      count = segments_size / sizeof(uint64_t) - 2;
+    uint64_t scale = segments[0];
+    uint64_t duration = segments[1];
+    uint64_t d, longest = 0;
+    int      i, r;
+
+    // query arguments of the playlist, repeated on every segment URL (tokens etc.)
+    char* query = compile_query(self, self->format == STREAM_FORMAT_DASH);
+
+    // allocate (generous line sizes)
+    char* playlist = (char*)ALLOC(1024 + (96 + strlen(query)) * (count + 1));
+    char* p = playlist;
+
+    // HLS media playlist (fragmented MP4 segments)
+    if (self->format == STREAM_FORMAT_HLS) {
+        for (i = 0; i < count; i++) {
+            d = ((i + 1 < count) ? segments[3 + i] : duration) - segments[2 + i];
+            longest = MAX(longest, d);
+        }
+        p += sprintf(p, "#EXTM3U\n"
+                        "#EXT-X-VERSION:7\n"
+                        "#EXT-X-TARGETDURATION:%llu\n"
+                        "#EXT-X-MEDIA-SEQUENCE:0\n"
+                        "#EXT-X-PLAYLIST-TYPE:VOD\n"
+                        "#EXT-X-INDEPENDENT-SEGMENTS\n"
+                        "#EXT-X-MAP:URI=\"?format=fmp4&segment=init%s\"\n",
+                        (unsigned long long)((longest + scale - 1) / scale), query);
+        for (i = 0; i < count; i++) {
+            d = ((i + 1 < count) ? segments[3 + i] : duration) - segments[2 + i];
+            p += sprintf(p, "#EXTINF:%.3f,\n?format=fmp4&segment=%d%s\n", (double)d / scale, i, query);
+        }
+        p += sprintf(p, "#EXT-X-ENDLIST\n");
+        FREE(query);
+        return playlist;
+    }
+
+    // codecs
+    char codecs[72], codec[32];
+    codecs[0] = 0;
+    if (!VOID(file->moov.vtrak)) {
+        compile_codec(&file->moov.vtrak, codec, sizeof(codec));
+        strcat(codecs, codec);
+    }
+    if (!VOID(file->moov.strak)) {
+        compile_codec(&file->moov.strak, codec, sizeof(codec));
+        strcat(codecs, codecs[0] ? "," : "");
+        strcat(codecs, codec);
+    }
+
+    // DASH manifest (segment timeline, equal consecutive durations merged)
+    double seconds = (double)duration / scale;
+    p += sprintf(p, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"static\" "
+                    "profiles=\"urn:mpeg:dash:profile:isoff-live:2011\" "
+                    "mediaPresentationDuration=\"PT%.3fS\" minBufferTime=\"PT%.1fS\">\n"
+                    " <Period start=\"PT0S\">\n"
+                    "  <AdaptationSet segmentAlignment=\"true\">\n"
+                    "   <Representation id=\"0\" mimeType=\"%s\" codecs=\"%s\" bandwidth=\"%llu\">\n"
+                    "    <SegmentTemplate timescale=\"%llu\" startNumber=\"0\" "
+                    "initialization=\"?format=fmp4&amp;segment=init%s\" "
+                    "media=\"?format=fmp4&amp;segment=$Number$%s\">\n"
+                    "     <SegmentTimeline>\n",
+                    seconds, STREAM_MP4_SEGMENT, STREAM_MP4_MIME, codecs,
+                    (unsigned long long)(seconds > 0 ? self->file_length * 8 / seconds : 0),
+                    (unsigned long long)scale, query, query);
+    for (i = 0; i < count; i += r + 1) {
+        d = ((i + 1 < count) ? segments[3 + i] : duration) - segments[2 + i];
+        for (r = 0; i + r + 2 < count && segments[4 + i + r] - segments[3 + i + r] == d; r++);
+        if (r) {
+            p += sprintf(p, "      <S t=\"%llu\" d=\"%llu\" r=\"%d\"/>\n",
+                         (unsigned long long)segments[2 + i], (unsigned long long)d, r);
+        } else {
+            p += sprintf(p, "      <S t=\"%llu\" d=\"%llu\"/>\n",
+                         (unsigned long long)segments[2 + i], (unsigned long long)d);
+        }
+    }
+    p += sprintf(p, "     </SegmentTimeline>\n"
+                    "    </SegmentTemplate>\n"
+                    "   </Representation>\n"
+                    "  </AdaptationSet>\n"
+                    " </Period>\n"
+                    "</MPD>\n");
+    FREE(query);
+    return playlist;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Track selection functions. The movie only holds the selected track and its
+ * mdat is made of the byte ranges where that track's samples are stored, in
+ * file order, so the data of the other track is skipped between ranges while
+ * throttling still follows file offsets (those of the selected track).
+ */
+static runs_t* compile_runs(trak_t* trak) {
+    cursor_t c;
+    uint64_t offset, size;
+    size_t   allocated = 0;
+    runs_t*  runs = (runs_t*)ZALLOC(sizeof(runs_t));
+
+    // walk the (seeked) samples
+    cursor_init(&c, trak);
+    for (; c.sample < c.samples; cursor_next(&c)) {
+        cursor_sample(&c, &offset, &size);
+        if (!size) continue;
+
+        // merge contiguous samples
+        if (runs->count && runs->ranges[2 * runs->count - 1] == offset) {
+            runs->ranges[2 * runs->count - 1] += size;
+            runs->size += size;
+            continue;
+        }
+
+        // ranges are only sent forward
+        if (runs->count && runs->ranges[2 * runs->count - 1] > offset) {
+            FREE(runs->ranges);
+            FREE(runs);
+            return NULL;
+        }
+
+        // new range
+        if (runs->count == allocated) {
+            allocated = allocated ? allocated * 2 : 256;
+            runs->ranges = (off_t*)REALLOC(runs->ranges, sizeof(off_t) * 2 * allocated);
+        }
+        runs->ranges[2 * runs->count] = offset;
+        runs->ranges[2 * runs->count + 1] = offset + size;
+        runs->count++;
+        runs->size += size;
+    }
+    return runs;
+}
+
+static runs_t* map_runs(off_t* ranges, int size) {
+    size_t  i;
+    runs_t* runs = (runs_t*)ZALLOC(sizeof(runs_t));
+    runs->ranges = ranges;
+    runs->count = size / (sizeof(off_t) * 2);
+    for (i = 0; i < runs->count; i++) {
+        runs->size += ranges[2 * i + 1] - ranges[2 * i];
+    }
+    return runs;
+}
+
+static int compile_range(stream_t* self, int release) {
+    runs_t* runs = (runs_t*)self->fragment_state;
+
+    // release
+    if (release) {
+        if (runs) {
+            FREE(runs->ranges);
+            FREE(runs);
+        }
+        self->fragment_state = NULL;
+        return 0;
+    }
+
+    // skip to next range
+    if (++runs->index >= runs->count) return 1;
+    self->file_offset = runs->ranges[2 * runs->index];
+    self->fragment_finish = runs->ranges[2 * runs->index + 1];
+    return 0;
+}
+
+static off_t send_runs(stream_t* self, runs_t* runs) {
+    off_t size = runs->size;
+
+    // file limits
+    self->file_offset = runs->count ? runs->ranges[0] : 0;
+    self->file_finish = runs->count ? runs->ranges[2 * runs->count - 1] : 0;
+
+    // a single range is sent as it is
+    if (runs->count > 1) {
+        self->fragment = compile_range;
+        self->fragment_state = runs;
+        self->fragment_finish = runs->ranges[1];
+    } else {
+        FREE(runs->ranges);
+        FREE(runs);
+    }
+    return size;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Trick-play functions. Only every Nth keyframe of the video track (within
+ * the requested times) is kept, each lasting until the next one kept, in a
+ * movie of its own (one sample per chunk, all of them sync samples) whose
+ * mdat is made of the byte ranges of those keyframes (see runs_t).
+ */
+static void trick_table(uint8_t** p, uint32_t type, uint8_t version, uint32_t* values, uint32_t count, uint32_t entries) {
+    uint32_t i, n;
+    uint8_t* box = box_open(p, type);
+    box_word(p, (uint32_t)version << 24);                                       // version (signed offsets if 1)
+    box_word(p, entries);
+    for (i = 0; i < count; i += n) {
+        for (n = 1; i + n < count && values[i + n] == values[i]; n++);         // run of equal values
+        box_word(p, n);
+        box_word(p, values[i]);
+    }
+    box_close(box, *p);
+}
+
+static uint32_t trick_entries(uint32_t* values, uint32_t count) {
+    uint32_t i, entries = count ? 1 : 0;
+    for (i = 1; i < count; i++) {
+        entries += (values[i] != values[i - 1]);
+    }
+    return entries;
+}
+
+static runs_t* compile_trick(stream_t* self, file_t* file, int every, iovs_t* iovs) {
+    trak_t*  trak = &file->moov.vtrak;
+    stbl_t*  stbl = &trak->mdia.minf.stbl;
+    tidx_t*  x = &stbl->index;
+    uint8_t* box[5];
+    uint64_t k, n, t, size, offset, duration = 0;
+    uint32_t i, j, count = 0;
+
+    // keyframes of the video track only
+    if (VOID(*trak) || VOID(stbl->stss) || every < 1) return NULL;
+    ZERO(&file->moov.strak, sizeof(trak_t));
+    seek_trak(self, file, trak);
+
+    // kept keyframes (within the seek points)
+    uint64_t first = trak->start.stsz.index;
+    uint64_t last = MIN(trak->end.stsz.index, stbl->max_samples);
+    i = first ? search_index(x->stss_samples, stbl->stss.count, first - 1) : 0;
+    uint32_t  total = (i < stbl->stss.count) ? (stbl->stss.count - i + every - 1) / every : 0;
+    uint64_t* times = (uint64_t*)ALLOC(sizeof(uint64_t) * (total + 1));
+    uint32_t* durations = (uint32_t*)ALLOC(sizeof(uint32_t) * (total + 1));
+    uint32_t* compositions = (uint32_t*)ALLOC(sizeof(uint32_t) * (total + 1));
+    uint32_t* sizes = (uint32_t*)ALLOC(sizeof(uint32_t) * (total + 1));
+    runs_t*   runs = (runs_t*)ZALLOC(sizeof(runs_t));
+    runs->ranges = (off_t*)ALLOC(sizeof(off_t) * 2 * (total + 1));
+    for (; i < stbl->stss.count && x->stss_samples[i] < last; i += every, count++) {
+        k = x->stss_samples[i];
+
+        // decoding time
+        j = search_index(x->stts_samples, stbl->stts.count, k);
+        n = j ? x->stts_samples[j - 1] : 0;
+        t = j ? x->stts_times[j - 1] : 0;
+        times[count] = (j < stbl->stts.count) ? t + (k - n) * x->stts_durations[j] : t;
+        durations[count] = (j < stbl->stts.count) ? x->stts_durations[j] : 1;
+
+        // composition offset
+        j = search_index(x->ctts_samples, stbl->ctts.count, k);
+        compositions[count] = (j < stbl->ctts.count) ? read_32(&stbl->ctts.data[(j << 3) + 4]) : 0;
+
+        // location (ranges are only sent forward)
+        size = stbl->stsz.size ? stbl->stsz.size : x->stsz_offsets[k + 1] - x->stsz_offsets[k];
+        offset = locate_sample(stbl, k);
+        if (runs->count && runs->ranges[2 * runs->count - 1] > offset) goto error;
+        sizes[count] = size;
+        runs->ranges[2 * runs->count] = offset;
+        runs->ranges[2 * runs->count + 1] = offset + size;
+        runs->count++;
+        runs->size += size;
+    }
+
+    // durations (up to the next keyframe kept, or the end seek point)
+    for (i = 0; i < count; i++) {
+        t = (i + 1 < count) ? times[i + 1] : trak->end.time;
+        if (t > times[i]) {
+            durations[i] = t - times[i];
+        }
+        duration += durations[i];
+    }
+
+    // timeline
+    trak->mdia.mdhd.duration = duration;
+    write_time(&trak->mdia.mdhd, 16, 24);
+    trak->tkhd.duration = (uint64_t)ROUND((double)file->moov.mvhd.scale *
+                                         ((double)duration / (double)trak->mdia.mdhd.scale));
+    write_time(&trak->tkhd, 20, 28);
+    file->moov.mvhd.duration = trak->tkhd.duration;
+    write_time(&file->moov.mvhd, 16, 24);
+
+    // head size (copied atoms, containers and the new tables)
+    uint32_t stts = trick_entries(durations, count);
+    uint32_t ctts = VOID(stbl->ctts) ? 0 : trick_entries(compositions, count);
+    size_t   head = box_size(&file->ftyp) + box_size((xxxx_t*)&file->moov.mvhd) +
+                    box_size((xxxx_t*)&trak->tkhd) + box_size((xxxx_t*)&trak->mdia.mdhd) +
+                    box_size(&trak->mdia.hdlr) + box_size(&trak->mdia.minf.xmhd) +
+                    box_size(&stbl->stsd) + 5 * 8 + 36 +                        // containers, dinf
+                    16 + 8 * stts + (ctts ? 16 + 8 * ctts : 0) + 28 + 20 + 4 * count;
+    int      wide = (head + 16 + 8 * count + 16 + runs->size) > UINT32_MAX;     // co64
+    head += 16 + (wide ? 8 : 4) * count + (wide ? 16 : 8);                      // chunk offsets, mdat
+
+    // movie
+    uint8_t* data = (uint8_t*)ALLOC(head);
+    uint8_t* p = data;
+    box_copy(&p, &file->ftyp);
+    box[0] = box_open(&p, MOOV);
+    box_copy(&p, (xxxx_t*)&file->moov.mvhd);
+    box[1] = box_open(&p, TRAK);
+    box_copy(&p, (xxxx_t*)&trak->tkhd);
+    box[2] = box_open(&p, MDIA);
+    box_copy(&p, (xxxx_t*)&trak->mdia.mdhd);
+    box_copy(&p, &trak->mdia.hdlr);
+    box[3] = box_open(&p, MINF);
+    box_copy(&p, &trak->mdia.minf.xmhd);
+    box[4] = box_open(&p, DINF);
+    uint8_t* dref = box_open(&p, DREF);
+    box_word(&p, 0);
+    box_word(&p, 1);
+    uint8_t* url = box_open(&p, URL_);
+    box_word(&p, 1);                                                            // self-contained
+    box_close(url, p);
+    box_close(dref, p);
+    box_close(box[4], p);
+    box[4] = box_open(&p, STBL);
+    box_copy(&p, &stbl->stsd);
+    trick_table(&p, STTS, 0, durations, count, stts);
+    if (ctts) {
+        trick_table(&p, CTTS, stbl->ctts.version, compositions, count, ctts);
+    }
+    uint8_t* stsc = box_open(&p, STSC);                                         // one sample per chunk
+    box_word(&p, 0);
+    box_word(&p, 1);
+    box_word(&p, 1);
+    box_word(&p, 1);
+    box_word(&p, 1);
+    box_close(stsc, p);
+    uint8_t* stsz = box_open(&p, STSZ);
+    box_word(&p, 0);
+    box_word(&p, 0);
+    box_word(&p, count);
+    for (i = 0; i < count; i++) {
+        box_word(&p, sizes[i]);
+    }
+    box_close(stsz, p);
+    uint8_t* coxx = box_open(&p, wide ? CO64 : STCO);
+    box_word(&p, 0);
+    box_word(&p, count);
+    for (i = 0, offset = head; i < count; offset += sizes[i], i++) {
+        if (wide) {
+            write_64(p, offset);
+            p += 8;
+        } else {
+            box_word(&p, offset);
+        }
+    }
+    box_close(coxx, p);
+    box_close(box[4], p);
+    box_close(box[3], p);
+    box_close(box[2], p);
+    box_close(box[1], p);
+    box_close(box[0], p);
+
+    // media data header (the keyframes follow)
+    if (wide) {
+        box_word(&p, 1);
+        box_word(&p, MDAT);
+        write_64(p, runs->size + 16);
+        p += 8;
+    } else {
+        box_word(&p, runs->size + 8);
+        box_word(&p, MDAT);
+    }
+
+    // single vector
+    ZERO(iovs, sizeof(iovs_t));
+    iovs->iovs[0].iov_base = data;
+    iovs->iovs[0].iov_len = p - data;
+    iovs->count = 1;
+    iovs->size = p - data;
+    stream_head_keep(self, data);
+    goto done;
+
+    // error
+    error:
+    FREE(runs->ranges);
+    FREE(runs);
+
+    // done
+    done:
+    FREE(times);
+    FREE(durations);
+    FREE(compositions);
+    FREE(sizes);
+    return runs;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Seek results cache. Seeks always snap to the video keyframe preceding
+ * the requested time (on both ends), so all requests landing between the
+ * same keyframes produce identical heads. The keyframe times are cached
+ * ("keys") so that requests can be resolved to their keyframes without
+ * parsing and the compiled heads (without HTTP headers) are cached under
+ * the resolved pair ("seek:<start>:<stop>:head" and ":limits", with the
+ * track selection appended to the pair along with the ":runs" ranges).
+ */
+typedef struct {
+    off_t           file_offset;                // first byte sent from file
+    off_t           file_finish;                // last byte sent from file
+    double          start;                      // corrected start time
+    double          stop;                       // corrected stop time
+} limits_t;
+
+static uint64_t* compile_keys(trak_t* trak, int* size) {
+    stbl_t* stbl = &trak->mdia.minf.stbl;
+
+    // keyframes are only snapped to with a sync table and variable sample sizes
+    *size = 0;
+    if (VOID(*trak) || VOID(stbl->stss) || !stbl->stsz.count) return NULL;
+
+    // layout: scale, duration, total time, keyframe times
+    uint64_t* keys = (uint64_t*)ALLOC(sizeof(uint64_t) * (3 + stbl->stss.count));
+    keys[0] = trak->mdia.mdhd.scale;
+    keys[1] = MIN(trak->mdia.mdhd.duration, stbl->max_time);
+    keys[2] = stbl->max_time;
+
+    // decoding time of each keyframe
+    tidx_t*  x = &stbl->index;
+    uint32_t i, j;
+    uint64_t n, t, k;
+    for (i = 0; i < stbl->stss.count; i++) {
+        k = x->stss_samples[i];                                                 // keyframe sample number
+        j = search_index(x->stts_samples, stbl->stts.count, k);                 // stts entry
+        n = j ? x->stts_samples[j - 1] : 0;                                     // samples before entry
+        t = j ? x->stts_times[j - 1] : 0;                                       // time before entry
+        keys[3 + i] = (j < stbl->stts.count) ? t + (k - n) * x->stts_durations[j] : t;
+    }
+
+    // ready
+    *size = sizeof(uint64_t) * (3 + stbl->stss.count);
+    return keys;
+}
+
+static int snap_keys(uint64_t* keys, int count, uint64_t time) {
+
+    // past all samples (never snapped)
+    if (time >= keys[2]) return count + 1;
+
+    // number of keyframes at or before time
+    int low = 0, high = count;
+    while (low < high) {
+        int middle = (low + high) >> 1;
+        if (keys[3 + middle] <= time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static char* seek_name(stream_t* self, uint64_t* keys, int size) {
+
+    // track selection
+    const char* tracks = (self->tracks == STREAM_TRACKS_VIDEO) ? ":video" :
+                         (self->tracks == STREAM_TRACKS_AUDIO) ? ":audio" : "";
+
+    // exact times (without keyframes, the audio track alone is never snapped)
+    if (!keys || size < sizeof(uint64_t) * 3 || self->tracks == STREAM_TRACKS_AUDIO) {
+        return FORMAT("seek:%.6f:%.6f%s", self->start, self->stop, tracks);
+    }
+
+    // clamp as seek_trak() does
+    int      count = size / sizeof(uint64_t) - 3;
+    uint64_t start = (uint64_t)(self->start * (double)keys[0]);
+    uint64_t stop = (uint64_t)(self->stop * (double)keys[0]);
+    start = MIN(start, keys[1]);
+    if (!stop || stop > keys[1]) {
+        stop = keys[1];
+    }
+
+    // snap
+    return FORMAT("seek:%d:%d%s", snap_keys(keys, count, start), snap_keys(keys, count, stop), tracks);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Lazy movie loading. The moov atom is mapped instead of read and parsed in
+ * place, so only the headers of its atoms are touched (random access, no
+ * read-ahead), then the tables of the selected tracks are prefetched as a
+ * whole and all the parsed atoms are copied into a compact moov atom, which
+ * is the one cached and used from then on (other tracks, user data etc. are
+ * never read). The parsed atoms move along with their copies, so the model
+ * is built right away instead of parsing the compact atom once more. Major
+ * page faults taken meanwhile are counted (parse:faults).
+ */
+static void prefetch_atom(atom_t* atom, uintptr_t page) {
+    if (!atom->size || !atom->data) return;
+    uintptr_t start = (uintptr_t)atom->data & ~(page - 1);
+    madvise((void*)start, (uintptr_t)atom->data + atom->data_size - start, MADV_WILLNEED);
+}
+
+static void prefetch_trak(trak_t* trak, uintptr_t page) {
+    if (VOID(*trak)) return;
+    stbl_t* stbl = &trak->mdia.minf.stbl;
+    prefetch_atom(&stbl->stsd.atom, page);
+    prefetch_atom(&stbl->stts.atom, page);
+    prefetch_atom(&stbl->ctts.atom, page);
+    prefetch_atom(&stbl->stss.atom, page);
+    prefetch_atom(&stbl->stsc.atom, page);
+    prefetch_atom(&stbl->stsz.atom, page);
+    prefetch_atom(&stbl->coxx.atom, page);
+}
+
+static void compact_move(atom_t* atom, uint8_t* box) {
+    atom->flags &= ~F_EX;                                                       // regular header
+    atom->size = read_32(box);
+    atom->data = box + 8;
+    atom->data_size = atom->size - 8;
+    atom->data_position = 0;
+}
+
+static void compact_leaf(uint8_t** p, xxxx_t* s) {
+    if (VOID(*s)) return;
+    uint8_t* box = *p;
+    box_copy(p, s);
+    compact_move(&s->atom, box);
+}
+
+static void compact_stxx(uint8_t** p, stxx_t* s) {
+    if (VOID(*s)) return;
+    size_t offset = s->data ? s->data - s->atom.data : 0;
+    compact_leaf(p, (xxxx_t*)s);
+    if (s->data) {
+        s->data = s->atom.data + offset;
+    }
+}
+
+static void compact_trak(uint8_t** p, trak_t* trak) {
+    if (VOID(*trak)) return;
+    uint8_t* box[4];
+    stbl_t*  stbl = &trak->mdia.minf.stbl;
+
+    // same layout as parsed (leaves copied with regular headers)
+    box[0] = box_open(p, TRAK);
+    compact_leaf(p, (xxxx_t*)&trak->tkhd);
+    box[1] = box_open(p, MDIA);
+    compact_leaf(p, (xxxx_t*)&trak->mdia.mdhd);
+    compact_leaf(p, &trak->mdia.hdlr);
+    box[2] = box_open(p, MINF);
+    compact_leaf(p, &trak->mdia.minf.xmhd);
+    box[3] = box_open(p, STBL);
+    compact_leaf(p, &stbl->stsd);
+    compact_stxx(p, &stbl->stts);
+    compact_stxx(p, &stbl->ctts);
+    compact_stxx(p, &stbl->stss);
+    compact_stxx(p, &stbl->stsc);
+    compact_stxx(p, &stbl->stsz);
+    compact_stxx(p, &stbl->coxx);
+    box_close(box[3], *p);
+    box_close(box[2], *p);
+    box_close(box[1], *p);
+    box_close(box[0], *p);
+
+    // containers
+    compact_move(&stbl->atom, box[3]);
+    compact_move(&trak->mdia.minf.atom, box[2]);
+    compact_move(&trak->mdia.atom, box[1]);
+    compact_move(&trak->atom, box[0]);
+}
+
+static char* load_moov(stream_t* self, atom_t* atom, int* size, model_t** model, size_t* model_size) {
+    struct rusage usage;
+    long     faults = 0;
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    off_t    start = atom->start & ~((off_t)page - 1);
+    size_t   length = atom->end - start;
+    uint8_t* map = NULL;
+    uint8_t* base = NULL;
+    uint8_t* moov = NULL;
+    uint8_t* box;
+    uint8_t* p;
+    atom_t   parent;
+    moov_t   m;
+
+    // sanity check (cached atoms are sized by int, and mapping past the end of the file would fault)
+    *size = 0;
+    *model = NULL;
+    if (atom->size < 8 || atom->size > INT_MAX || atom->end > self->file_length) return NULL;
+    if (!getrusage(RUSAGE_THREAD, &usage)) {
+        faults = usage.ru_majflt;
+    }
+
+    // map (or read if mapping is not possible)
+    map = (uint8_t*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, self->file, start);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        base = (uint8_t*)ALLOC(atom->size);
+        if (pread(self->file, base, atom->size, atom->start) != atom->size) goto done;
+    } else {
+        madvise(map, length, MADV_RANDOM);
+        base = map + (atom->start - start);
+    }
+
+    // parse in place
+    ZERO(&m, sizeof(moov_t));
+    parent.data = base;
+    parent.data_size = atom->size;
+    parent.data_start = atom->start;
+    parent.data_position = 0;
+    if (data_atom(&parent, &m.atom) != MOOV || parse_moov(self, &m)) goto done;
+
+    // read the tables ahead
+    if (map) {
+        prefetch_trak(&m.vtrak, page);
+        prefetch_trak(&m.strak, page);
+    }
+
+    // compact (never larger than the original)
+    moov = (uint8_t*)ALLOC(atom->size);
+    p = moov;
+    box = box_open(&p, MOOV);
+    compact_leaf(&p, (xxxx_t*)&m.mvhd);
+    compact_trak(&p, &m.vtrak);
+    compact_trak(&p, &m.strak);
+    box_close(box, p);
+    compact_move(&m.atom, box);
+    *size = p - moov;
+
+    // build model (tables decoded once)
+    *model = compile_model(&m, moov, *size, model_size);
+
+    // done
+    done:
+    if (map) {
+        munmap(map, length);
+    } else {
+        FREE(base);
+    }
+    if (self->parse_faults && !getrusage(RUSAGE_THREAD, &usage)) {
+        (*self->parse_faults) += usage.ru_majflt - faults;
+    }
+    return (char*)moov;
 }
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -884,13 +2403,6 @@ static void compile_head(stream_t* self, file_t* file) {
 
 /*----------------------------------------------------------------------------------------------------------*/
 
-/*
- * Prepare worker for FLV parsing.
- */
-int stream_mp4_setup(worker_t* worker) {
-    return 0;
-}
-
 /*
  * Parser function implementation for the MP4 file format.
  */
@@ -903,77 +2415,117 @@ int stream_mp4_parse(stream_t* self) {
     file_t file;
     ZERO(&file, sizeof(file_t));
 
-    // offsets cache key
-    char* okey_name = FORMAT("%s:offsets", self->path);
-    int   okey_size = strlen(okey_name);
-
-    // zero-seek cache keys
-    char* hkey_name = FORMAT("%s:zero:head", self->path);
-    int   hkey_size = strlen(hkey_name);
-    char* lkey_name = FORMAT("%s:zero:limits", self->path);
-    int   lkey_size = strlen(lkey_name);
-
-    // generational cache keys
-    char* ftyp_key_name = NULL;
-    int   ftyp_key_size = 0;
-    char* moov_key_name = NULL;
-    int   moov_key_size = 0;
-    char* mdat_key_name = NULL;
-    int   mdat_key_size = 0;
-
     // main atoms (from cache)
     char* ftyp = NULL;
     int   ftyp_size = 0;
     char* moov = NULL;
-    int   moov_size;
+    int   moov_size = 0;
     char* mdat = NULL;
-    int   mdat_size;
+    int   mdat_size = 0;
+    void* model = NULL;
+    size_t model_size = 0;
+
+    // compiled head
+    iovs_t    iovs;
+    uint8_t*  heads = NULL;
+    char*     head = NULL;
+    int       head_size = 0;
+    ZERO(&iovs, sizeof(iovs_t));
+
+    // seek results
+    uint64_t* keys = NULL;
+    int       keys_size = 0;
+    uint64_t* segments = NULL;
+    int       segments_size = 0;
+    char*     name = NULL;
+    char*     key = NULL;
+
+    // track selection (file data sent, unknown if fragmented)
+    runs_t*   runs = NULL;
+    off_t     length = -1;
+
+    // tracks and trick-play only apply to progressive output (offsets follow the selected track)
+    if (self->format != STREAM_FORMAT_PLAIN) {
+        self->trick = 0;
+    }
+    if (self->format != STREAM_FORMAT_PLAIN || self->trick) {
+        self->tracks = STREAM_TRACKS_ALL;
+    }
+    const char* offsets_name = (self->tracks == STREAM_TRACKS_AUDIO) ? "offsets:audio" : "offsets";
 
-    // attempt zero-seek
-    int periods;
-    self->offsets = self->db ? tcadbget(self->db, okey_name, okey_size, &periods) : NULL;
+    // attempt cached seek
+    int periods = 0;
+    self->offsets = stream_cache_get(self, offsets_name, &periods);
     self->periods = periods / sizeof(off_t);
 
-    // perform zero-seek
-    if (self->offsets && !self->start && !self->stop) {
+    // perform cached seek (progressive heads only)
+    if (self->offsets && self->format == STREAM_FORMAT_PLAIN && !self->trick) {
 
-        // zero-head
-        int length = 0;
-        self->head = tcadbget(self->db, hkey_name, hkey_size, &length);
-        self->head_length = length;
+        // resolve
+        seek_spatial(self);
+        keys = stream_cache_get(self, "keys", &keys_size);
+        name = seek_name(self, keys, keys_size);
 
-        // zero-limits
+        // head
+        key = FORMAT("%s:head", name);
+        head = stream_cache_get(self, key, &head_size);
+        FREE(key);
+
+        // limits
         int limits_size = 0;
-        off_t* limits = tcadbget(self->db, lkey_name, lkey_size, &limits_size);
-        if (self->head && limits) {
-            self->file_offset = limits[0];
-            self->file_finish = limits[1];
+        key = FORMAT("%s:limits", name);
+        limits_t* limits = stream_cache_get(self, key, &limits_size);
+        if (head && limits && limits_size == sizeof(limits_t)) {
+            self->file_offset = limits->file_offset;
+            self->file_finish = limits->file_finish;
+            self->start = limits->start;
+            self->stop = limits->stop;
         } else {
-            FREE(self->head);
+            FREE(head);
         }
         FREE(limits);
+        FREE(key);
+
+        // ranges
+        if (head && self->tracks) {
+            int   ranges_size = 0;
+            key = FORMAT("%s:runs", name);
+            off_t* ranges = stream_cache_get(self, key, &ranges_size);
+            if (ranges) {
+                runs = map_runs(ranges, ranges_size);
+            } else {
+                FREE(head);
+            }
+            FREE(key);
+        }
     }
 
     // regenerate
-    if (self->head) {
+    if (head) {
 
         // count
         (*self->cache_hits)++;
 
-    } else {
+        // single vector
+        iovs.iovs[0].iov_base = head;
+        iovs.iovs[0].iov_len = head_size;
+        iovs.count = 1;
+        iovs.size = head_size;
+        stream_head_keep(self, head);
+        head = NULL;
+
+        // selected track
+        if (runs) {
+            length = send_runs(self, runs);
+            runs = NULL;
+        }
 
-        // generate keys
-        ftyp_key_name = FORMAT("%s:atom:ftyp", self->path);
-        ftyp_key_size = strlen(ftyp_key_name);
-        moov_key_name = FORMAT("%s:atom:moov", self->path);
-        moov_key_size = strlen(moov_key_name);
-        mdat_key_name = FORMAT("%s:atom:mdat", self->path);
-        mdat_key_size = strlen(mdat_key_name);
+    } else {
 
         // get stored data
-        ftyp = self->db ? tcadbget(self->db, ftyp_key_name, ftyp_key_size, &ftyp_size) : NULL;
-        moov = self->db ? tcadbget(self->db, moov_key_name, moov_key_size, &moov_size) : NULL;
-        mdat = self->db ? tcadbget(self->db, mdat_key_name, mdat_key_size, &mdat_size) : NULL;
+        ftyp = stream_cache_get(self, "atom:ftyp", &ftyp_size);
+        moov = stream_cache_get(self, "atom:moov", &moov_size);
+        mdat = stream_cache_get(self, "atom:mdat", &mdat_size);
 
         // reload meta-data
         atom_t atom;
@@ -990,7 +2542,10 @@ int stream_mp4_parse(stream_t* self) {
                 case FTYP: _SAVE_ATOM(ftyp); left--; break;
                 case MDAT: atom.size = atom.data_start - atom.start;
                            _SAVE_ATOM(mdat); if (!mdat) left--; break;
-                case MOOV: _SAVE_ATOM(moov); left--; break;
+                case MOOV: FREE(model);
+                           moov = load_moov(self, &atom, &moov_size, (model_t**)&model, &model_size);
+                           if (!moov) goto error;
+                           left--; break;
                 case ____: goto error; break;
                 }
                 self->file_offset = atom.end;
@@ -1001,13 +2556,12 @@ int stream_mp4_parse(stream_t* self) {
             if (!mdat) goto error;                                              // missing MDAT
 
             // store in cache
-            if (self->db) {
-                if (ftyp) {
-                    tcadbput(self->db, ftyp_key_name, ftyp_key_size, ftyp, ftyp_size);
-                }
-                tcadbput(self->db, moov_key_name, moov_key_size, moov, moov_size);
-                tcadbput(self->db, mdat_key_name, mdat_key_size, mdat, mdat_size);
+            if (ftyp) {
+                stream_cache_put(self, "atom:ftyp", ftyp, ftyp_size);
             }
+            stream_cache_put(self, "atom:moov", moov, moov_size);
+            stream_cache_put(self, "atom:mdat", mdat, mdat_size);
+            stream_cache_put(self, "model", model, model_size);
 
         } else {
 
@@ -1025,14 +2579,6 @@ int stream_mp4_parse(stream_t* self) {
             }
         }
 
-        // map moov
-        atom.data = moov;
-        atom.data_size = moov_size;
-        atom.data_position = 0;
-        if (data_atom(&atom, &file.moov.atom) == ____) {
-            goto error;
-        }
-
         // map mdat
         atom.data = mdat;
         atom.data_size = mdat_size;
@@ -1041,9 +2587,46 @@ int stream_mp4_parse(stream_t* self) {
             goto error;
         }
 
-        // parse meta-data
-        if (parse_moov(self, &file.moov)) {
-            goto error;
+        // map parsed model (built while loading, or from cache)
+        if (!model) {
+            int size = 0;
+            model = stream_cache_get(self, "model", &size);
+            model_size = size;
+        }
+        if (map_model(&file.moov, model, model_size, (uint8_t*)moov, moov_size)) {
+            FREE(model);
+            ZERO(&file.moov, sizeof(moov_t));
+
+            // map moov
+            atom.data = moov;
+            atom.data_size = moov_size;
+            atom.data_position = 0;
+            if (data_atom(&atom, &file.moov.atom) == ____) {
+                goto error;
+            }
+
+            // parse meta-data
+            if (parse_moov(self, &file.moov)) {
+                goto error;
+            }
+
+            // build model (tables decoded once)
+            model = compile_model(&file.moov, (uint8_t*)moov, moov_size, &model_size);
+            stream_cache_put(self, "model", model, model_size);
+            if (map_model(&file.moov, model, model_size, (uint8_t*)moov, moov_size)) {
+                goto error;
+            }
+        } else {
+            clear_mvhd(&file.moov.mvhd);
+        }
+
+        // drop the other track
+        if (self->tracks == STREAM_TRACKS_VIDEO) {
+            if (VOID(file.moov.vtrak)) goto error;
+            ZERO(&file.moov.strak, sizeof(trak_t));
+        } else if (self->tracks == STREAM_TRACKS_AUDIO) {
+            if (VOID(file.moov.strak)) goto error;
+            ZERO(&file.moov.vtrak, sizeof(trak_t));
         }
 
         // get duration (periods)
@@ -1051,10 +2634,6 @@ int stream_mp4_parse(stream_t* self) {
         self->periods = ceil((double)file.moov.mvhd.duration / (double)file.moov.mvhd.scale);
         if (!self->periods) goto error;
 
-        // compile limits
-        if (!VOID(file.moov.vtrak)) compile_maxs(&file.moov.vtrak.mdia.minf.stbl);
-        if (!VOID(file.moov.strak)) compile_maxs(&file.moov.strak.mdia.minf.stbl);
-
         // regenerate offsets (if required)
         if (!self->offsets) {
 
@@ -1062,173 +2641,217 @@ int stream_mp4_parse(stream_t* self) {
             trak_t* trak = VOID(file.moov.vtrak) ? &file.moov.strak : &file.moov.vtrak;
 
             // convert period
-            uint32_t period = self->period * trak->mdia.mdhd.scale;
-
-            // shortcut
-            stbl_t*  stbl = &trak->mdia.minf.stbl;
+            uint64_t period = self->period * trak->mdia.mdhd.scale;
 
-            // cursors
-            uint32_t i;
-            uint8_t* p;
-            uint32_t u = 0, d = 0, c = 0;
-            uint32_t t = 0, n = 0, k = 0;
-
-            uint32_t time = 0;
-            tbli_t   sample = {0, 0};
-            uint32_t sample_id = 0;
-            tbli_t   chunk = {0, 0};
-            uint32_t chunk_last = 0;
-            uint32_t chunk_id = 0;
-            uint32_t chunk_sample = 0;
-
-            uint32_t offset;
-
-            // allocate space
+            // generate
             self->offsets = (off_t*)ALLOC(sizeof(off_t) * self->periods);
+            if (stream_lazy(self) && self->format == STREAM_FORMAT_PLAIN && !self->trick && !self->spatial &&
+                self->periods > STREAM_OFFSETS_CHUNK) {
+
+                // lazily, when served progressively (the model is kept until the table is complete)
+                lazy_t* lazy = (lazy_t*)ZALLOC(sizeof(lazy_t));
+                lazy->model = model;
+                lazy->stbl = trak->mdia.minf.stbl;
+                lazy->period = period;
+                lazy->name = offsets_name;
+                self->extend = compile_lazy;
+                self->extend_state = lazy;
+                model = NULL;
+                extend_offsets(&lazy->stbl, period, lazy->cursors, self->offsets, 0, STREAM_OFFSETS_CHUNK);
+                self->offsets_ready = STREAM_OFFSETS_CHUNK;
+                stream_complete(self);
 
-            // walk space-time
-            for (i = 0; i < self->periods; i++, time += period) {
-
-                // find sample number
-                p = stbl->stts.data + 8 * sample.index;
-                u = d = c = 0;
-                for (; sample.index < stbl->stts.count; sample.index++, p += 8) {
-                    c  = read_32(&p[0]);                                        // read count
-                    d  = read_32(&p[4]);                                        // read duration
-                    u  = c * d;                                                 // whole entry time
-                    if ((t + u) > time) break;                                  // break if passed
-                    n += c;                                                     // increment count
-                    t += u;                                                     // increment time
-                    d  = 1;
-                }
-                if (!d) {
-                    sample_id     = stbl->max_samples;
-                } else {
-                    sample.offset = (time - t) / d;                             // save offset
-                    sample_id     = MIN(n + sample.offset, stbl->max_samples);  // save sample number
-                }
-
-                // find chunk number
-                p = stbl->stsc.data + 12 * chunk.index;
-                u = d = c = 0;
-                for (; chunk.index < stbl->stsc.count; chunk.index++, p += 12) {
-                    c = read_32(&p[4]);                                         // read samples per chunk
-                    d = (chunk.index == (stbl->stsc.count - 1)) ?               // read next chunk number
-                         stbl->max_chunks : (read_32(&p[12]) - 1);
-                    u = d - chunk_last;                                         // chunks in this entry
-                    d = u * c;                                                  // samples in this entry
-                    if ((k + d) > sample_id) break;                             // went too far?
-                    k += d;                                                     // increment samples
-                    chunk_last += u;                                            // increment chunks
-                    c = 1;
-                }
-                if (!c) {
-                    chunk_id = stbl->max_chunks;
-                    chunk_sample = 0;
-                } else {
-                    d = sample_id - k;                                          // sample within entry
-                    chunk.offset = d / c;                                       // save offset
-                    chunk_id = chunk_last + chunk.offset;                       // save chunk number
-                    chunk_sample = d % c;                                       // sample within chunk
-                }
-
-                // look-up stco/co64
-                if (chunk_id < stbl->max_chunks) {
-                    offset = read_xx(&stbl->coxx.data[chunk_id *                // read offset from array
-                                                      stbl->coxx.bytes],
-                                     stbl->coxx.bytes << 3);
-                } else {
-                    offset = stbl->max_offset;                                  // use end-of-data
-                }
-
-                // look-up stsz
-                if (stbl->stsz.size) {
-                    offset += chunk_sample * stbl->stsz.size;
-                } else if (chunk_sample) {
-                    u = chunk_sample;
-                    while (u) {
-                        offset += read_32(&stbl->stsz.data[(sample_id - u) << 2]);
-                        u--;
-                    }
-                }
+            } else {
 
-                // store offset
-                self->offsets[i] = offset;
-            }
+                // at once
+                compile_offsets(&trak->mdia.minf.stbl, period, self->offsets, self->periods);
 
-            // store offsets
-            if (self->db) {
-                tcadbput(self->db, okey_name, okey_size, self->offsets, sizeof(off_t) * self->periods);
+                // store offsets
+                stream_cache_put(self, offsets_name, self->offsets, sizeof(off_t) * self->periods);
             }
         }
 
         // normalize limits
-        if (self->spatial == true) {
-            int i;
-            if (self->start) {
-                for (i = self->periods - 1; i >= 0; i--) {
-                    if (self->offsets[i] < self->start) {
-                        self->start = i * self->period;
-                        break;
-                    }
-                }
+        seek_spatial(self);
+
+        // resolve keyframes (if not cached)
+        if (!keys) {
+            keys = stream_cache_get(self, "keys", &keys_size);
+        }
+        if (!keys) {
+            keys = compile_keys(&file.moov.vtrak, &keys_size);
+            if (keys) {
+                stream_cache_put(self, "keys", keys, keys_size);
             }
-            if (i < 0) {
-                self->start = 0;
+        }
+        FREE(name);
+        name = seek_name(self, keys, keys_size);
+
+        // resolve segments (if not cached), sent unthrottled
+        if (self->format == STREAM_FORMAT_HLS || self->format == STREAM_FORMAT_DASH ||
+            self->format == STREAM_FORMAT_SEGMENT) {
+            segments = stream_cache_get(self, "segments", &segments_size);
+            if (!segments || segments_size < sizeof(uint64_t) * 3) {
+                FREE(segments);
+                segments = compile_segments(&file, keys, keys_size, &segments_size);
+                stream_cache_put(self, "segments", segments, segments_size);
             }
-            if (self->stop) {
-                for (i = self->periods - 1; i >= 0; i--) {
-                    if (self->offsets[i] < self->stop) {
-                        self->stop = i * self->period;
-                        break;
-                    }
+            self->throttle = 0;
+        }
+
+        // segment times (half a unit past the keyframes so they snap onto them)
+        if (self->format == STREAM_FORMAT_SEGMENT) {
+            int count = segments_size / sizeof(uint64_t) - 2;
+            if (self->segment >= count) goto error;
+            self->start = 0;
+            self->stop = 0;
+            if (self->segment >= 0) {
+                self->start = (segments[2 + self->segment] + 0.5) / (double)segments[0];
+                if (self->segment + 1 < count) {
+                    self->stop = (segments[3 + self->segment] + 0.5) / (double)segments[0];
                 }
             }
-            if (i < 0) {
-                self->stop = 0;
-            }
         }
 
         // reset byte offsets
         self->file_offset = 0;
         self->file_finish = 0;
 
-        // perform seek on each track
-        compile_trak(self, &file, &file.moov.vtrak);
-        compile_trak(self, &file, &file.moov.strak);
+        // playlists (no file data)
+        if (self->format == STREAM_FORMAT_HLS || self->format == STREAM_FORMAT_DASH) {
+            char* playlist = compile_playlist(self, &file, segments, segments_size);
+            iovs.iovs[0].iov_base = playlist;
+            iovs.iovs[0].iov_len = strlen(playlist);
+            iovs.count = 1;
+            iovs.size = iovs.iovs[0].iov_len;
+            stream_head_keep(self, playlist);
+
+        // fragmented output (the movie is kept to compile the fragments while sending)
+        } else if (self->format == STREAM_FORMAT_FMP4 || self->format == STREAM_FORMAT_SEGMENT) {
+            frag_t* frag = (frag_t*)ZALLOC(sizeof(frag_t));
+            frag->moov = moov;
+            frag->model = model;
+            frag->file = file;
+            frag->segment = (self->format == STREAM_FORMAT_SEGMENT) ? self->segment : -1;
+            self->fragment = compile_fragment;
+            self->fragment_state = frag;
+            moov = NULL;
+            model = NULL;
+            seek_frag(self, frag);
+
+            // init segment (alone, or before the fragments)
+            if (frag->segment < 0) {
+                compile_init(self, frag, &iovs);
+            }
+            if (self->format == STREAM_FORMAT_SEGMENT && frag->segment < 0) {
+                self->file_offset = self->file_finish = 0;
+            }
 
-        // recalibrate meta-data
-        compile_moov(self, &file);
-        compile_mdat(self, &file);
+        // trick-play (keyframes only, sent unthrottled)
+        } else if (self->trick) {
+            runs = compile_trick(self, &file, self->trick, &iovs);
+            if (!runs) goto error;
+            length = send_runs(self, runs);
+            runs = NULL;
+            self->throttle = 0;
 
-        // asssemble headers/atoms
-        compile_head(self, &file);
+        } else {
+
+            // perform seek on each track
+            seek_trak(self, &file, &file.moov.vtrak);
+            seek_trak(self, &file, &file.moov.strak);
+
+            // byte ranges of the selected track (walked before its tables are clipped)
+            if (self->tracks) {
+                runs = compile_runs(VOID(file.moov.vtrak) ? &file.moov.strak : &file.moov.vtrak);
+                if (!runs) goto error;
+            }
 
-        // store zero-seek head
-        if (self->db && !self->start && !self->stop) {
-            off_t limits[2] = { self->file_offset, self->file_finish };
-            tcadbput(self->db, hkey_name, hkey_size, self->head, self->head_length);
-            tcadbput(self->db, lkey_name, lkey_size, limits, sizeof(off_t) * 2);
+            // restructure each track
+            compile_trak(self, &file, &file.moov.vtrak);
+            compile_trak(self, &file, &file.moov.strak);
+
+            // recalibrate meta-data
+            compile_moov(self, &file);
+            compile_mdat(self, &file, runs);
+
+            // asssemble atoms (vectors into moov, ftyp and the patched heads)
+            heads = (uint8_t*)ALLOC(STREAM_MP4_IOVS * 16);
+            compile_head(self, &file, runs, &iovs, heads);
+
+            // store seek result
+            limits_t limits = { self->file_offset, self->file_finish, self->start, self->stop };
+            key = FORMAT("%s:head", name);
+            stream_cache_putv(self, key, iovs.iovs, iovs.count);
+            FREE(key);
+            key = FORMAT("%s:limits", name);
+            stream_cache_put(self, key, &limits, sizeof(limits_t));
+            FREE(key);
+            if (runs) {
+                key = FORMAT("%s:runs", name);
+                stream_cache_put(self, key, runs->ranges, sizeof(off_t) * 2 * runs->count);
+                FREE(key);
+                length = send_runs(self, runs);
+                runs = NULL;
+            }
+
+            // referenced buffers now belong to the stream
+            stream_head_keep(self, heads);
+            stream_head_keep(self, moov);
+            stream_head_keep(self, ftyp);
+            heads = NULL;
+            moov = NULL;
+            ftyp = NULL;
         }
     }
 
+    // first fragment (the stream compiles the following ones while sending)
+    if (self->fragment == compile_fragment && self->file_offset < self->file_finish) {
+        size_t   moof_size = 0;
+        uint8_t* moof = compile_moof(self, (frag_t*)self->fragment_state, &moof_size);
+        if (!moof) goto error;
+        iovs.iovs[iovs.count].iov_base = moof;
+        iovs.iovs[iovs.count].iov_len = moof_size;
+        iovs.count++;
+        iovs.size += moof_size;
+        stream_head_keep(self, moof);
+    }
+    if (self->fragment == compile_fragment && self->fragment_finish >= self->file_finish) {
+        self->fragment(self, 1);
+        self->fragment = NULL;
+    }
+
+    // prepend HTTP headers
+    if (!self->fragment) {
+        length = self->file_finish - self->file_offset;
+    }
+    compile_http(self, &iovs, length);
+
     // success
     goto done;
 
     // error
     error:
+    if (self->extend) {
+        self->extend(self, 1);
+        self->extend = NULL;
+    }
     status = 1;
 
     // done
     done:
-    FREE(okey_name);
-    FREE(hkey_name);
-    FREE(lkey_name);
-    FREE(ftyp_key_name);
-    FREE(moov_key_name);
-    FREE(mdat_key_name);
+    FREE(heads);
+    FREE(head);
     FREE(ftyp);
     FREE(moov);
     FREE(mdat);
+    FREE(keys);
+    FREE(segments);
+    FREE(name);
+    FREE(model);
+    if (runs) {
+        FREE(runs->ranges);
+        FREE(runs);
+    }
     return status;
 }
@@ -13,10 +13,10 @@
 /*----------------------------------------------------------------------------------------------------------*/
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "core.h"
 #include "stream.h"
-#include "worker.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
 
@@ -24,6 +24,27 @@
  * MP4 mime.
  */
 #define STREAM_MP4_MIME "video/mp4"
+#define STREAM_MP4_HLS_MIME "application/vnd.apple.mpegurl"
+#define STREAM_MP4_DASH_MIME "application/dash+xml"
+
+/*
+ * Fragmented output: target duration of each fragment (in seconds, fragments
+ * always start on a keyframe of the video track so they may run longer).
+ */
+#define STREAM_MP4_FRAGMENT 2.0
+
+/*
+ * Segmented output (HLS/DASH): target duration of each segment (in seconds,
+ * segments also start on keyframes) and the time segments and playlists may
+ * be cached by clients and proxies (in seconds).
+ */
+#define STREAM_MP4_SEGMENT 6.0
+#define STREAM_MP4_MAX_AGE 86400
+
+/*
+ * Cached model layout version (bumped on every change of the structures below).
+ */
+#define STREAM_MP4_MODEL 1
 
 /*----------------------------------------------------------------------------------------------------------*/
 
@@ -63,6 +84,22 @@
 #define STCO        ATOM('s', 't', 'c', 'o')    // 32bit chunk offsets table
 #define CO64        ATOM('c', 'o', '6', '4')    // 64bit chunk offsets table
 #define MDAT        ATOM('m', 'd', 'a', 't')    // media data
+#define DINF        ATOM('d', 'i', 'n', 'f')    // data information
+#define DREF        ATOM('d', 'r', 'e', 'f')    // data references
+#define URL_        ATOM('u', 'r', 'l', ' ')    // data reference (url)
+#define MVEX        ATOM('m', 'v', 'e', 'x')    // movie extends (fragmented)
+#define TREX        ATOM('t', 'r', 'e', 'x')    // track extends (defaults)
+#define MOOF        ATOM('m', 'o', 'o', 'f')    // movie fragment
+#define MFHD        ATOM('m', 'f', 'h', 'd')    // movie fragment header
+#define TRAF        ATOM('t', 'r', 'a', 'f')    // track fragment
+#define TFHD        ATOM('t', 'f', 'h', 'd')    // track fragment header
+#define TFDT        ATOM('t', 'f', 'd', 't')    // track fragment decode time
+#define TRUN        ATOM('t', 'r', 'u', 'n')    // track fragment run
+#define AVC1        ATOM('a', 'v', 'c', '1')    // AVC sample entry
+#define AVC3        ATOM('a', 'v', 'c', '3')    // AVC sample entry (in-band parameters)
+#define AVCC        ATOM('a', 'v', 'c', 'C')    // AVC decoder configuration
+#define MP4A        ATOM('m', 'p', '4', 'a')    // MPEG-4 audio sample entry
+#define ESDS        ATOM('e', 's', 'd', 's')    // elementary stream descriptor
 
 /*
  * Atom flags and test routines.
@@ -73,17 +110,15 @@
 /*----------------------------------------------------------------------------------------------------------*/
 
 /*
- * Gather-write buffers structure (emulation).
+ * Gather-write buffers structure (the compiled head is sent using writev()
+ * straight from the atom buffers, see stream_head_add()).
  */
-typedef struct {
-    void*  base;
-    size_t size;
-} iov_t;
+#define STREAM_MP4_IOVS 70                      // assume buffer fragments (and 16-byte heads)
 
 typedef struct {
-    iov_t           iovs[70];                   // assume buffer fragments
+    struct iovec    iovs[STREAM_MP4_IOVS];      // vectors
     uint32_t        count;                      // number of vectors
-    uint64_t        size;
+    uint64_t        size;                       // total size
 } iovs_t;
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -112,6 +147,42 @@ typedef struct {
 
 /*----------------------------------------------------------------------------------------------------------*/
 
+/*
+ * Track seek index (native, built once per file and cached). Tables are
+ * decoded from the big-endian atoms into 64bit values and the counting
+ * ones hold cumulative values at the end of each entry of the matching
+ * atom, so that a seek is a handful of binary searches and array reads
+ * instead of table walks.
+ */
+typedef struct {
+    uint32_t        stts_count;                 // stts entries
+    uint32_t        stss_count;                 // stss entries
+    uint32_t        ctts_count;                 // ctts entries
+    uint32_t        stsc_count;                 // stsc entries
+    uint32_t        stsz_count;                 // stsz entries
+    uint32_t        coxx_count;                 // stco/co64 entries
+    uint64_t        max_offset;                 // byte end offset
+    uint64_t        max_chunks;                 // total chunks
+    uint64_t        max_samples;                // total samples
+    uint64_t        max_time;                   // total time uints
+} tidx_head_t;
+
+typedef struct {
+    tidx_head_t*    head;                       // index header (table counts and limits)
+    uint64_t*       stts_samples;               // samples up to the end of each stts entry
+    uint64_t*       stts_times;                 // decoding time up to the end of each stts entry
+    uint64_t*       stts_durations;             // sample duration of each stts entry
+    uint64_t*       stss_samples;               // keyframe sample numbers (zero based)
+    uint64_t*       ctts_samples;               // samples up to the end of each ctts entry
+    uint64_t*       stsc_samples;               // samples up to the end of each stsc entry
+    uint64_t*       stsc_chunks;                // chunks before each stsc entry (plus total)
+    uint64_t*       stsc_sizes;                 // samples per chunk of each stsc entry
+    uint64_t*       stsz_offsets;               // bytes before each sample (plus total)
+    uint64_t*       coxx_offsets;               // chunk offsets
+} tidx_t;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
 /*
  * Format structures.
  */
@@ -164,6 +235,8 @@ typedef struct {
     stxx_t          stsc;                       // sample-to-chunks
     stxx_t          stsz;                       // sample sizes
     stxx_t          coxx;                       // 32/64bit chunk offsets
+
+    tidx_t          index;                      // seek index
 } stbl_t;
 
 typedef struct {
@@ -195,18 +268,81 @@ typedef struct {
     trak_t          strak;                      // sound track
 } moov_t;
 
+/*
+ * Parsed movie model (built once per file and cached as "model"). The moov
+ * structure is stored with its pointers relative to the cached moov atom
+ * (no offset is ever 0 since the atom starts with its own header) and is
+ * followed by the video and sound track indexes, so that a cache hit only
+ * needs to rebase a few pointers instead of re-parsing the atoms.
+ */
+typedef struct {
+    uint32_t        version;                    // STREAM_MP4_MODEL
+    uint32_t        moov_size;                  // size of the moov atom it was parsed from
+    uint32_t        vtidx_size;                 // video track index size in bytes
+    uint32_t        stidx_size;                 // sound track index size in bytes
+    moov_t          moov;                       // parsed movie meta data (relative pointers)
+} model_t;
+
 typedef struct {
     xxxx_t          ftyp;                       // file compatibility
     moov_t          moov;                       // movie meta data
     xxxx_t          mdat;                       // actual movie data
 } file_t;
 
-/*----------------------------------------------------------------------------------------------------------*/
+/*
+ * Fragmented output state. The parsed movie (and the buffers it points into)
+ * is kept with the stream and each track is walked by a cursor that only
+ * moves forward, one fragment at a time (see STREAM_FORMAT_FMP4).
+ */
+typedef struct {
+    trak_t*         trak;                       // track (NULL if missing)
+    uint32_t        id;                         // track id
+    uint64_t        sample;                     // next sample number
+    uint64_t        samples;                    // end sample number (exclusive)
+    uint64_t        time;                       // decoding time of next sample (since start)
+    uint32_t        stts;                       // stts entry of next sample
+    uint32_t        ctts;                       // ctts entry of next sample
+    uint32_t        stss;                       // next keyframe (stss entry)
+    uint32_t        stsc;                       // stsc entry of next sample
+    uint64_t        chunk;                      // chunk of next sample
+    uint64_t        chunk_sample;               // first sample of that chunk
+} cursor_t;
+
+typedef struct {
+    char*           moov;                       // moov atom (sample tables)
+    void*           model;                      // parsed model (seek indexes)
+    file_t          file;                       // movie (pointing into the above)
+    cursor_t        cursors[2];                 // video and sound track cursors
+    uint32_t        sequence;                   // last fragment sequence number
+    int             segment;                    // segment number (-1 for progressive fragments)
+} frag_t;
+
+/*
+ * Lazy offsets state (see stream_extend_f). The model is kept to merge the
+ * period times with the tables of the throttling track a chunk at a time,
+ * resuming from the saved cursors.
+ */
+typedef struct {
+    void*           model;                      // parsed model (seek indexes)
+    stbl_t          stbl;                       // throttling track tables (only the index is used)
+    uint64_t        period;                     // period in track time units
+    uint32_t        cursors[2];                 // stts and stsc cursors
+    const char*     name;                       // cache entry of the complete table
+} lazy_t;
 
 /*
- * Prepare worker for FLV parsing.
+ * Track selection state (see STREAM_TRACKS_*). The mdat only holds the byte
+ * ranges of the file where the samples of the selected track are stored
+ * (contiguous samples merged), which are sent one after the other.
  */
-int stream_mp4_setup(worker_t* worker);
+typedef struct {
+    off_t*          ranges;                     // start and end offset of each range (in file order)
+    size_t          count;                      // number of ranges
+    size_t          index;                      // range being sent
+    off_t           size;                       // total size of the ranges
+} runs_t;
+
+/*----------------------------------------------------------------------------------------------------------*/
 
 /*
  * Parser function implementation for the MP4 file format.
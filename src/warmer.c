@@ -0,0 +1,486 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * warmer.c: Background cache warmer (crawler and hot list replay).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stream_flv.h"
+#include "stream_mp4.h"
+#include "warmer.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Hot list record (used when saving).
+ */
+typedef struct {
+    int                 count;
+    char*               key;
+} warm_hot_t;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Append a job to the shared queue (path and mime are copied).
+ */
+static void _queue_push(warmer_t* self, const char* path, const char* mime, double start) {
+
+    // prepare node
+    warm_node_t* node = (warm_node_t*)ZALLOC(sizeof(warm_node_t));
+    node->path = STRDUP(path);
+    node->mime = STRDUP(mime);
+    node->start = start;
+
+    // acquire lock
+    pthread_spin_lock(&self->lock);
+
+    // append
+    node->prev = self->tail->prev;
+    node->next = self->tail;
+    self->tail->prev->next = node;
+    self->tail->prev = node;
+
+    // release lock
+    pthread_spin_unlock(&self->lock);
+}
+
+/*
+ * Retrieve a pending job from the shared queue. The path and mime are
+ * taken over by the caller and must be freed. The function will return
+ * 0 on success and 1 if queue was empty.
+ */
+static int _queue_pop(warmer_t* self, char** path, char** mime, double* start) {
+
+    // prepare
+    warm_node_t* node = NULL;
+    *path = NULL;
+    *mime = NULL;
+    *start = 0;
+
+    // acquire lock
+    pthread_spin_lock(&self->lock);
+
+    // pop
+    int empty = 1;
+    if (self->head->next != self->tail) {
+
+        // extract
+        node = self->head->next;
+        self->head->next = node->next;
+        node->next->prev = self->head;
+
+        // assign
+        *path = node->path;
+        *mime = node->mime;
+        *start = node->start;
+
+        // ready
+        FREE(node);
+        empty = 0;
+    }
+
+    // release lock
+    pthread_spin_unlock(&self->lock);
+
+    // done
+    return empty;
+}
+
+/*
+ * Find the mime of a file path by its extension (NULL if not served).
+ */
+static const char* _warmer_mimeof(warmer_t* self, const char* path) {
+    const char* type = strrchr(path, '.');
+    if (!type || strchr(type, '/') || !self->types) return NULL;
+    char** pair;
+    for (pair = self->types; pair[0] && pair[1]; pair += 2) {
+        if (!strcasecmp(type + 1, pair[0])) {
+            return pair[1];
+        }
+    }
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Queue all files (and seek points) listed in the hot list (hottest first).
+ */
+static void _warmer_replay(warmer_t* self) {
+
+    // open
+    FILE* file = fopen(self->hotlist, "r");
+    if (!file) return;
+
+    // read ("count\tmime\tpath\tstart" lines)
+    size_t count = 0;
+    char   line[PATH_MAX + 256];
+    while (!self->stopping && fgets(line, sizeof(line), file)) {
+        char* mime = strchr(line, '\t');
+        char* path = mime ? strchr(mime + 1, '\t') : NULL;
+        if (!path) continue;
+        *mime++ = *path++ = 0;
+        path[strcspn(path, "\r\n")] = 0;
+        char* start = strrchr(path, '\t');
+        if (start) {
+            *start++ = 0;
+        }
+        _queue_push(self, path, mime, start ? strtod(start, NULL) : 0);
+        count++;
+    }
+
+    // done
+    fclose(file);
+    INFO("Replaying hot list \"%s\" (%lu files).", self->hotlist, (unsigned long)count);
+}
+
+/*
+ * Recursively queue all the known media files in a folder.
+ */
+static void _warmer_crawl(warmer_t* self, const char* folder) {
+
+    // open
+    DIR* dir = opendir(folder);
+    if (!dir) return;
+
+    // walk
+    struct dirent* entry;
+    struct stat info;
+    while (!self->stopping && (entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
+        char* path = FORMAT("%s%s%s", folder, folder[strlen(folder) - 1] == '/' ? "" : "/", entry->d_name);
+        if (!lstat(path, &info)) {
+            if (S_ISDIR(info.st_mode)) {
+                _warmer_crawl(self, path);
+            } else if (S_ISREG(info.st_mode)) {
+                warmer_enqueue(self, path);
+            }
+        }
+        FREE(path);
+    }
+
+    // done
+    closedir(dir);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Parse a single file into the cache (and the offsets tables), seeking at
+ * the given start position so that its compiled head is cached as well.
+ */
+static void _warmer_parse(warm_thread_t* self, const char* path, const char* mime, double start) {
+
+    // detached stream
+    warmer_t* warmer = self->warmer;
+    stream_t* stream = stream_detached(path, mime, warmer->period, &self->counter);
+    stream->start = start;
+    stream->db = warmer->db;
+    stream->index = warmer->index;
+
+    // parse
+    if (stream_open(stream) || stream_parse(stream)) {
+        WARNING("File \"%s\" could not be warmed!", path);
+        self->failed++;
+        goto done;
+    }
+
+    // schedule indexing
+    if (stream->index_stale && warmer->indexer) {
+        indexer_enqueue(warmer->indexer, stream->path, stream->mime);
+    }
+
+    // success
+    TRACE("Warmed \"%s\".", path);
+    self->warmed++;
+
+    // done
+    done:
+    stream_destroy(stream);
+    FREE(stream);
+}
+
+/*
+ * Rate limiter tick (one file per tick).
+ */
+static void _warmer_tick_cb(struct ev_loop* loop, ev_timer* watcher, int events) {
+
+    // get self
+    warm_thread_t* self = (warm_thread_t*)((char*)watcher - offsetof(warm_thread_t, tick_w));
+    char*          path = NULL;
+    char*          mime = NULL;
+    double         start = 0;
+
+    // consume
+    if (!self->warmer->stopping && !_queue_pop(self->warmer, &path, &mime, &start)) {
+        _warmer_parse(self, path, mime, start);
+        FREE(path);
+        FREE(mime);
+    }
+}
+
+/*
+ * Shutdown handler.
+ */
+static void _warmer_stop_cb(struct ev_loop* loop, ev_async* watcher, int events) {
+    ev_unloop(loop, EVUNLOOP_ALL);
+}
+
+/*
+ * Warming thread main work loop.
+ */
+static void* _warmer_run(void* data) {
+
+    // get self
+    warm_thread_t* self = (warm_thread_t*)data;
+    warmer_t* warmer = self->warmer;
+
+    // configure
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    // first thread gathers the jobs
+    if (self->id == 1) {
+        if (warmer->hotlist) {
+            _warmer_replay(warmer);
+        }
+        char** folder;
+        for (folder = warmer->folders; folder && *folder && !warmer->stopping; folder++) {
+            _warmer_crawl(warmer, *folder);
+        }
+    }
+
+    // enter loop
+    TRACE("Warmer %u is up.", self->id);
+    ev_loop(self->loop, 0);
+
+    // end gracefully
+    TRACE("Warmer %u is down!", self->id);
+    pthread_exit(NULL);
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor.
+ */
+int warmer_new(warmer_t* self) {
+
+    // initialise
+    pthread_spin_init(&self->lock, 0);
+    self->head = (warm_node_t*)ZALLOC(sizeof(warm_node_t));
+    self->tail = (warm_node_t*)ZALLOC(sizeof(warm_node_t));
+    self->head->next = self->tail;
+    self->tail->prev = self->head;
+
+    // check
+    if (!self->threads || self->rate <= 0) {
+        ERROR("Warmer needs at least one thread and a positive rate!");
+        return 1;
+    }
+
+    // threads
+    int i;
+    double interval = (double)self->threads / self->rate;
+    self->pool = (warm_thread_t*)ZALLOC(sizeof(warm_thread_t) * self->threads);
+    for (i = 0; i < self->threads; i++) {
+        warm_thread_t* thread = &self->pool[i];
+        thread->id = i + 1;
+        thread->warmer = self;
+
+        // event loop
+        thread->loop = ev_loop_new(0);
+        if (!thread->loop) {
+            ERROR("Could not create new event loop for warmer %u!", thread->id);
+            return 1;
+        }
+
+        // watchers (ticks are spread evenly between threads)
+        ev_timer_init(&thread->tick_w, _warmer_tick_cb, interval * (i + 1) / self->threads, interval);
+        ev_timer_start(thread->loop, &thread->tick_w);
+        ev_async_init(&thread->stop_w, _warmer_stop_cb);
+        ev_async_start(thread->loop, &thread->stop_w);
+
+        // spawn
+        if (pthread_create(&thread->thread, NULL, _warmer_run, thread)) {
+            ERROR("Could not spawn warmer %u!", thread->id);
+            return 1;
+        }
+    }
+
+    // success
+    return 0;
+}
+
+/*
+ * Destructor (pending jobs are discarded).
+ */
+int warmer_destroy(warmer_t* self) {
+
+    // stop threads
+    int i;
+    self->stopping = 1;
+    for (i = 0; self->pool && i < self->threads; i++) {
+        warm_thread_t* thread = &self->pool[i];
+        if (thread->thread) {
+            ev_async_send(thread->loop, &thread->stop_w);
+            if (pthread_join(thread->thread, NULL)) {
+                pthread_cancel(thread->thread);
+                WARNING("Warmer %u stalled, and was cancelled!", thread->id);
+            }
+        }
+        if (thread->loop) {
+            ev_loop_destroy(thread->loop);
+        }
+    }
+
+    // discard pending jobs
+    char*  path = NULL;
+    char*  mime = NULL;
+    double start = 0;
+    if (self->head) {
+        while (!_queue_pop(self, &path, &mime, &start)) {
+            FREE(path);
+            FREE(mime);
+        }
+    }
+
+    // purge internals
+    pthread_spin_destroy(&self->lock);
+    FREE(self->pool);
+    FREE(self->head);
+    FREE(self->tail);
+
+    // done
+    ZERO(self, sizeof(warmer_t));
+    return 0;
+}
+
+/*
+ * Schedule a file for warming, if its type has parsed metadata (the mime
+ * is deduced from the file extension). Returns 0 on success, 1 otherwise.
+ */
+int warmer_enqueue(warmer_t* self, const char* path) {
+
+    // only parsed formats have metadata
+    const char* mime = _warmer_mimeof(self, path);
+    if (!mime || (strcmp(mime, STREAM_MP4_MIME) && strcmp(mime, STREAM_FLV_MIME))) {
+        return 1;
+    }
+
+    // enlist file
+    _queue_push(self, path, mime, 0);
+    return 0;
+}
+
+/*
+ * Get the total number of warmed (or failed) files.
+ */
+size_t warmer_warmed(warmer_t* self) {
+    size_t i, result = 0;
+    for (i = 0; i < self->threads; i++) {
+        result += self->pool[i].warmed;
+    }
+    return result;
+}
+
+size_t warmer_failed(warmer_t* self) {
+    size_t i, result = 0;
+    for (i = 0; i < self->threads; i++) {
+        result += self->pool[i].failed;
+    }
+    return result;
+}
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Hot list ordering (hottest first).
+ */
+static int _warmer_hotter(const void* a, const void* b) {
+    return ((const warm_hot_t*)b)->count - ((const warm_hot_t*)a)->count;
+}
+
+/*
+ * Save the hottest entries of the given dispatch counts database (keys are
+ * "mime\tpath\tstart", values are tcadbaddint() counters) as a hot list file.
+ * Returns 0 on success and 1 on error.
+ */
+int warmer_save(const char* hotlist, TCADB* hot) {
+
+    // initialize
+    int         status = 1;
+    size_t      i, count = 0, size = tcadbrnum(hot);
+    warm_hot_t* entries = (warm_hot_t*)ZALLOC(sizeof(warm_hot_t) * (size + 1));
+    char*       temp = FORMAT("%s.%d", hotlist, (int)getpid());
+    FILE*       file = NULL;
+
+    // collect
+    int   ksize = 0;
+    char* key;
+    tcadbiterinit(hot);
+    while (count < size && (key = tcadbiternext(hot, &ksize))) {
+        int  vsize = 0;
+        int* value = (int*)tcadbget(hot, key, ksize, &vsize);
+        if (value && vsize == sizeof(int)) {
+            entries[count].count = *value;
+            entries[count].key = key;
+            count++;
+        } else {
+            FREE(key);
+        }
+        FREE(value);
+    }
+
+    // hottest first
+    qsort(entries, count, sizeof(warm_hot_t), _warmer_hotter);
+
+    // write
+    file = fopen(temp, "w");
+    if (!file) goto error;
+    for (i = 0; i < count && i < WARMER_HOTLIST_SIZE; i++) {
+        if (fprintf(file, "%d\t%s\n", entries[i].count, entries[i].key) < 0) goto error;
+    }
+    if (fclose(file)) {
+        file = NULL;
+        goto error;
+    }
+    file = NULL;
+
+    // commit
+    if (rename(temp, hotlist)) goto error;
+
+    // success
+    INFO("Saved hot list \"%s\" (%lu files).", hotlist, (unsigned long)MIN(count, WARMER_HOTLIST_SIZE));
+    status = 0;
+    goto done;
+
+    // error
+    error:
+    WARNING("Could not save hot list \"%s\" (%s)!", hotlist, strerror(errno));
+    if (file) {
+        fclose(file);
+    }
+    unlink(temp);
+
+    // done
+    done:
+    for (i = 0; i < count; i++) {
+        FREE(entries[i].key);
+    }
+    FREE(entries);
+    FREE(temp);
+    return status;
+}
@@ -0,0 +1,158 @@
+/*
+ * The Loomiere Project (http://valeriu.palos.ro/loomiere/).
+ *
+ * warmer.h: Background cache warmer (crawler and hot list replay).
+ *
+ * Read the LICENSE file!
+ * Copyright (C)2010 Valeriu Paloş (valeriu@palos.ro). All rights reserved!
+ */
+
+#ifndef __warmer_h__
+#define __warmer_h__
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#include <ev.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <pthread.h>
+#include <tcadb.h>
+
+#include "cache.h"
+#include "core.h"
+#include "index.h"
+#include "stream.h"
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Warming constants.
+ */
+#define WARMER_HOTLIST_SIZE     10000   // maximum entries saved in the hot list
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Job node for the warmer queue.
+ */
+typedef struct warm_node_t {
+
+    // internals
+    char*               path;
+    char*               mime;
+    double              start;
+    struct warm_node_t* next;
+    struct warm_node_t* prev;
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(char*) * 2 +
+                        sizeof(double) +
+                        sizeof(struct warm_node_t*) * 2);
+} warm_node_t CACHE_ALIGNED;
+
+/*
+ * Warming thread (all threads share the warmer queue).
+ */
+typedef struct warm_thread_t {
+
+    // arguments
+    unsigned int        id;             // thread number (1 also crawls)
+    struct warmer_t*    warmer;         // owner
+
+    // internals
+    size_t              warmed;         // files parsed into the cache
+    size_t              failed;         // files that could not be parsed
+    size_t              counter;        // cache statistics (ignored)
+
+    pthread_t           thread;         // thread handle
+    struct ev_loop*     loop;           // event loop
+
+    ev_timer            tick_w;         // rate limiter
+    ev_async            stop_w;         // shutdown handler
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(unsigned int) +
+                        sizeof(struct warmer_t*) +
+                        sizeof(size_t) * 3 +
+                        sizeof(pthread_t) +
+                        sizeof(struct ev_loop*) +
+                        sizeof(ev_timer) +
+                        sizeof(ev_async));
+
+} warm_thread_t CACHE_ALIGNED;
+
+/*
+ * Warmer object. Files are queued from the hot list saved at the last
+ * shutdown (hottest files and seek points first, so that their compiled
+ * heads get cached too), then from a crawl of the given folders and then
+ * as they appear on disk (see notify.h). Each thread parses at most one
+ * file per tick so that warming never competes with live i/o.
+ */
+typedef struct warmer_t {
+
+    // arguments
+    unsigned int        threads;        // number of warming threads
+    double              rate;           // files parsed per second (all threads)
+    double              period;         // throttling period (in seconds)
+    char*               hotlist;        // hot list file (may be NULL)
+    char**              folders;        // crawled folders (NULL terminated)
+    char**              types;          // file extension and mime pairs (NULL terminated)
+    cache_t*            db;             // cache database
+    char*               index;          // sidecar files folder
+    indexer_t*          indexer;        // background indexer
+
+    // internals
+    int                 stopping;       // shutdown in progress
+    pthread_spinlock_t  lock;           // spinlock
+    warm_node_t*        head;           // queue head
+    warm_node_t*        tail;           // queue tail
+    warm_thread_t*      pool;           // warming threads
+
+    // alignment
+    CACHE_ALIGNMENT(    sizeof(unsigned int) +
+                        sizeof(double) * 2 +
+                        sizeof(char*) * 2 +
+                        sizeof(char**) * 2 +
+                        sizeof(cache_t*) +
+                        sizeof(indexer_t*) +
+                        sizeof(int) +
+                        sizeof(pthread_spinlock_t) +
+                        sizeof(warm_node_t*) * 2 +
+                        sizeof(warm_thread_t*));
+
+} warmer_t CACHE_ALIGNED;
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+/*
+ * Constructor (arguments are prepared in self).
+ */
+int warmer_new(warmer_t* self);
+
+/*
+ * Destructor (pending jobs are discarded).
+ */
+int warmer_destroy(warmer_t* self);
+
+/*
+ * Schedule a file for warming, if its type has parsed metadata (the mime
+ * is deduced from the file extension). Returns 0 on success, 1 otherwise.
+ */
+int warmer_enqueue(warmer_t* self, const char* path);
+
+/*
+ * Get the total number of warmed (or failed) files.
+ */
+size_t warmer_warmed(warmer_t* self);
+size_t warmer_failed(warmer_t* self);
+
+/*
+ * Save the hottest entries of the given dispatch counts database (keys are
+ * "mime\tpath\tstart", values are tcadbaddint() counters) as a hot list file.
+ * Returns 0 on success and 1 on error.
+ */
+int warmer_save(const char* hotlist, TCADB* hot);
+
+/*----------------------------------------------------------------------------------------------------------*/
+
+#endif
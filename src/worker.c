@@ -9,7 +9,6 @@
 
 #include <pthread.h>
 
-#include "amf.h"
 #include "worker.h"
 
 /*----------------------------------------------------------------------------------------------------------*/
@@ -179,16 +178,6 @@ int worker_new(worker_t* self) {
     // statistics
     self->data_pivot = ev_now(self->loop);
 
-    // Lua state
-    self->lua = lua_open();
-    luaL_openlibs(self->lua);
-    load_core_c(self->lua);
-    load_amf_lua(self->lua);
-
-    // parsers
-    stream_flv_setup(self);
-    stream_mp4_setup(self);
-
     // spawn
     return pthread_create(&self->thread, NULL, _worker_run, self);
 }
@@ -209,7 +198,6 @@ int worker_destroy(worker_t* self) {
 
     // purge internals
     ev_loop_destroy(self->loop);
-    lua_close(self->lua);
     pthread_spin_destroy(&self->lock);
     FREE(self->head);
     FREE(self->tail);
@@ -229,16 +217,25 @@ int worker_enqueue(worker_t* self, stream_t* stream) {
     // pass-on context
     stream->db = self->db;
     stream->loop = self->loop;
-    stream->lua = self->lua;
+    stream->index = self->index;
+    stream->indexer = self->indexer;
+    stream->flight = self->flight;
+    stream->parser = self->parser;
+    stream->wasted = self->wasted;
 
     // pass-on statistics
     stream->load = &self->load;
     stream->cache_hits = &self->cache_hits;
     stream->cache_misses = &self->cache_misses;
+    stream->parse_faults = &self->parse_faults;
     stream->data_total = &self->data_total;
     stream->delay_sum = &self->delay_sum;
     stream->delay_count = &self->delay_count;
     stream->delay_average = &self->delay_average;
+    stream->data_saved = &self->data_saved;
+    stream->data_wasted = &self->data_wasted;
+    stream->resent_sum = &self->resent_sum;
+    stream->resent_count = &self->resent_count;
 
     // enlist stream
     return _queue_push(self, COMMAND_LOAD, stream);
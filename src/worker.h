@@ -19,6 +19,7 @@
 #include <stddef.h>
 #include <tcadb.h>
 
+#include "cache.h"
 #include "core.h"
 #include "stream.h"
 
@@ -58,7 +59,12 @@ typedef struct worker_t {
 
     // arguments
     size_t              id;             // worker id code
-    TCADB*              db;             // cache database
+    cache_t*            db;             // cache database
+    char*               index;          // sidecar files folder
+    struct indexer_t*   indexer;        // background indexer
+    struct flight_t*    flight;         // parses in flight (shared)
+    struct parser_t*    parser;         // parser pool (shared)
+    TCADB*              wasted;         // data wasted by host (shared)
 
     // internals
     size_t              load;           // active streams
@@ -66,9 +72,14 @@ typedef struct worker_t {
     ev_tstamp           data_pivot;     // start-time of transfer measurement
     size_t              cache_hits;     // number of successful db gets
     size_t              cache_misses;   // number of failed db gets
+    size_t              parse_faults;   // major page faults while loading metadata
     double              delay_sum;      // total sum of delays
     double              delay_count;    // total number of delays
     double              delay_average;  // total number of delays
+    double              data_saved;     // data not sent thanks to adaptive run-ahead
+    double              data_wasted;    // data sent past the play-head of viewers gone
+    double              resent_sum;     // total data retransmitted (closed streams)
+    double              resent_count;   // total data sent (closed streams)
 
     pthread_t           thread;         // thread handle
     pthread_spinlock_t  lock;           // spinlock
@@ -76,20 +87,23 @@ typedef struct worker_t {
     task_node_t*        tail;           // incoming queue tail
 
     struct ev_loop*     loop;           // event loop
-    lua_State*          lua;            // utility Lua state
 
     ev_async            async_w;        // asynchronous command handler
 
     // alignment
-    CACHE_ALIGNMENT(    sizeof(size_t) * 5 +
-                        sizeof(double) * 3 +
+    CACHE_ALIGNMENT(    sizeof(size_t) * 6 +
+                        sizeof(double) * 7 +
                         sizeof(ev_tstamp) +
                         sizeof(pthread_t) +
                         sizeof(pthread_spinlock_t) +
                         sizeof(task_node_t*) * 2 +
+                        sizeof(cache_t*) +
+                        sizeof(char*) +
+                        sizeof(struct indexer_t*) +
+                        sizeof(struct flight_t*) +
+                        sizeof(struct parser_t*) +
                         sizeof(TCADB*) +
                         sizeof(struct ev_loop*) +
-                        sizeof(lua_State*) +
                         sizeof(ev_async));
 
 } worker_t CACHE_ALIGNED;